@@ -0,0 +1,51 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace bragi::midi::v1;
+
+// A voice repeating one note, at its own rate and velocity
+Voice drone(Sequencer& seq, uint8_t pitch, double every, uint8_t velocity) {
+    for ( int i = 0; i < 8; i++ ) {
+        seq.send(note_on(pitch, velocity));
+        co_await seq.beats(every / 2);
+
+        seq.send(note_off(pitch));
+        co_await seq.beats(every / 2);
+    }
+}
+
+// Starts a new voice every beat, for as long as the tempo stays above 60 BPM
+Voice conductor(Sequencer& seq) {
+    std::mt19937                       random(7);
+    std::uniform_int_distribution<int> pitch(48, 84);
+    std::uniform_int_distribution<int> rate(1, 4);
+
+    while ( seq.tempo() > 60 ) {
+        seq.spawn(drone(seq, static_cast<uint8_t>(pitch(random)), rate(random) / 2.0, 40));
+        co_await seq.beats(1);
+
+        seq.set_tempo(seq.tempo() - 1);
+    }
+}
+
+int main() {
+    // Ensure at least 1 midi device available - this is guaranteed only for Windows
+    std::shared_ptr<Output> output = std::make_shared<Output>(0);
+
+    output->connect();
+
+    Sequencer seq(output, 120);
+
+    // Hundreds of voices all run on this thread
+    for ( uint8_t pitch = 36; pitch < 96; pitch++ )
+        seq.spawn(drone(seq, pitch, 4 + pitch % 5, 20));
+    seq.spawn(conductor(seq));
+
+    seq.run();
+
+    std::printf("Worst lateness: %lld us\n",
+                static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(seq.lateness()).count()));
+}
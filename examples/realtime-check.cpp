@@ -0,0 +1,181 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+
+using namespace bragi::midi::v1;
+
+// Usage: realtime-check
+//
+// Checks that RealtimeOutput keeps its promises, by replacing malloc, operator new and pthread_mutex_lock for the
+// whole program. While the real-time thread is inside send(), note_on() or note_off(), any allocation or lock fails
+// the check, as does any allocation on the worker thread while it drains the queue. Exits with 1 on failure.
+//
+// Only works with glibc, which provides __libc_malloc and friends to forward to.
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+}
+
+static thread_local bool   guarded       = false;
+static thread_local bool   locks_guarded = false;
+static std::atomic<size_t> allocations{0};
+static std::atomic<size_t> locks{0};
+
+static void allocated() {
+    if ( guarded )
+        allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void* malloc(size_t size) {
+    allocated();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    allocated();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    allocated();
+    return __libc_realloc(ptr, size);
+}
+
+void* operator new(size_t size) {
+    allocated();
+    if ( void* ptr = __libc_malloc(size ? size : 1) )
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+using lock_function = int (*)(pthread_mutex_t*);
+
+// Resolved before anything is guarded, as dlsym may allocate
+static lock_function real_lock = reinterpret_cast<lock_function>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    if ( locks_guarded )
+        locks.fetch_add(1, std::memory_order_relaxed);
+    return real_lock(mutex);
+}
+
+/**
+ * @brief Discards messages, guarding the worker thread from the first message it drains
+ */
+class GuardingBackend : public OutputBackend {
+    public:
+        std::atomic<size_t> received{0};
+
+        void connect() override {}
+        void disconnect() override {}
+
+        void send_short(uint8_t, uint8_t, uint8_t) override {
+            guarded = true;
+            received.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void send_long(const uint8_t*, size_t) override {}
+        bool physical_device() const override { return false; }
+        uint16_t manufacturer_id() const override { return 0; }
+        uint16_t product_id() const override { return 0; }
+        std::string product_name() const override { return "realtime-check"; }
+};
+
+int main() {
+    // Make sure the replacements are actually called, or the check below proves nothing
+    {
+        std::mutex probe;
+        guarded       = true;
+        locks_guarded = true;
+        delete new int(0);
+        probe.lock();
+        locks_guarded = false;
+        guarded       = false;
+        probe.unlock();
+
+        if ( allocations.exchange(0) == 0 || locks.exchange(0) == 0 ) {
+            std::printf("FAILED: allocations or locks are not intercepted\n");
+            return 1;
+        }
+    }
+
+    GuardingBackend*        backend = new GuardingBackend();
+    std::shared_ptr<Output> output  = std::make_shared<Output>(std::unique_ptr<OutputBackend>(backend));
+    output->connect();
+
+    constexpr size_t count = 100000;
+    size_t           sent, rt_allocations, rt_locks;
+
+    {
+        RealtimeOutput rt(output, 4096, std::chrono::microseconds(50));
+
+        std::thread audio([&]() {
+            for ( size_t i = 0; i < count; i++ ) {
+                uint8_t pitch = static_cast<uint8_t>(i % 128);
+
+                guarded       = true;
+                locks_guarded = true;
+                bool queued   = i % 2 ? rt.note_off(pitch) : rt.note_on(pitch);
+                queued        = rt.send(ShortMessage(MessageType::controller_change, 1, pitch)) && queued;
+                locks_guarded = false;
+                guarded       = false;
+
+                // Give the worker time to catch up rather than dropping everything
+                if ( !queued )
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+        audio.join();
+
+        // Checked before the worker's final drain and exit, which are not part of the hot path
+        sent = count * 2 - rt.dropped();
+        while ( backend->received.load() < sent )
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        rt_allocations = allocations.load();
+        rt_locks       = locks.load();
+    }
+
+    std::printf("Sent %zu messages, %zu dropped\n", sent, count * 2 - sent);
+    std::printf("Allocations in send or drain: %zu\n", rt_allocations);
+    std::printf("Locks in send:                %zu\n", rt_locks);
+
+    if ( sent == 0 || rt_allocations != 0 || rt_locks != 0 ) {
+        std::printf("FAILED\n");
+        return 1;
+    }
+
+    std::printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace bragi::midi::v1;
+
+// Usage: rtp-peer PORT [HOST HOST_PORT]
+//
+// Listens for a session on PORT and prints every message received. Given a host, invites it and plays a C major
+// scale, eg. on one machine
+//   rtp-peer 5004
+// and on another, or in a second terminal with a different port
+//   rtp-peer 5006 127.0.0.1 5004
+int main(int argc, char** argv) {
+    if ( argc != 2 && argc != 4 ) {
+        std::fprintf(stderr, "Usage: %s PORT [HOST HOST_PORT]\n", argv[0]);
+        return 2;
+    }
+
+    RtpMidiSession session("bragi", static_cast<uint16_t>(std::atoi(argv[1])));
+
+    session.set_receiver([](const Message& msg) {
+        for ( uint8_t byte : msg.serialize() )
+            std::printf(" %02X", byte);
+        std::printf("\n");
+        std::fflush(stdout);
+    });
+
+    if ( argc == 2 ) {
+        while ( true )
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    session.invite(argv[2], static_cast<uint16_t>(std::atoi(argv[3])));
+
+    for ( uint8_t pitch : {60, 62, 64, 65, 67, 69, 71, 72} ) {
+        session.send(note_on(pitch, 100));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        session.send(note_off(pitch, 0));
+    }
+
+    session.flush();
+    RtpMidiStats stats = session.stats();
+    std::printf("%zu packets sent\n", stats.packets_sent);
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace bragi::midi::v1;
+
+// Usage: scan-corpus [-j THREADS] [FILE...]
+//
+// With no files given, paths are read from standard input one per line, eg.
+//   find library -name '*.mid' | scan-corpus -j 16
+int main(int argc, char** argv) {
+    unsigned int             threads = 0;
+    std::vector<std::string> paths;
+
+    for ( int i = 1; i < argc; i++ ) {
+        if ( std::strcmp(argv[i], "-j") == 0 && i + 1 < argc )
+            threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if ( paths.empty() )
+        for ( std::string line; std::getline(std::cin, line); )
+            if ( !line.empty() )
+                paths.push_back(line);
+
+    CorpusStats stats = scan_corpus(paths, threads);
+
+    std::cout << "Files:     " << stats.files << " scanned, " << stats.errors.size() << " malformed\n";
+    std::cout << "Events:    " << stats.events << "\n";
+    std::cout << "Notes:     " << stats.notes << "\n";
+
+    if ( stats.files ) {
+        std::cout << "Duration:  " << stats.total_duration << " s total, " << stats.min_duration << " - "
+                  << stats.max_duration << " s per file\n";
+        std::cout << "Tempo:     " << stats.min_bpm << " - " << stats.max_bpm << " BPM\n";
+    }
+
+    std::cout << "Programs:\n";
+    for ( size_t i = 0; i < stats.programs.size(); i++ )
+        if ( stats.programs[i] )
+            std::cout << "  " << i << ": " << stats.programs[i] << "\n";
+
+    for ( const ScanError& error : stats.errors )
+        std::cerr << error.path << ": " << error.what << "\n";
+
+    return stats.errors.empty() ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <chrono>
+#include <cstdio>
+
+using namespace bragi::midi::v1;
+
+// Usage: shm-monitor NAME
+//
+// Prints every message published by a ShmOutput of the given name, with the delay between publishing and reading.
+int main(int argc, char** argv) {
+    if ( argc < 2 ) {
+        std::fprintf(stderr, "Usage: %s NAME\n", argv[0]);
+        return 2;
+    }
+
+    ShmReader  reader(argv[1]);
+    ShmMessage msg;
+
+    while ( true ) {
+        if ( !reader.read(msg, std::chrono::seconds(1)) )
+            continue;
+
+        long long now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        std::printf("%8.3f us |", (now - msg.time) / 1e3);
+        for ( uint8_t byte : msg.bytes )
+            std::printf(" %02X", byte);
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+}
@@ -0,0 +1,1024 @@
+/**
+ * @file bragi_midi.cpp
+ * @brief Python bindings, built as the @c bragi_midi extension module
+ *
+ * Besides wrapping Message, Output and Note one call at a time, the bulk functions take any object supporting the
+ * buffer protocol - bytes, bytearray, memoryview, array or NumPy arrays - and work through it in C++ with the GIL
+ * released, without copying it first.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <bragi/midi/v1/midi.hh>
+
+using namespace bragi::midi::v1;
+
+namespace {
+/********************************/
+/* Helpers                      */
+/********************************/
+/// @brief Raise the Python exception matching the C++ exception being handled
+void set_error() {
+    try {
+        throw;
+    } catch ( std::system_error& err ) {
+        PyErr_SetString(PyExc_OSError, err.what());
+    } catch ( std::invalid_argument& err ) {
+        PyErr_SetString(PyExc_ValueError, err.what());
+    } catch ( std::domain_error& err ) {
+        PyErr_SetString(PyExc_ValueError, err.what());
+    } catch ( std::length_error& err ) {
+        PyErr_SetString(PyExc_ValueError, err.what());
+    } catch ( std::range_error& err ) {
+        PyErr_SetString(PyExc_ValueError, err.what());
+    } catch ( std::underflow_error& err ) {
+        PyErr_SetString(PyExc_ValueError, err.what());
+    } catch ( std::bad_alloc& ) {
+        PyErr_NoMemory();
+    } catch ( std::exception& err ) {
+        PyErr_SetString(PyExc_RuntimeError, err.what());
+    }
+}
+
+/**
+ * @brief Run @b work with the GIL released
+ *
+ * @returns false with the Python exception set if @b work threw
+ */
+template <typename Work>
+bool without_gil(Work&& work) {
+    std::exception_ptr failure;
+
+    PyThreadState* state = PyEval_SaveThread();
+    try {
+        work();
+    } catch ( ... ) {
+        failure = std::current_exception();
+    }
+    PyEval_RestoreThread(state);
+
+    if ( !failure )
+        return true;
+
+    try {
+        std::rethrow_exception(failure);
+    } catch ( ... ) {
+        set_error();
+    }
+    return false;
+}
+
+/// @brief A borrowed view of a buffer-protocol object, released on destruction
+class Buffer {
+    protected:
+        Py_buffer view;
+        bool      acquired;
+
+    public:
+        Buffer(PyObject* obj, int flags) { acquired = PyObject_GetBuffer(obj, &view, flags) == 0; }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        ~Buffer() {
+            if ( acquired )
+                PyBuffer_Release(&view);
+        }
+
+        /// @brief false with the Python exception set if the object does not support the requested view
+        bool ok() const { return acquired; }
+
+        uint8_t* data() const { return static_cast<uint8_t*>(view.buf); }
+
+        size_t size() const { return static_cast<size_t>(view.len); }
+
+        size_t itemsize() const { return static_cast<size_t>(view.itemsize); }
+};
+
+bool to_byte(PyObject* obj, uint8_t& value) {
+    unsigned long converted = PyLong_AsUnsignedLong(obj);
+    if ( PyErr_Occurred() )
+        return false;
+    if ( converted > 0xFF ) {
+        PyErr_SetString(PyExc_ValueError, "Value must fit in a byte!");
+        return false;
+    }
+    value = static_cast<uint8_t>(converted);
+    return true;
+}
+
+/**
+ * @brief Splits a stream of bytes into messages, as received from a MIDI port
+ *
+ * Channel messages may use running status, and realtime messages may appear between any two messages.
+ */
+class StreamReader {
+    protected:
+        const uint8_t* pos;
+        const uint8_t* end;
+        uint8_t        running = 0;
+
+    public:
+        StreamReader(const uint8_t* data, size_t size): pos(data), end(data + size) {}
+
+        /// @brief Bytes read so far
+        size_t offset(const uint8_t* start) const { return static_cast<size_t>(pos - start); }
+
+        /**
+         * @brief Read the next message
+         *
+         * A system exclusive message leaves @b msg invalid and is returned through @b long_msg and @b long_size.
+         *
+         * @returns false at the end of the stream
+         *
+         * @throws std::invalid_argument if a data byte has no status, or a message is cut short by a status byte
+         * @throws std::domain_error if a status byte is not a known message type
+         * @throws std::underflow_error if the stream ends within a message
+         */
+        bool next(ShortMessage& msg, const uint8_t*& long_msg, size_t& long_size) {
+            if ( pos >= end )
+                return false;
+
+            msg       = ShortMessage();
+            long_size = 0;
+
+            uint8_t first = *pos;
+            if ( first >= 0xF8 ) {
+                msg = ShortMessage(first);
+                pos++;
+                return true;
+            }
+
+            if ( first == MessageType::system_exclusive ) {
+                const uint8_t* stop = static_cast<const uint8_t*>(
+                    std::memchr(pos, MessageType::end_of_system_exclusive, static_cast<size_t>(end - pos)));
+                if ( !stop )
+                    throw std::underflow_error("System exclusive message is not terminated!");
+
+                long_msg  = pos;
+                long_size = static_cast<size_t>(stop - pos) + 1;
+                pos       = stop + 1;
+                running   = 0;
+                return true;
+            }
+
+            uint8_t status = first & 0x80 ? first : running;
+            if ( !status )
+                throw std::invalid_argument("Data byte without a status byte!");
+            if ( first & 0x80 )
+                pos++;
+
+            size_t size = short_message_size(status);
+            if ( size == 0 )
+                throw std::domain_error("Invalid message type!");
+            if ( static_cast<size_t>(end - pos) < size - 1 )
+                throw std::underflow_error("Message is missing data!");
+
+            msg = ShortMessage(status, size > 1 ? pos[0] : 0, size > 2 ? pos[1] : 0);
+            if ( !msg.valid() )
+                throw std::invalid_argument("Message interrupted by a status byte!");
+
+            pos += size - 1;
+            running = status < 0xF0 ? status : 0;
+            return true;
+        }
+};
+
+/********************************/
+/* Message                      */
+/********************************/
+struct PyMessage {
+    PyObject_HEAD
+    Message msg;
+};
+
+extern PyTypeObject message_type;
+
+PyObject* wrap(const Message& msg) {
+    PyMessage* self = PyObject_New(PyMessage, &message_type);
+    if ( !self )
+        return nullptr;
+    new (&self->msg) Message(msg);
+    return reinterpret_cast<PyObject*>(self);
+}
+
+Message& unwrap(PyObject* self) {
+    return reinterpret_cast<PyMessage*>(self)->msg;
+}
+
+PyObject* message_new(PyTypeObject* type, PyObject*, PyObject*) {
+    PyMessage* self = reinterpret_cast<PyMessage*>(type->tp_alloc(type, 0));
+    if ( self )
+        new (&self->msg) Message();
+    return reinterpret_cast<PyObject*>(self);
+}
+
+void message_dealloc(PyObject* self) {
+    unwrap(self).~Message();
+    Py_TYPE(self)->tp_free(self);
+}
+
+int message_init(PyObject* self, PyObject* args, PyObject*) {
+    PyObject* value = nullptr;
+    if ( !PyArg_ParseTuple(args, "|O", &value) )
+        return -1;
+    if ( !value )
+        return 0;
+
+    try {
+        if ( PyLong_Check(value) ) {
+            uint8_t msg_type;
+            if ( !to_byte(value, msg_type) )
+                return -1;
+            unwrap(self) = Message(msg_type);
+            return 0;
+        }
+
+        Buffer bytes(value, PyBUF_SIMPLE);
+        if ( !bytes.ok() )
+            return -1;
+        unwrap(self) = Message::parse(std::basic_string<uint8_t>(bytes.data(), bytes.size()));
+        return 0;
+    } catch ( ... ) {
+        set_error();
+        return -1;
+    }
+}
+
+PyObject* message_serialize(PyObject* self, PyObject*) {
+    try {
+        std::basic_string<uint8_t> bytes = unwrap(self).serialize();
+        return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(bytes.data()),
+                                         static_cast<Py_ssize_t>(bytes.size()));
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* message_repr(PyObject* self) {
+    try {
+        std::string text = "Message(";
+        char        hex[4];
+        for ( uint8_t byte : unwrap(self).serialize() ) {
+            std::snprintf(hex, sizeof(hex), text.size() > 8 ? " %02X" : "%02X", byte);
+            text += hex;
+        }
+        return PyUnicode_FromString((text + ")").c_str());
+    } catch ( ... ) {
+        return PyUnicode_FromString("Message(<malformed>)");
+    }
+}
+
+Py_ssize_t message_length(PyObject* self) {
+    try {
+        return static_cast<Py_ssize_t>(unwrap(self).size());
+    } catch ( ... ) {
+        set_error();
+        return -1;
+    }
+}
+
+PyObject* message_compare(PyObject* self, PyObject* other, int op) {
+    if ( !PyObject_TypeCheck(other, &message_type) || (op != Py_EQ && op != Py_NE) )
+        Py_RETURN_NOTIMPLEMENTED;
+
+    try {
+        bool equal = unwrap(self).serialize() == unwrap(other).serialize();
+        return PyBool_FromLong(equal == (op == Py_EQ));
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+template <typename Value, Value (Message::*Get)() const>
+PyObject* message_get(PyObject* self, PyObject*) {
+    try {
+        return PyLong_FromUnsignedLong((unwrap(self).*Get)());
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+template <Message& (Message::*Set)(uint8_t)>
+PyObject* message_set(PyObject* self, PyObject* arg) {
+    uint8_t value;
+    if ( !to_byte(arg, value) )
+        return nullptr;
+
+    try {
+        (unwrap(self).*Set)(value);
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+    Py_INCREF(self);
+    return self;
+}
+
+PyObject* message_set_int(PyObject* self, PyObject* arg) {
+    unsigned long value = PyLong_AsUnsignedLong(arg);
+    if ( PyErr_Occurred() )
+        return nullptr;
+    if ( value > 0x3FFF ) {
+        PyErr_SetString(PyExc_ValueError, "Value must fit in 14 bits!");
+        return nullptr;
+    }
+
+    try {
+        unwrap(self).set_int(static_cast<uint16_t>(value));
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+    Py_INCREF(self);
+    return self;
+}
+
+PyObject* message_validate(PyObject* self, PyObject*) {
+    try {
+        unwrap(self).validate();
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+    Py_INCREF(self);
+    return self;
+}
+
+PyMethodDef message_methods[] = {
+    {"serialize", message_serialize, METH_NOARGS, "Bytes of the message"},
+    {"__bytes__", message_serialize, METH_NOARGS, "Bytes of the message"},
+    {"message_type", message_get<uint8_t, &Message::message_type>, METH_NOARGS,
+     "Message type, without the channel"},
+    {"message_type_raw", message_get<uint8_t, &Message::message_type_raw>, METH_NOARGS,
+     "Message type, including the channel"},
+    {"get_channel", message_get<uint8_t, &Message::get_channel>, METH_NOARGS, "Channel of the message"},
+    {"set_channel", message_set<&Message::set_channel>, METH_O, "Set the channel, returns the message"},
+    {"get_first_byte", message_get<uint8_t, &Message::get_first_byte>, METH_NOARGS, "First data byte"},
+    {"set_first_byte", message_set<&Message::set_first_byte>, METH_O, "Set the first data byte, returns the message"},
+    {"get_second_byte", message_get<uint8_t, &Message::get_second_byte>, METH_NOARGS, "Second data byte"},
+    {"set_second_byte", message_set<&Message::set_second_byte>, METH_O,
+     "Set the second data byte, returns the message"},
+    {"get_int", message_get<uint16_t, &Message::get_int>, METH_NOARGS, "14-bit value of the data bytes"},
+    {"set_int", message_set_int, METH_O, "Set the 14-bit value of the data bytes, returns the message"},
+    {"validate", message_validate, METH_NOARGS, "Raise ValueError if malformed, returns the message"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+PySequenceMethods message_sequence = {message_length};
+
+PyTypeObject message_type = [] {
+    PyTypeObject type = {PyVarObject_HEAD_INIT(nullptr, 0)};
+    type.tp_name        = "bragi_midi.Message";
+    type.tp_doc         = "Message(value=None)\n\nA MIDI message, from a message type or parsed from bytes";
+    type.tp_basicsize   = sizeof(PyMessage);
+    type.tp_flags       = Py_TPFLAGS_DEFAULT;
+    type.tp_new         = message_new;
+    type.tp_init        = message_init;
+    type.tp_dealloc     = message_dealloc;
+    type.tp_repr        = message_repr;
+    type.tp_richcompare = message_compare;
+    type.tp_as_sequence = &message_sequence;
+    type.tp_methods     = message_methods;
+    return type;
+}();
+
+/********************************/
+/* Output                       */
+/********************************/
+struct PyOutput {
+    PyObject_HEAD
+    std::shared_ptr<Output> output;
+};
+
+extern PyTypeObject output_type;
+
+std::shared_ptr<Output>& unwrap_output(PyObject* self) {
+    return reinterpret_cast<PyOutput*>(self)->output;
+}
+
+PyObject* output_new(PyTypeObject* type, PyObject*, PyObject*) {
+    PyOutput* self = reinterpret_cast<PyOutput*>(type->tp_alloc(type, 0));
+    if ( self )
+        new (&self->output) std::shared_ptr<Output>();
+    return reinterpret_cast<PyObject*>(self);
+}
+
+void output_dealloc(PyObject* self) {
+    // Called while an exception is set when __init__ failed, or during unwinding, which must survive the teardown
+    PyObject *error_type, *error_value, *error_traceback;
+    PyErr_Fetch(&error_type, &error_value, &error_traceback);
+
+    // Disconnecting may wait on the driver
+    std::shared_ptr<Output> output = std::move(unwrap_output(self));
+    without_gil([&] { output.reset(); });
+    PyErr_Clear();
+    PyErr_Restore(error_type, error_value, error_traceback);
+
+    unwrap_output(self).~shared_ptr();
+    Py_TYPE(self)->tp_free(self);
+}
+
+int output_init(PyObject* self, PyObject* args, PyObject*) {
+    unsigned int out_no;
+    if ( !PyArg_ParseTuple(args, "I", &out_no) )
+        return -1;
+
+    try {
+        unwrap_output(self) = std::make_shared<Output>(out_no);
+        return 0;
+    } catch ( ... ) {
+        set_error();
+        return -1;
+    }
+}
+
+/// @brief Checks the Output was initialized, Python allows calling methods on an object whose __init__ failed
+Output* checked_output(PyObject* self) {
+    Output* output = unwrap_output(self).get();
+    if ( !output )
+        PyErr_SetString(PyExc_RuntimeError, "Output is not initialized!");
+    return output;
+}
+
+PyObject* output_connect(PyObject* self, PyObject*) {
+    Output* output = checked_output(self);
+    if ( !output || !without_gil([&] { output->connect(); }) )
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* output_disconnect(PyObject* self, PyObject*) {
+    Output* output = checked_output(self);
+    if ( !output || !without_gil([&] { output->disconnect(); }) )
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* output_send_msg(PyObject* self, PyObject* arg) {
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+    if ( !PyObject_TypeCheck(arg, &message_type) ) {
+        PyErr_SetString(PyExc_TypeError, "Expected a Message!");
+        return nullptr;
+    }
+
+    // Copied so the message cannot change while the GIL is released
+    Message msg = unwrap(arg);
+    if ( !without_gil([&] { output->send_msg(msg); }) )
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* output_send_bytes(PyObject* self, PyObject* arg) {
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+
+    Buffer bytes(arg, PyBUF_SIMPLE);
+    if ( !bytes.ok() )
+        return nullptr;
+
+    size_t count = 0;
+    bool   ok    = without_gil([&] {
+        StreamReader   reader(bytes.data(), bytes.size());
+        ShortMessage   msg;
+        const uint8_t* long_msg;
+        size_t         long_size;
+
+        while ( reader.next(msg, long_msg, long_size) ) {
+            if ( long_size )
+                output->send_raw(long_msg, long_size);
+            else
+                output->send_msg(msg);
+            count++;
+        }
+    });
+    if ( !ok )
+        return nullptr;
+    return PyLong_FromSize_t(count);
+}
+
+PyObject* output_send_packed(PyObject* self, PyObject* arg) {
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+
+    Buffer packed(arg, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT);
+    if ( !packed.ok() )
+        return nullptr;
+    if ( packed.itemsize() != sizeof(uint32_t) ) {
+        PyErr_SetString(PyExc_ValueError, "Expected 32-bit items!");
+        return nullptr;
+    }
+
+    size_t count = packed.size() / sizeof(uint32_t);
+    bool   ok    = without_gil([&] {
+        for ( size_t i = 0; i < count; i++ ) {
+            uint32_t value;
+            std::memcpy(&value, packed.data() + i * sizeof(value), sizeof(value));
+            output->send_msg(ShortMessage(value & 0xFF, value >> 8 & 0xFF, value >> 16 & 0xFF));
+        }
+    });
+    if ( !ok )
+        return nullptr;
+    return PyLong_FromSize_t(count);
+}
+
+PyObject* output_send_events(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"events", "record_size", nullptr};
+
+    PyObject*  events;
+    Py_ssize_t record_size = 0;
+    if ( !PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", const_cast<char**>(keywords), &events, &record_size) )
+        return nullptr;
+
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+
+    Buffer records(events, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT);
+    if ( !records.ok() )
+        return nullptr;
+
+    // Plain bytes hold packed records
+    size_t record = record_size > 0 ? static_cast<size_t>(record_size)
+                  : records.itemsize() > 1 ? records.itemsize()
+                  : sizeof(double) + 3;
+    if ( record < sizeof(double) + 3 ) {
+        PyErr_SetString(PyExc_ValueError, "Records must hold a float64 time followed by status, data1 and data2!");
+        return nullptr;
+    }
+
+    size_t count = records.size() / record;
+    bool   ok    = without_gil([&] {
+        using clock = std::chrono::steady_clock;
+        clock::time_point start = clock::now();
+
+        for ( size_t i = 0; i < count; i++ ) {
+            const uint8_t* item = records.data() + i * record;
+
+            double time;
+            std::memcpy(&time, item, sizeof(time));
+            if ( time > 0 )
+                std::this_thread::sleep_until(
+                    start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(time)));
+
+            const uint8_t* bytes = item + sizeof(time);
+            output->send_msg(ShortMessage(bytes[0], bytes[1], bytes[2]));
+        }
+    });
+    if ( !ok )
+        return nullptr;
+    return PyLong_FromSize_t(count);
+}
+
+PyObject* output_physical_device(PyObject* self, PyObject*) {
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+    try {
+        return PyBool_FromLong(output->physical_device());
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* output_manufacturer_id(PyObject* self, PyObject*) {
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+    try {
+        return PyLong_FromUnsignedLong(output->manufacturer_id());
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* output_product_id(PyObject* self, PyObject*) {
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+    try {
+        return PyLong_FromUnsignedLong(output->product_id());
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* output_product_name(PyObject* self, PyObject*) {
+    Output* output = checked_output(self);
+    if ( !output )
+        return nullptr;
+    try {
+        return PyUnicode_FromString(output->product_name().c_str());
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyMethodDef output_methods[] = {
+    {"connect", output_connect, METH_NOARGS, "Open the device"},
+    {"disconnect", output_disconnect, METH_NOARGS, "Close the device, does nothing if not connected"},
+    {"send_msg", output_send_msg, METH_O, "Send a Message"},
+    {"send_bytes", output_send_bytes, METH_O,
+     "send_bytes(buffer) -> int\n\nSend a stream of messages as read from a MIDI port, running status allowed. "
+     "Returns the number of messages sent."},
+    {"send_packed", output_send_packed, METH_O,
+     "send_packed(buffer) -> int\n\nSend 32-bit items holding status | data1 << 8 | data2 << 16, as written by "
+     "parse_into(). Returns the number of messages sent."},
+    {"send_events", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(output_send_events)),
+     METH_VARARGS | METH_KEYWORDS,
+     "send_events(events, record_size=0) -> int\n\nSend records of a float64 time in seconds followed by status, "
+     "data1 and data2 bytes, eg. a NumPy array of dtype [('time', '<f8'), ('status', 'u1'), ('data1', 'u1'), "
+     "('data2', 'u1')]. Each is sent once its time, counted from the call, has come. record_size defaults to the "
+     "item size of the buffer, or 11 for a buffer of bytes. Returns the number of messages sent."},
+    {"physical_device", output_physical_device, METH_NOARGS, "Whether this is a physical device"},
+    {"manufacturer_id", output_manufacturer_id, METH_NOARGS, "Manufacturer ID"},
+    {"product_id", output_product_id, METH_NOARGS, "Product ID"},
+    {"product_name", output_product_name, METH_NOARGS, "Product name"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+PyTypeObject output_type = [] {
+    PyTypeObject type = {PyVarObject_HEAD_INIT(nullptr, 0)};
+    type.tp_name      = "bragi_midi.Output";
+    type.tp_doc       = "Output(out_no)\n\nA MIDI output device";
+    type.tp_basicsize = sizeof(PyOutput);
+    type.tp_flags     = Py_TPFLAGS_DEFAULT;
+    type.tp_new       = output_new;
+    type.tp_init      = output_init;
+    type.tp_dealloc   = output_dealloc;
+    type.tp_methods   = output_methods;
+    return type;
+}();
+
+/********************************/
+/* Note                         */
+/********************************/
+struct PyNote {
+    PyObject_HEAD
+    PyObject*             output;
+    uint8_t               pitch;
+    uint8_t               velocity;
+    uint8_t               channel;
+    std::unique_ptr<Note> note;
+};
+
+PyObject* note_new(PyTypeObject* type, PyObject*, PyObject*) {
+    PyNote* self = reinterpret_cast<PyNote*>(type->tp_alloc(type, 0));
+    if ( self )
+        new (&self->note) std::unique_ptr<Note>();
+    return reinterpret_cast<PyObject*>(self);
+}
+
+void note_dealloc(PyObject* self) {
+    PyNote*   note = reinterpret_cast<PyNote*>(self);
+    PyObject *error_type, *error_value, *error_traceback;
+    PyErr_Fetch(&error_type, &error_value, &error_traceback);
+
+    // Only an error from sending the NOTE OFF is dropped, see output_dealloc()
+    without_gil([&] { note->note.reset(); });
+    PyErr_Clear();
+    PyErr_Restore(error_type, error_value, error_traceback);
+
+    note->note.~unique_ptr();
+    Py_XDECREF(note->output);
+    Py_TYPE(self)->tp_free(self);
+}
+
+int note_init(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"output", "pitch", "velocity", "channel", nullptr};
+
+    PyNote*   note   = reinterpret_cast<PyNote*>(self);
+    PyObject* output = nullptr;
+    note->pitch      = middle_c;
+    note->velocity   = max_velocity;
+    note->channel    = 0;
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwargs, "O!|bbb", const_cast<char**>(keywords), &output_type, &output,
+                                      &note->pitch, &note->velocity, &note->channel) )
+        return -1;
+
+    Py_INCREF(output);
+    Py_XSETREF(note->output, output);
+    return 0;
+}
+
+PyObject* note_enter(PyObject* self, PyObject*) {
+    PyNote* note = reinterpret_cast<PyNote*>(self);
+    if ( !note->output || !checked_output(note->output) )
+        return nullptr;
+    if ( note->note ) {
+        PyErr_SetString(PyExc_RuntimeError, "Note is already playing!");
+        return nullptr;
+    }
+
+    std::shared_ptr<Output> output = unwrap_output(note->output);
+    if ( !without_gil([&] { note->note.reset(new Note(output, note->pitch, note->velocity, note->channel)); }) )
+        return nullptr;
+
+    Py_INCREF(self);
+    return self;
+}
+
+PyObject* note_exit(PyObject* self, PyObject*) {
+    PyNote* note = reinterpret_cast<PyNote*>(self);
+    if ( !without_gil([&] { note->note.reset(); }) )
+        return nullptr;
+    Py_RETURN_FALSE;
+}
+
+PyMethodDef note_methods[] = {
+    {"__enter__", note_enter, METH_NOARGS, "Send NOTE ON"},
+    {"__exit__", note_exit, METH_VARARGS, "Send NOTE OFF"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+PyTypeObject note_type = [] {
+    PyTypeObject type = {PyVarObject_HEAD_INIT(nullptr, 0)};
+    type.tp_name      = "bragi_midi.Note";
+    type.tp_doc       = "Note(output, pitch=60, velocity=127, channel=0)\n\n"
+                        "Context manager playing a note for as long as the block runs";
+    type.tp_basicsize = sizeof(PyNote);
+    type.tp_flags     = Py_TPFLAGS_DEFAULT;
+    type.tp_new       = note_new;
+    type.tp_init      = note_init;
+    type.tp_dealloc   = note_dealloc;
+    type.tp_methods   = note_methods;
+    return type;
+}();
+
+/********************************/
+/* Module functions             */
+/********************************/
+PyObject* module_note(PyObject* args, PyObject* kwargs, Message (*make)(uint8_t, uint8_t, uint8_t)) {
+    static const char* keywords[] = {"pitch", "velocity", "channel", nullptr};
+
+    uint8_t pitch, velocity = max_velocity, channel = 0;
+    if ( !PyArg_ParseTupleAndKeywords(args, kwargs, "b|bb", const_cast<char**>(keywords), &pitch, &velocity,
+                                      &channel) )
+        return nullptr;
+
+    try {
+        return wrap(make(pitch, velocity, channel));
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* module_note_on(PyObject*, PyObject* args, PyObject* kwargs) {
+    return module_note(args, kwargs, note_on);
+}
+
+PyObject* module_note_off(PyObject*, PyObject* args, PyObject* kwargs) {
+    return module_note(args, kwargs, note_off);
+}
+
+PyObject* module_system_exclusive(PyObject*, PyObject* arg) {
+    Buffer data(arg, PyBUF_SIMPLE);
+    if ( !data.ok() )
+        return nullptr;
+
+    try {
+        return wrap(Message::system_exclusive(std::basic_string<uint8_t>(data.data(), data.size())));
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* module_parse(PyObject*, PyObject* arg) {
+    Buffer bytes(arg, PyBUF_SIMPLE);
+    if ( !bytes.ok() )
+        return nullptr;
+
+    std::vector<Message> messages;
+    bool ok = without_gil([&] {
+        StreamReader   reader(bytes.data(), bytes.size());
+        ShortMessage   msg;
+        const uint8_t* long_msg;
+        size_t         long_size;
+
+        while ( reader.next(msg, long_msg, long_size) )
+            messages.push_back(long_size ? Message::parse(std::basic_string<uint8_t>(long_msg, long_size))
+                                         : msg.to_message());
+    });
+    if ( !ok )
+        return nullptr;
+
+    PyObject* list = PyList_New(static_cast<Py_ssize_t>(messages.size()));
+    if ( !list )
+        return nullptr;
+
+    for ( size_t i = 0; i < messages.size(); i++ ) {
+        PyObject* item = wrap(messages[i]);
+        if ( !item ) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), item);
+    }
+    return list;
+}
+
+PyObject* module_parse_into(PyObject*, PyObject* args) {
+    PyObject* source;
+    PyObject* target;
+    if ( !PyArg_ParseTuple(args, "OO", &source, &target) )
+        return nullptr;
+
+    Buffer bytes(source, PyBUF_SIMPLE);
+    if ( !bytes.ok() )
+        return nullptr;
+
+    Buffer packed(target, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE);
+    if ( !packed.ok() )
+        return nullptr;
+    if ( packed.itemsize() != sizeof(uint32_t) ) {
+        PyErr_SetString(PyExc_ValueError, "Expected 32-bit items!");
+        return nullptr;
+    }
+
+    size_t capacity = packed.size() / sizeof(uint32_t);
+    size_t count    = 0;
+    size_t consumed = 0;
+    bool   ok       = without_gil([&] {
+        StreamReader   reader(bytes.data(), bytes.size());
+        ShortMessage   msg;
+        const uint8_t* long_msg;
+        size_t         long_size;
+
+        while ( count < capacity && reader.next(msg, long_msg, long_size) ) {
+            consumed = reader.offset(bytes.data());
+            if ( long_size )
+                continue;
+
+            uint32_t value = msg.packed();
+            std::memcpy(packed.data() + count * sizeof(value), &value, sizeof(value));
+            count++;
+        }
+    });
+    if ( !ok )
+        return nullptr;
+    return Py_BuildValue("nn", static_cast<Py_ssize_t>(count), static_cast<Py_ssize_t>(consumed));
+}
+
+PyObject* module_output_count(PyObject*, PyObject*) {
+    try {
+        return PyLong_FromUnsignedLong(Output::output_count());
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+/// @brief Devices installed by simulate_outputs(), empty while the system devices are used
+std::shared_ptr<SimulatedDeviceProvider> simulated;
+
+PyObject* module_simulate_outputs(PyObject*, PyObject* args) {
+    unsigned int count;
+    if ( !PyArg_ParseTuple(args, "I", &count) )
+        return nullptr;
+
+    try {
+        simulated = std::make_shared<SimulatedDeviceProvider>(count);
+        DeviceRegistry::instance().set_provider(simulated);
+        Py_RETURN_NONE;
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* module_system_outputs(PyObject*, PyObject*) {
+    try {
+        DeviceRegistry::instance().set_provider(nullptr);
+        simulated.reset();
+        Py_RETURN_NONE;
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyObject* module_simulated_sent(PyObject*, PyObject* args) {
+    unsigned int out_no;
+    if ( !PyArg_ParseTuple(args, "I", &out_no) )
+        return nullptr;
+
+    if ( !simulated ) {
+        PyErr_SetString(PyExc_RuntimeError, "Outputs are not simulated!");
+        return nullptr;
+    }
+
+    try {
+        std::basic_string<uint8_t> sent = simulated->sent(out_no);
+        return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(sent.data()),
+                                         static_cast<Py_ssize_t>(sent.size()));
+    } catch ( ... ) {
+        set_error();
+        return nullptr;
+    }
+}
+
+PyMethodDef module_methods[] = {
+    {"note_on", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(module_note_on)),
+     METH_VARARGS | METH_KEYWORDS, "note_on(pitch, velocity=127, channel=0) -> Message"},
+    {"note_off", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(module_note_off)),
+     METH_VARARGS | METH_KEYWORDS, "note_off(pitch, velocity=127, channel=0) -> Message"},
+    {"system_exclusive", module_system_exclusive, METH_O,
+     "system_exclusive(data) -> Message\n\nWrap the bytes between the 0xF0 and 0xF7 bytes"},
+    {"parse", module_parse, METH_O,
+     "parse(buffer) -> list[Message]\n\nSplit a stream of messages as read from a MIDI port, running status allowed"},
+    {"parse_into", module_parse_into, METH_VARARGS,
+     "parse_into(buffer, out) -> (count, consumed)\n\nSplit a stream of messages into a writable buffer of 32-bit "
+     "items, eg. a NumPy uint32 array, each holding status | data1 << 8 | data2 << 16. System exclusive messages are "
+     "skipped. Stops once out is full, returning the number of items written and bytes read."},
+    {"output_count", module_output_count, METH_NOARGS, "Number of MIDI output devices"},
+    {"simulate_outputs", module_simulate_outputs, METH_VARARGS,
+     "simulate_outputs(count)\n\nReplace the MIDI output devices with count devices which only record what is sent "
+     "to them, eg. for tests. Outputs created earlier keep their device."},
+    {"system_outputs", module_system_outputs, METH_NOARGS,
+     "system_outputs()\n\nGo back to the MIDI output devices of the system after simulate_outputs()"},
+    {"simulated_sent", module_simulated_sent, METH_VARARGS,
+     "simulated_sent(out_no) -> bytes\n\nEvery byte sent to a simulated output since simulate_outputs()"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+PyModuleDef module = {
+    PyModuleDef_HEAD_INIT,
+    "bragi_midi",
+    "MIDI library, with bulk functions working on buffers outside the GIL",
+    -1,
+    module_methods,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr
+};
+
+/// @brief Add the MessageType constants, as a plain class of integers
+bool add_message_types(PyObject* mod) {
+    PyObject* values = Py_BuildValue(
+        "{s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i}",
+        "note_off", MessageType::note_off, "note_on", MessageType::note_on, "key_pressure", MessageType::key_pressure,
+        "controller_change", MessageType::controller_change, "program_change", MessageType::program_change,
+        "channel_pressure", MessageType::channel_pressure, "pitch_bend", MessageType::pitch_bend,
+        "system_exclusive", MessageType::system_exclusive, "song_position", MessageType::song_position,
+        "song_select", MessageType::song_select, "bus_select", MessageType::bus_select,
+        "tune_request", MessageType::tune_request, "end_of_system_exclusive", MessageType::end_of_system_exclusive,
+        "timing_tick", MessageType::timing_tick, "start_song", MessageType::start_song,
+        "continue_song", MessageType::continue_song, "stop_song", MessageType::stop_song,
+        "active_sensing", MessageType::active_sensing, "system_reset", MessageType::system_reset);
+    if ( !values )
+        return false;
+
+    PyObject* cls = PyObject_CallFunction(reinterpret_cast<PyObject*>(&PyType_Type), "s()N", "MessageType", values);
+    return cls && PyModule_AddObject(mod, "MessageType", cls) == 0;
+}
+}
+
+PyMODINIT_FUNC PyInit_bragi_midi() {
+    if ( PyType_Ready(&message_type) < 0 || PyType_Ready(&output_type) < 0 || PyType_Ready(&note_type) < 0 )
+        return nullptr;
+
+    PyObject* mod = PyModule_Create(&module);
+    if ( !mod )
+        return nullptr;
+
+    Py_INCREF(&message_type);
+    Py_INCREF(&output_type);
+    Py_INCREF(&note_type);
+    if ( PyModule_AddObject(mod, "Message", reinterpret_cast<PyObject*>(&message_type)) < 0
+         || PyModule_AddObject(mod, "Output", reinterpret_cast<PyObject*>(&output_type)) < 0
+         || PyModule_AddObject(mod, "Note", reinterpret_cast<PyObject*>(&note_type)) < 0
+         || PyModule_AddIntConstant(mod, "middle_c", middle_c) < 0
+         || PyModule_AddIntConstant(mod, "max_velocity", max_velocity) < 0 || !add_message_types(mod) ) {
+        Py_DECREF(mod);
+        return nullptr;
+    }
+
+    return mod;
+}
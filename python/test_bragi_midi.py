@@ -0,0 +1,155 @@
+"""
+Tests of the bragi_midi extension module, run with `python -m unittest test_bragi_midi` next to the built module.
+"""
+import array
+import struct
+import unittest
+
+import bragi_midi
+
+
+class FailedConstructionTest(unittest.TestCase):
+    def test_missing_output_raises_value_error(self):
+        count = bragi_midi.output_count()
+
+        for out_no in (count, count + 5):
+            with self.assertRaises(ValueError) as raised:
+                bragi_midi.Output(out_no)
+            self.assertIn("No such output", str(raised.exception))
+
+    def test_bad_arguments_raise_type_error(self):
+        with self.assertRaises(TypeError):
+            bragi_midi.Output("first")
+
+    def test_exception_survives_collecting_half_built_output(self):
+        # The half-built Output is only referenced from the value stack, which is cleared while the KeyError is
+        # already set, so output_dealloc runs with an exception pending
+        def fail():
+            raise KeyError("kept")
+
+        def construct():
+            return [bragi_midi.Output.__new__(bragi_midi.Output), fail()]
+
+        with self.assertRaises(KeyError) as raised:
+            construct()
+        self.assertEqual(raised.exception.args, ("kept",))
+
+    def test_uninitialized_output_raises_runtime_error(self):
+        output = bragi_midi.Output.__new__(bragi_midi.Output)
+        with self.assertRaises(RuntimeError):
+            output.connect()
+
+
+class MessageTest(unittest.TestCase):
+    def test_note_on_round_trips_through_parse(self):
+        messages = bragi_midi.parse(bytes([0x90, 60, 100, 61, 101]))
+        self.assertEqual(messages, [bragi_midi.note_on(60, 100), bragi_midi.note_on(61, 101)])
+
+
+def packed(status, data1=0, data2=0):
+    return status | data1 << 8 | data2 << 16
+
+
+def uint32_array(values=()):
+    # "I" is 32 bits on every platform CPython supports, "L" is 64 bits on most
+    items = array.array("I", values)
+    assert items.itemsize == 4
+    return items
+
+
+class ParseIntoTest(unittest.TestCase):
+    def test_running_status(self):
+        out = uint32_array([0] * 4)
+        count, consumed = bragi_midi.parse_into(bytes([0x90, 60, 100, 64, 100, 0x80, 60, 0]), out)
+        self.assertEqual((count, consumed), (3, 8))
+        self.assertEqual(list(out[:3]), [packed(0x90, 60, 100), packed(0x90, 64, 100), packed(0x80, 60, 0)])
+
+    def test_system_exclusive_is_skipped(self):
+        out = uint32_array([0] * 4)
+        count, consumed = bragi_midi.parse_into(bytes([0x90, 60, 100, 0xF0, 1, 2, 3, 0xF7, 0xB0, 7, 90]), out)
+        self.assertEqual((count, consumed), (2, 11))
+        self.assertEqual(list(out[:2]), [packed(0x90, 60, 100), packed(0xB0, 7, 90)])
+
+    def test_stops_when_out_is_full(self):
+        stream = bytes([0x90, 60, 100, 62, 100, 64, 100, 0xC0, 5])
+        out = uint32_array([0] * 2)
+        count, consumed = bragi_midi.parse_into(stream, out)
+        self.assertEqual((count, consumed), (2, 5))
+        self.assertEqual(list(out), [packed(0x90, 60, 100), packed(0x90, 62, 100)])
+
+        # The rest starts with a data byte, which needs the running status of the part already read
+        rest = uint32_array([0] * 2)
+        self.assertEqual(bragi_midi.parse_into(bytes([0x90]) + stream[consumed:], rest), (2, 5))
+        self.assertEqual(list(rest), [packed(0x90, 64, 100), packed(0xC0, 5)])
+
+    def test_wrong_itemsize_raises_value_error(self):
+        with self.assertRaises(ValueError):
+            bragi_midi.parse_into(bytes([0x90, 60, 100]), array.array("H", [0] * 4))
+        with self.assertRaises(ValueError):
+            bragi_midi.parse_into(bytes([0x90, 60, 100]), array.array("d", [0] * 4))
+
+    def test_read_only_out_raises_buffer_error(self):
+        with self.assertRaises(BufferError):
+            bragi_midi.parse_into(bytes([0x90, 60, 100]), bytes(16))
+
+
+class SendTest(unittest.TestCase):
+    def setUp(self):
+        bragi_midi.simulate_outputs(2)
+        self.output = bragi_midi.Output(1)
+        self.output.connect()
+
+    def tearDown(self):
+        self.output.disconnect()
+        del self.output
+        bragi_midi.system_outputs()
+
+    def sent(self):
+        return bragi_midi.simulated_sent(1)
+
+    def test_simulated_outputs_replace_the_system_ones(self):
+        self.assertEqual(bragi_midi.output_count(), 2)
+        self.assertEqual(bragi_midi.simulated_sent(0), b"")
+        with self.assertRaises(ValueError):
+            bragi_midi.simulated_sent(2)
+
+    def test_send_bytes_running_status(self):
+        self.assertEqual(self.output.send_bytes(bytes([0x90, 60, 100, 64, 100, 0x80, 60, 0])), 3)
+        self.assertEqual(self.sent(), bytes([0x90, 60, 100, 0x90, 64, 100, 0x80, 60, 0]))
+
+    def test_send_bytes_system_exclusive(self):
+        self.assertEqual(self.output.send_bytes(bytes([0xF0, 0x7E, 1, 2, 0xF7, 0xB0, 7, 90])), 2)
+        self.assertEqual(self.sent(), bytes([0xF0, 0x7E, 1, 2, 0xF7, 0xB0, 7, 90]))
+
+    def test_send_bytes_without_status_raises_value_error(self):
+        with self.assertRaises(ValueError):
+            self.output.send_bytes(bytes([60, 100]))
+
+    def test_send_packed(self):
+        count = self.output.send_packed(uint32_array([packed(0x90, 60, 100), packed(0xC0, 5), packed(0x80, 60)]))
+        self.assertEqual(count, 3)
+        self.assertEqual(self.sent(), bytes([0x90, 60, 100, 0xC0, 5, 0x80, 60, 0]))
+
+    def test_send_packed_wrong_itemsize_raises_value_error(self):
+        with self.assertRaisesRegex(ValueError, "32-bit"):
+            self.output.send_packed(array.array("H", [0x90, 60]))
+        self.assertEqual(self.sent(), b"")
+
+    def test_send_events(self):
+        events = struct.pack("<dBBB", 0, 0x90, 60, 100) + struct.pack("<dBBB", 0.01, 0x80, 60, 0)
+        self.assertEqual(self.output.send_events(events), 2)
+        self.assertEqual(self.sent(), bytes([0x90, 60, 100, 0x80, 60, 0]))
+
+    def test_send_events_padded_records(self):
+        # Eg. a NumPy structured array aligned to 16 bytes
+        events = struct.pack("<dBBB5x", 0, 0xB0, 7, 90) + struct.pack("<dBBB5x", 0, 0xB0, 10, 64)
+        self.assertEqual(self.output.send_events(events, record_size=16), 2)
+        self.assertEqual(self.sent(), bytes([0xB0, 7, 90, 0xB0, 10, 64]))
+
+    def test_send_events_short_records_raise_value_error(self):
+        with self.assertRaises(ValueError):
+            self.output.send_events(bytes(20), record_size=10)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,143 @@
+#include <bragi/midi/v1/coalescer.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace bragi::midi::v1 {
+constexpr size_t Coalescer::controller_slots;
+constexpr size_t Coalescer::pitch_bend_slots;
+constexpr size_t Coalescer::pressure_slots;
+constexpr size_t Coalescer::slot_count;
+
+Coalescer::Coalescer(std::shared_ptr<Output> output, std::chrono::microseconds window):
+        output(std::move(output)),
+        window(window)
+    {
+        if ( !this->output )
+            throw std::invalid_argument("No output!");
+
+        worker = std::thread(&Coalescer::run, this);
+    }
+
+Coalescer::~Coalescer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+    worker.join();
+
+    try {
+        flush();
+    } catch ( std::exception& ) {
+
+    }
+}
+
+size_t Coalescer::slot_of(const ShortMessage& msg) {
+    uint8_t channel = msg.status() & 0x0F;
+
+    switch ( msg.status() & 0xF0 ) {
+        case MessageType::controller_change: {
+            uint8_t controller = msg.data1();
+            if ( controller == 6 || controller == 38 || (controller >= 96 && controller <= 101) || controller >= 120 )
+                return slot_count;
+            return channel * 128 + controller;
+        }
+
+        case MessageType::pitch_bend:
+            return controller_slots + channel;
+
+        case MessageType::channel_pressure:
+            return controller_slots + pitch_bend_slots + channel;
+
+        default:
+            return slot_count;
+    }
+}
+
+void Coalescer::flush_locked() {
+    size_t i = 0;
+
+    try {
+        for ( ; i < dirty_count; i++ ) {
+            dirty[order[i]] = false;
+            output->send_msg(latest[order[i]]);
+            sent_count++;
+        }
+    } catch ( ... ) {
+        // The failed value is dropped, the rest stay pending
+        std::copy(order.begin() + i + 1, order.begin() + dirty_count, order.begin());
+        dirty_count -= i + 1;
+        throw;
+    }
+
+    dirty_count = 0;
+}
+
+void Coalescer::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while ( running ) {
+        wake.wait_for(lock, window);
+
+        try {
+            flush_locked();
+        } catch ( std::exception& ) {
+            // Nowhere to report to from here, the next send_msg() or flush() will surface driver errors
+        }
+    }
+}
+
+void Coalescer::send_msg(const ShortMessage& msg) {
+    if ( !msg.valid() )
+        throw std::invalid_argument("Invalid short message!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    received_count++;
+
+    size_t slot = slot_of(msg);
+
+    if ( slot < slot_count ) {
+        if ( !dirty[slot] ) {
+            dirty[slot] = true;
+            order[dirty_count++] = static_cast<uint16_t>(slot);
+        }
+        latest[slot] = msg;
+        return;
+    }
+
+    flush_locked();
+    output->send_msg(msg);
+    sent_count++;
+}
+
+void Coalescer::send_msg(const Message& msg) {
+    if ( msg.size() <= 3 )
+        return send_msg(ShortMessage::from(msg));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    received_count++;
+
+    flush_locked();
+    output->send_msg(msg);
+    sent_count++;
+}
+
+void Coalescer::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    flush_locked();
+}
+
+size_t Coalescer::received() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return received_count;
+}
+
+size_t Coalescer::forwarded() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sent_count;
+}
+}
@@ -0,0 +1,115 @@
+/**
+ * @file coalescer.hpp
+ * @brief Thinning out controller floods before they reach a slow MIDI link
+ */
+#ifndef _BRAGI_MIDI_V1_COALESCER_HPP_
+#define _BRAGI_MIDI_V1_COALESCER_HPP_
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Keeps only the latest value of continuous controllers within a time window
+ *
+ * A knob sweep can generate far more CONTROLLER CHANGE and PITCH BEND messages than a 31.25 kbaud DIN link carries.
+ * The Coalescer holds these back for up to one window and only forwards the last value seen per
+ * (channel, controller), per-channel PITCH BEND and per-channel CHANNEL PRESSURE.
+ *
+ * Every other message is passed straight through, but only after the pending values are flushed. This keeps the
+ * relative order of notes, and of notes and controllers, identical to the order they were sent in - eg. a sustain
+ * pedal release is never moved behind the NOTE OFF that followed it.
+ *
+ * Data entry (6, 38, 96, 97), parameter select (98 - 101) and channel mode controllers (120 - 127) only make sense in
+ * sequence, so they are never coalesced.
+ */
+class Coalescer {
+    protected:
+        constexpr static size_t controller_slots = 16 * 128;
+        constexpr static size_t pitch_bend_slots = 16;
+        constexpr static size_t pressure_slots   = 16;
+        constexpr static size_t slot_count       = controller_slots + pitch_bend_slots + pressure_slots;
+
+        std::shared_ptr<Output>               output;
+        std::chrono::microseconds             window;
+        std::mutex                            mutex;
+        std::condition_variable               wake;
+        bool                                  running = true;
+
+        std::array<ShortMessage, slot_count>  latest;
+        std::array<bool, slot_count>          dirty = {};
+        std::array<uint16_t, slot_count>      order;       // Dirty slots, in the order they were first touched
+        size_t                                dirty_count    = 0;
+        size_t                                received_count = 0;
+        size_t                                sent_count     = 0;
+
+        std::thread                           worker;
+
+        static size_t slot_of(const ShortMessage& msg);
+        void flush_locked();
+        void run();
+
+    public:
+        /// @brief Disable empty constructor
+        Coalescer() = delete;
+
+        /// @brief Disable copy constructor, the worker thread refers to this object
+        Coalescer(const Coalescer&) = delete;
+
+        /// @brief Disable copy assignment, the worker thread refers to this object
+        Coalescer& operator=(const Coalescer&) = delete;
+
+        /**
+         * @brief Start coalescing in front of an output
+         *
+         * @param [in] output Connected output to forward messages to
+         * @param [in] window Longest time a value is held back
+         *
+         * @throws std::invalid_argument if @b output is empty
+         * @throws std::system_error if the flushing thread could not be started
+         */
+        Coalescer(std::shared_ptr<Output> output, std::chrono::microseconds window = std::chrono::milliseconds(10));
+
+        /// @brief Flushes pending values and stops the flushing thread
+        ~Coalescer();
+
+        /**
+         * @brief Send or hold back a message
+         *
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        void send_msg(const Message& msg);
+
+        /**
+         * @brief Send or hold back a short message
+         *
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        void send_msg(const ShortMessage& msg);
+
+        /**
+         * @brief Forward all pending values now
+         *
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        void flush();
+
+        /// @brief Number of messages passed to send_msg()
+        size_t received();
+
+        /// @brief Number of messages forwarded to the output
+        size_t forwarded();
+};
+}
+
+#endif //_BRAGI_MIDI_V1_COALESCER_HPP_//
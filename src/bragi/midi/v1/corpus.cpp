@@ -0,0 +1,236 @@
+#include <bragi/midi/v1/corpus.hpp>
+#include <bragi/midi/v1/mapped_file.hpp>
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/smf.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+namespace bragi::midi::v1 {
+/// @brief Default tempo of a Standard MIDI File, 120 BPM
+constexpr static uint32_t default_tempo = 500000;
+
+struct TempoChange {
+    uint64_t tick;
+    uint32_t tempo;
+
+    bool operator<(const TempoChange& other) const {
+        return tick < other.tick;
+    }
+};
+
+static double to_bpm(uint32_t tempo) {
+    return 60e6 / tempo;
+}
+
+static double ticks_to_seconds(uint16_t division, const std::vector<TempoChange>& tempo_map, uint64_t ticks) {
+    if ( division & 0x8000 ) {
+        // SMPTE timing - frames per second in the upper byte, stored as a negative number
+        int fps = -static_cast<int8_t>(division >> 8);
+        double rate = (fps == 29 ? 29.97 : fps) * (division & 0xFF);
+        if ( rate <= 0 )
+            throw std::domain_error("Invalid SMPTE division!");
+        return ticks / rate;
+    }
+
+    double   seconds = 0;
+    uint64_t tick    = 0;
+    uint32_t tempo   = default_tempo;
+
+    for ( const TempoChange& change : tempo_map ) {
+        if ( change.tick >= ticks )
+            break;
+        seconds += static_cast<double>(change.tick - tick) * tempo / division / 1e6;
+        tick  = change.tick;
+        tempo = change.tempo;
+    }
+
+    return seconds + static_cast<double>(ticks - tick) * tempo / division / 1e6;
+}
+
+/********************************/
+/* Scanning                     */
+/********************************/
+FileStats scan_file(const uint8_t* data, size_t size) {
+    SmfFile file(data, size);
+
+    FileStats stats;
+    stats.format = file.format();
+    stats.tracks = file.track_count();
+
+    std::vector<TempoChange> tempo_map;
+    uint64_t                 length = 0;
+
+    for ( size_t i = 0; i < file.track_count(); i++ ) {
+        SmfTrack track = file.track(i);
+        SmfEvent event;
+        uint64_t tick = 0;
+
+        while ( track.next(event) ) {
+            tick += event.delta;
+            stats.events++;
+
+            switch ( event.status & 0xF0 ) {
+                case MessageType::note_on:
+                    if ( event.data[1] ) {
+                        stats.notes++;
+                        stats.pitches[event.data[0]]++;
+                    }
+                    break;
+
+                case MessageType::program_change:
+                    stats.programs[event.data[0]]++;
+                    break;
+
+                default:
+                    break;
+            }
+
+            if ( event.status == 0xFF && event.meta_type == MetaType::set_tempo ) {
+                if ( event.payload_size != 3 )
+                    throw std::domain_error("Malformed tempo event!");
+
+                uint32_t tempo = event.payload[0] << 16 | event.payload[1] << 8 | event.payload[2];
+                if ( tempo == 0 )
+                    throw std::domain_error("Zero tempo!");
+
+                tempo_map.push_back({tick, tempo});
+            }
+        }
+
+        length = std::max(length, tick);
+    }
+
+    std::stable_sort(tempo_map.begin(), tempo_map.end());
+
+    stats.duration = ticks_to_seconds(file.division(), tempo_map, length);
+    stats.min_bpm  = stats.max_bpm = to_bpm(default_tempo);
+
+    if ( !tempo_map.empty() ) {
+        // A larger tempo value means fewer beats per minute
+        auto range = std::minmax_element(tempo_map.begin(), tempo_map.end(),
+            [](const TempoChange& a, const TempoChange& b) { return a.tempo < b.tempo; });
+        stats.max_bpm = to_bpm(range.first->tempo);
+        stats.min_bpm = to_bpm(range.second->tempo);
+    }
+
+    return stats;
+}
+
+FileStats scan_file(const std::string& path) {
+    MappedFile file(path);
+    return scan_file(file.data(), file.size());
+}
+
+/********************************/
+/* Accumulation                 */
+/********************************/
+void CorpusStats::add(const FileStats& file) {
+    if ( files == 0 ) {
+        min_duration = max_duration = file.duration;
+        min_bpm = file.min_bpm;
+        max_bpm = file.max_bpm;
+    } else {
+        min_duration = std::min(min_duration, file.duration);
+        max_duration = std::max(max_duration, file.duration);
+        min_bpm      = std::min(min_bpm, file.min_bpm);
+        max_bpm      = std::max(max_bpm, file.max_bpm);
+    }
+
+    files++;
+    events         += file.events;
+    notes          += file.notes;
+    total_duration += file.duration;
+
+    for ( size_t i = 0; i < 128; i++ ) {
+        pitches[i]  += file.pitches[i];
+        programs[i] += file.programs[i];
+    }
+}
+
+void CorpusStats::merge(const CorpusStats& other) {
+    if ( other.files ) {
+        if ( files == 0 ) {
+            min_duration = other.min_duration;
+            max_duration = other.max_duration;
+            min_bpm      = other.min_bpm;
+            max_bpm      = other.max_bpm;
+        } else {
+            min_duration = std::min(min_duration, other.min_duration);
+            max_duration = std::max(max_duration, other.max_duration);
+            min_bpm      = std::min(min_bpm, other.min_bpm);
+            max_bpm      = std::max(max_bpm, other.max_bpm);
+        }
+
+        files          += other.files;
+        events         += other.events;
+        notes          += other.notes;
+        total_duration += other.total_duration;
+
+        for ( size_t i = 0; i < 128; i++ ) {
+            pitches[i]  += other.pitches[i];
+            programs[i] += other.programs[i];
+        }
+    }
+
+    errors.insert(errors.end(), other.errors.begin(), other.errors.end());
+}
+
+/********************************/
+/* Parallel scan                */
+/********************************/
+static void scan_worker(const std::vector<std::string>& paths, std::atomic<size_t>& cursor, CorpusStats& result) {
+    // Accumulate locally so threads never write to shared cache lines while scanning
+    CorpusStats local;
+
+    for ( size_t i = cursor.fetch_add(1, std::memory_order_relaxed); i < paths.size();
+          i = cursor.fetch_add(1, std::memory_order_relaxed) ) {
+        try {
+            local.add(scan_file(paths[i]));
+        } catch ( std::exception& e ) {
+            local.errors.push_back({i, paths[i], e.what()});
+        }
+    }
+
+    result = std::move(local);
+}
+
+CorpusStats scan_corpus(const std::vector<std::string>& paths, unsigned int threads) {
+    if ( threads == 0 )
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, std::max<size_t>(paths.size(), 1)));
+
+    std::atomic<size_t>      cursor(0);
+    std::vector<CorpusStats> results(threads);
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    for ( unsigned int i = 1; i < threads; i++ ) {
+        try {
+            workers.emplace_back(scan_worker, std::cref(paths), std::ref(cursor), std::ref(results[i]));
+        } catch ( std::system_error& ) {
+            // Carry on with the threads we did get
+            break;
+        }
+    }
+
+    scan_worker(paths, cursor, results[0]);
+
+    for ( std::thread& worker : workers )
+        worker.join();
+
+    CorpusStats total;
+    for ( const CorpusStats& result : results )
+        total.merge(result);
+
+    std::sort(total.errors.begin(), total.errors.end(),
+        [](const ScanError& a, const ScanError& b) { return a.index < b.index; });
+
+    return total;
+}
+}
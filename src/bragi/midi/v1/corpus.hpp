@@ -0,0 +1,119 @@
+/**
+ * @file corpus.hpp
+ * @brief Batch analysis of Standard MIDI File libraries
+ */
+#ifndef _BRAGI_MIDI_V1_CORPUS_HPP_
+#define _BRAGI_MIDI_V1_CORPUS_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Statistics gathered from a single file
+ */
+struct FileStats {
+    /// @brief File format - @c 0, @c 1 or @c 2
+    uint16_t format = 0;
+
+    /// @brief Number of tracks
+    size_t   tracks = 0;
+
+    /// @brief Number of events across all tracks, including meta and system exclusive events
+    uint64_t events = 0;
+
+    /// @brief Number of NOTE ON messages with a non-zero velocity
+    uint64_t notes  = 0;
+
+    /// @brief NOTE ON count per pitch
+    std::array<uint64_t, 128> pitches  = {};
+
+    /// @brief PROGRAM CHANGE count per program
+    std::array<uint64_t, 128> programs = {};
+
+    /// @brief Length of the longest track in seconds, following the tempo map
+    double duration = 0;
+
+    /// @brief Slowest tempo in beats per minute, @c 120 if the file sets no tempo
+    double min_bpm  = 0;
+
+    /// @brief Fastest tempo in beats per minute, @c 120 if the file sets no tempo
+    double max_bpm  = 0;
+};
+
+/**
+ * @brief A file which could not be analysed
+ */
+struct ScanError {
+    /// @brief Position of the file in the list passed to scan_corpus()
+    size_t      index;
+
+    /// @brief Path of the file
+    std::string path;
+
+    /// @brief Description of the failure
+    std::string what;
+};
+
+/**
+ * @brief Statistics accumulated over many files
+ *
+ * Only files which were fully analysed contribute to the counts, so a malformed file never skews them.
+ */
+struct CorpusStats {
+    uint64_t files  = 0;
+    uint64_t events = 0;
+    uint64_t notes  = 0;
+
+    std::array<uint64_t, 128> pitches  = {};
+    std::array<uint64_t, 128> programs = {};
+
+    double total_duration = 0;
+    double min_duration   = 0;
+    double max_duration   = 0;
+    double min_bpm        = 0;
+    double max_bpm        = 0;
+
+    /// @brief Files which failed, ordered by their position in the input
+    std::vector<ScanError> errors;
+
+    /// @brief Add the statistics of a single file
+    void add(const FileStats& file);
+
+    /// @brief Combine with statistics gathered elsewhere, eg. by another thread
+    void merge(const CorpusStats& other);
+};
+
+/**
+ * @brief Analyse a Standard MIDI File held in memory
+ *
+ * @throws std::domain_error if the file is malformed
+ * @throws std::underflow_error if the file is truncated
+ */
+FileStats scan_file(const uint8_t* data, size_t size);
+
+/**
+ * @brief Map and analyse a Standard MIDI File
+ *
+ * @throws std::system_error if the file could not be mapped
+ * @throws Whatever is thrown by scan_file(const uint8_t*, size_t)
+ */
+FileStats scan_file(const std::string& path);
+
+/**
+ * @brief Analyse many files in parallel
+ *
+ * Files are handed out to the worker threads one at a time, so a few large files do not hold up the rest of the
+ * corpus. Each thread accumulates its own CorpusStats which are merged once all files are done. A file which cannot
+ * be read or parsed is recorded in CorpusStats::errors and does not stop the run.
+ *
+ * @param [in] paths Files to analyse
+ * @param [in] threads Number of worker threads including the calling thread, @c 0 to use one per hardware thread
+ */
+CorpusStats scan_corpus(const std::vector<std::string>& paths, unsigned int threads = 0);
+}
+
+#endif //_BRAGI_MIDI_V1_CORPUS_HPP_//
@@ -0,0 +1,367 @@
+#include <bragi/midi/v1/device_registry.hpp>
+
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+namespace bragi::midi::v1 {
+/********************************/
+/* Cached backend               */
+/********************************/
+/**
+ * @brief Forwards everything to a backend, except the capabilities which come from the registry
+ */
+class CachedBackend : public OutputBackend {
+    protected:
+        std::unique_ptr<OutputBackend> backend;
+        DeviceInfo                     details;
+
+    public:
+        CachedBackend(std::unique_ptr<OutputBackend> backend, DeviceInfo details):
+                backend(std::move(backend)),
+                details(std::move(details))
+            {}
+
+        void connect() override {
+            backend->connect();
+        }
+
+        void disconnect() override {
+            backend->disconnect();
+        }
+
+        void send_short(uint8_t status, uint8_t data1, uint8_t data2) override {
+            backend->send_short(status, data1, data2);
+        }
+
+        void send_long(const uint8_t* data, size_t size) override {
+            backend->send_long(data, size);
+        }
+
+        bool physical_device() const override {
+            return details.physical_device;
+        }
+
+        uint16_t manufacturer_id() const override {
+            return details.manufacturer_id;
+        }
+
+        uint16_t product_id() const override {
+            return details.product_id;
+        }
+
+        std::string product_name() const override {
+            return details.product_name;
+        }
+};
+
+/********************************/
+/* SystemDeviceProvider         */
+/********************************/
+unsigned int SystemDeviceProvider::count() {
+    return system_output_count();
+}
+
+std::unique_ptr<OutputBackend> SystemDeviceProvider::open(unsigned int out_no) {
+    return system_output_backend(out_no);
+}
+
+/********************************/
+/* SimulatedDeviceProvider      */
+/********************************/
+struct SimulatedDeviceProvider::State {
+    struct Device {
+        std::basic_string<uint8_t> sent;
+        size_t                     opened      = 0;
+        size_t                     connections = 0;
+    };
+
+    std::mutex                 mutex;
+    std::chrono::microseconds  connect_time;
+    unsigned int               count;
+    std::vector<Device>        devices;  // Kept for removed devices, so they come back with what they recorded
+
+    Device& device_locked(unsigned int out_no) {
+        if ( out_no >= count )
+            throw std::domain_error("No such output!");
+        return devices[out_no];
+    }
+};
+
+/**
+ * @brief Backend of a simulated device, appending what is sent to the device record
+ */
+class SimulatedBackend : public OutputBackend {
+    protected:
+        using State = SimulatedDeviceProvider::State;
+
+        std::shared_ptr<State> state;
+        unsigned int           out_no;
+        bool                   open = false;
+
+        void record(const uint8_t* data, size_t size) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if ( !open )
+                throw std::logic_error("Not connected!");
+            if ( out_no >= state->count )
+                throw std::system_error(std::make_error_code(std::errc::no_such_device));
+            state->devices[out_no].sent.append(data, size);
+        }
+
+    public:
+        SimulatedBackend(std::shared_ptr<State> state, unsigned int out_no): state(std::move(state)), out_no(out_no) {}
+
+        void connect() override {
+            if ( open )
+                throw std::logic_error("Already connected!");
+            std::this_thread::sleep_for(state->connect_time);
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if ( out_no >= state->count )
+                throw std::system_error(std::make_error_code(std::errc::no_such_device));
+            state->devices[out_no].connections++;
+            open = true;
+        }
+
+        void disconnect() override {
+            open = false;
+        }
+
+        void send_short(uint8_t status, uint8_t data1, uint8_t data2) override {
+            uint8_t bytes[3] = {status, data1, data2};
+            record(bytes, short_message_size(status));
+        }
+
+        void send_long(const uint8_t* data, size_t size) override {
+            record(data, size);
+        }
+
+        bool physical_device() const override {
+            return false;
+        }
+
+        uint16_t manufacturer_id() const override {
+            return 0;
+        }
+
+        uint16_t product_id() const override {
+            return 0;
+        }
+
+        std::string product_name() const override {
+            return "simulated:" + std::to_string(out_no);
+        }
+};
+
+SimulatedDeviceProvider::SimulatedDeviceProvider(unsigned int count, std::chrono::microseconds connect_time):
+        state(std::make_shared<State>())
+    {
+        state->connect_time = connect_time;
+        state->count        = count;
+        state->devices.resize(count);
+    }
+
+unsigned int SimulatedDeviceProvider::count() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->count;
+}
+
+std::unique_ptr<OutputBackend> SimulatedDeviceProvider::open(unsigned int out_no) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->device_locked(out_no).opened++;
+    return std::unique_ptr<OutputBackend>(new SimulatedBackend(state, out_no));
+}
+
+void SimulatedDeviceProvider::set_count(unsigned int count) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if ( count > state->devices.size() )
+        state->devices.resize(count);
+    state->count = count;
+}
+
+std::basic_string<uint8_t> SimulatedDeviceProvider::sent(unsigned int out_no) const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->device_locked(out_no).sent;
+}
+
+size_t SimulatedDeviceProvider::opened(unsigned int out_no) const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->device_locked(out_no).opened;
+}
+
+size_t SimulatedDeviceProvider::connections(unsigned int out_no) const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->device_locked(out_no).connections;
+}
+
+void SimulatedDeviceProvider::clear() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    for ( State::Device& device : state->devices )
+        device.sent.clear();
+}
+
+/********************************/
+/* DeviceRegistry               */
+/********************************/
+DeviceRegistry::DeviceRegistry(std::shared_ptr<DeviceProvider> provider, std::chrono::milliseconds recheck_interval):
+        provider(provider ? std::move(provider) : std::make_shared<SystemDeviceProvider>()),
+        recheck_interval(recheck_interval)
+    {}
+
+DeviceRegistry& DeviceRegistry::instance() {
+    static DeviceRegistry registry;
+    return registry;
+}
+
+void DeviceRegistry::clear_pool_locked() {
+    // Outputs still connecting are handed to their caller unpooled, and those waiting for them try again
+    pool.clear();
+    pool_changed.notify_all();
+}
+
+void DeviceRegistry::reload_locked() {
+    std::vector<DeviceInfo> found;
+    unsigned int            total = provider->count();
+
+    for ( unsigned int out_no = 0; out_no < total; out_no++ ) {
+        std::unique_ptr<OutputBackend> backend = provider->open(out_no);
+
+        DeviceInfo details;
+        details.out_no          = out_no;
+        details.product_name    = backend->product_name();
+        details.manufacturer_id = backend->manufacturer_id();
+        details.product_id      = backend->product_id();
+        details.physical_device = backend->physical_device();
+        found.push_back(std::move(details));
+    }
+
+    // Device numbers may now refer to other devices, so pooled connections must not be handed out again
+    devices.swap(found);
+    clear_pool_locked();
+    cached     = true;
+    checked_at = clock::now();
+}
+
+void DeviceRegistry::revalidate_locked() {
+    if ( !cached )
+        return reload_locked();
+
+    clock::time_point now = clock::now();
+    if ( now - checked_at < recheck_interval )
+        return;
+
+    if ( provider->count() != devices.size() )
+        return reload_locked();
+    checked_at = now;
+}
+
+const DeviceInfo& DeviceRegistry::info_locked(unsigned int out_no) {
+    revalidate_locked();
+    if ( out_no >= devices.size() )
+        throw std::domain_error("No such output!");
+    return devices[out_no];
+}
+
+std::unique_ptr<OutputBackend> DeviceRegistry::open_locked(unsigned int out_no) {
+    const DeviceInfo& details = info_locked(out_no);
+    return std::unique_ptr<OutputBackend>(new CachedBackend(provider->open(out_no), details));
+}
+
+void DeviceRegistry::set_provider(std::shared_ptr<DeviceProvider> provider) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->provider = provider ? std::move(provider) : std::make_shared<SystemDeviceProvider>();
+    cached         = false;
+    devices.clear();
+    clear_pool_locked();
+}
+
+unsigned int DeviceRegistry::count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    revalidate_locked();
+    return static_cast<unsigned int>(devices.size());
+}
+
+std::vector<DeviceInfo> DeviceRegistry::list() {
+    std::lock_guard<std::mutex> lock(mutex);
+    revalidate_locked();
+    return devices;
+}
+
+DeviceInfo DeviceRegistry::info(unsigned int out_no) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return info_locked(out_no);
+}
+
+std::unique_ptr<OutputBackend> DeviceRegistry::open(unsigned int out_no) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return open_locked(out_no);
+}
+
+std::shared_ptr<Output> DeviceRegistry::acquire(unsigned int out_no) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while ( true ) {
+        // Revalidating first, as a changed device list empties the pool
+        info_locked(out_no);
+
+        std::map<unsigned int, Pooled>::iterator pooled = pool.find(out_no);
+        if ( pooled == pool.end() )
+            break;
+        if ( !pooled->second.connecting )
+            return pooled->second.output;
+
+        pool_changed.wait(lock);
+    }
+
+    std::shared_ptr<Output> output = std::make_shared<Output>(open_locked(out_no));
+    pool[out_no] = {output, true};
+
+    // Opening a device may take tens of milliseconds, which must not hold up other devices or count()
+    lock.unlock();
+    std::exception_ptr failure;
+    try {
+        output->connect();
+    } catch ( ... ) {
+        failure = std::current_exception();
+    }
+    lock.lock();
+
+    // Unless a refresh dropped the placeholder meanwhile
+    std::map<unsigned int, Pooled>::iterator pooled = pool.find(out_no);
+    if ( pooled != pool.end() && pooled->second.output == output ) {
+        if ( failure )
+            pool.erase(pooled);
+        else
+            pooled->second.connecting = false;
+    }
+    pool_changed.notify_all();
+
+    if ( failure )
+        std::rethrow_exception(failure);
+    return output;
+}
+
+size_t DeviceRegistry::close_idle() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t closed = 0;
+    for ( std::map<unsigned int, Pooled>::iterator it = pool.begin(); it != pool.end(); ) {
+        if ( !it->second.connecting && it->second.output.use_count() == 1 ) {
+            it = pool.erase(it);
+            closed++;
+        } else {
+            ++it;
+        }
+    }
+    return closed;
+}
+
+void DeviceRegistry::refresh() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cached = false;
+    devices.clear();
+    clear_pool_locked();
+}
+}
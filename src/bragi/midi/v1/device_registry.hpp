@@ -0,0 +1,255 @@
+/**
+ * @file device_registry.hpp
+ * @brief Process-wide cache of output devices and their open connections
+ */
+#ifndef _BRAGI_MIDI_V1_DEVICE_REGISTRY_HPP_
+#define _BRAGI_MIDI_V1_DEVICE_REGISTRY_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/output_backend.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Capabilities of an output device, as reported by its backend
+ */
+struct DeviceInfo {
+    unsigned int out_no          = 0;
+    std::string  product_name;
+    uint16_t     manufacturer_id = 0;
+    uint16_t     product_id      = 0;
+    bool         physical_device = false;
+};
+
+/**
+ * @brief Source of the output devices listed by a DeviceRegistry
+ *
+ * Implement this to list simulated devices, eg. for testing on a machine without any.
+ */
+class DeviceProvider {
+    public:
+        virtual ~DeviceProvider() = default;
+
+        /// @brief Number of devices currently present
+        virtual unsigned int count() = 0;
+
+        /**
+         * @brief Create a backend for a device, without connecting it
+         *
+         * @throws std::domain_error if @b out_no does not exist
+         */
+        virtual std::unique_ptr<OutputBackend> open(unsigned int out_no) = 0;
+};
+
+/**
+ * @brief Devices of the system MIDI API, see system_output_count() and system_output_backend()
+ */
+class SystemDeviceProvider : public DeviceProvider {
+    public:
+        unsigned int count() override;
+        std::unique_ptr<OutputBackend> open(unsigned int out_no) override;
+};
+
+/**
+ * @brief Devices which only exist in memory, recording what is sent to them
+ *
+ * Stands in for the system MIDI API in tests, or on a machine without devices. Devices are named @c simulated:
+ * followed by their number, and can be plugged in or removed with set_count(). Backends stay valid when the provider
+ * is destroyed.
+ *
+ * @code
+ * std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(2);
+ * DeviceRegistry::instance().set_provider(devices);
+ *
+ * Output output(1);
+ * output.connect();
+ * output.send_msg(note_on(middle_c));
+ * devices->sent(1); // 90 3C 7F
+ * @endcode
+ */
+class SimulatedDeviceProvider : public DeviceProvider {
+    protected:
+        struct State;
+        friend class SimulatedBackend;
+
+        std::shared_ptr<State> state;
+
+    public:
+        /**
+         * @brief Create the devices
+         *
+         * @param [in] count Number of devices
+         * @param [in] connect_time How long connecting takes, as opening a real device does
+         */
+        explicit SimulatedDeviceProvider(unsigned int count = 1,
+                                         std::chrono::microseconds connect_time = std::chrono::microseconds(0));
+
+        unsigned int count() override;
+
+        /// @throws std::domain_error if @b out_no does not exist
+        std::unique_ptr<OutputBackend> open(unsigned int out_no) override;
+
+        /// @brief Plug in or remove devices, keeping what the remaining devices recorded
+        void set_count(unsigned int count);
+
+        /**
+         * @brief Every byte sent to a device since it was created, or since clear()
+         *
+         * @throws std::domain_error if @b out_no does not exist
+         */
+        std::basic_string<uint8_t> sent(unsigned int out_no) const;
+
+        /**
+         * @brief Number of backends created for a device
+         *
+         * @throws std::domain_error if @b out_no does not exist
+         */
+        size_t opened(unsigned int out_no) const;
+
+        /**
+         * @brief Number of times a device was connected
+         *
+         * @throws std::domain_error if @b out_no does not exist
+         */
+        size_t connections(unsigned int out_no) const;
+
+        /// @brief Forget what was sent to every device
+        void clear();
+};
+
+/**
+ * @brief Caches what devices exist and keeps their connections open for reuse
+ *
+ * The device list and capabilities are read once and then kept. Every @b recheck_interval the device count is read
+ * again, which is cheap, and the list is read again in full if it changed, eg. when a device is plugged in or removed.
+ * Call refresh() when the platform reports a change that keeps the count the same.
+ *
+ * acquire() hands out connected outputs shared by everyone acquiring the same device, so acquiring an output that is
+ * already open only copies a pointer. The registry keeps its own reference, so connections stay open after their
+ * last user lets go until close_idle() or refresh() is called. Connecting happens without holding the registry lock,
+ * so a slow device only holds up those acquiring that same device.
+ *
+ * Output(out_no) and Output::output_count() go through the process-wide instance(). Output(out_no) takes the device
+ * details from the cache but always opens a connection of its own, so code which opens the same device again and
+ * again, eg. when switching patches, should acquire() it instead.
+ */
+class DeviceRegistry {
+    protected:
+        using clock = std::chrono::steady_clock;
+
+        struct Pooled {
+            std::shared_ptr<Output> output;
+            bool                    connecting = false; // Placeholder while the output connects without the lock
+        };
+
+        std::shared_ptr<DeviceProvider>                   provider;
+        clock::duration                                   recheck_interval;
+
+        std::mutex                                        mutex;
+        std::condition_variable                           pool_changed;
+        bool                                              cached = false;
+        clock::time_point                                 checked_at;
+        std::vector<DeviceInfo>                           devices;
+        std::map<unsigned int, Pooled>                    pool;
+
+        void clear_pool_locked();
+        void reload_locked();
+        void revalidate_locked();
+        const DeviceInfo& info_locked(unsigned int out_no);
+        std::unique_ptr<OutputBackend> open_locked(unsigned int out_no);
+
+    public:
+        /// @brief Disable copy constructor, connections are pooled per registry
+        DeviceRegistry(const DeviceRegistry&) = delete;
+
+        /// @brief Disable copy assignment, connections are pooled per registry
+        DeviceRegistry& operator=(const DeviceRegistry&) = delete;
+
+        /**
+         * @brief Create a registry of the devices from a provider
+         *
+         * @param [in] provider Source of devices, the system MIDI API if empty
+         * @param [in] recheck_interval How often to check the device count for changes
+         */
+        explicit DeviceRegistry(std::shared_ptr<DeviceProvider> provider = nullptr,
+                                std::chrono::milliseconds recheck_interval = std::chrono::seconds(1));
+
+        /// @brief The registry shared by the whole process, listing system MIDI devices unless changed
+        static DeviceRegistry& instance();
+
+        /**
+         * @brief Replace the source of devices, as refresh() does
+         *
+         * @param [in] provider Source of devices, the system MIDI API if empty
+         */
+        void set_provider(std::shared_ptr<DeviceProvider> provider);
+
+        /**
+         * @brief Number of devices
+         *
+         * @throws Whatever is thrown by the provider while reading the device list
+         */
+        unsigned int count();
+
+        /**
+         * @brief Capabilities of every device
+         *
+         * @throws Whatever is thrown by the provider while reading the device list
+         */
+        std::vector<DeviceInfo> list();
+
+        /**
+         * @brief Capabilities of one device
+         *
+         * @throws std::domain_error if @b out_no does not exist
+         * @throws Whatever is thrown by the provider while reading the device list
+         */
+        DeviceInfo info(unsigned int out_no);
+
+        /**
+         * @brief Create a separate, unconnected backend for a device
+         *
+         * Its capabilities are answered from the cache instead of asking the device.
+         *
+         * @throws std::domain_error if @b out_no does not exist
+         * @throws Whatever is thrown by the provider
+         */
+        std::unique_ptr<OutputBackend> open(unsigned int out_no);
+
+        /**
+         * @brief Get a connected output for a device, shared with anyone else acquiring it
+         *
+         * The output must not be disconnected by its users. While one caller connects a device, others acquiring the
+         * same device wait for it. If the device list is refreshed meanwhile, the caller still gets its output, but
+         * it is not pooled.
+         *
+         * @throws std::domain_error if @b out_no does not exist
+         * @throws Whatever is thrown by the provider or by Output::connect()
+         */
+        std::shared_ptr<Output> acquire(unsigned int out_no);
+
+        /**
+         * @brief Close pooled connections nobody else holds
+         *
+         * @returns Number of connections closed
+         */
+        size_t close_idle();
+
+        /**
+         * @brief Forget the device list and pooled connections
+         *
+         * Outputs still held by users stay connected until released, but are no longer handed out.
+         */
+        void refresh();
+};
+}
+
+#endif //_BRAGI_MIDI_V1_DEVICE_REGISTRY_HPP_//
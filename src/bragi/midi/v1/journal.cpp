@@ -0,0 +1,458 @@
+#include <bragi/midi/v1/journal.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+
+namespace bragi::midi::v1 {
+static_assert(sizeof(JournalRecord) == 24, "Journal records must stay 24 bytes");
+
+/**
+ * @brief Header at the start of each segment file, records follow directly after
+ */
+struct SegmentHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t count;
+    int64_t  first_time;
+    int64_t  started_at;
+    uint64_t reserved[2];
+};
+
+static_assert(sizeof(SegmentHeader) == 64, "Segment header must stay 64 bytes");
+
+constexpr static char     segment_magic[8] = {'B', 'R', 'A', 'G', 'I', 'J', 'N', 'L'};
+constexpr static uint32_t segment_version  = 1;
+
+static std::string segment_path(const std::string& prefix, size_t number) {
+    char name[32];
+    std::snprintf(name, sizeof(name), ".%08u.seg", static_cast<unsigned int>(number));
+    return prefix + name;
+}
+
+static std::string sysex_path(const std::string& prefix) {
+    return prefix + ".sysex";
+}
+
+/********************************/
+/* JournalWriter                */
+/********************************/
+JournalWriter::JournalWriter(const std::string& prefix, size_t segment_records, size_t queue_capacity,
+                             std::chrono::microseconds poll_interval):
+        prefix(prefix),
+        segment_records(segment_records),
+        start(std::chrono::steady_clock::now()),
+        started_at(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()),
+        entries(queue_capacity),
+        sysex_bytes(queue_capacity),
+        poll_interval(poll_interval),
+        running(true),
+        broken(false),
+        dropped_count(0)
+    {
+        if ( segment_records == 0 )
+            throw std::invalid_argument("Segments must hold at least 1 record!");
+
+        sysex_file.open(sysex_path(prefix), std::ios::binary | std::ios::trunc);
+        if ( !sysex_file )
+            throw std::system_error(std::make_error_code(std::errc::io_error), "Could not create sysex file");
+
+        // A longer message could never be queued, so sent_raw() drops it instead of growing this
+        raw_sysex.reserve(sysex_bytes.capacity());
+
+        open_segment();
+        worker = std::thread(&JournalWriter::run, this);
+    }
+
+JournalWriter::~JournalWriter() {
+    running.store(false, std::memory_order_release);
+    worker.join();
+
+    try {
+        close_segment();
+    } catch ( std::exception& ) {
+
+    }
+}
+
+int64_t JournalWriter::now() const noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void JournalWriter::open_segment() {
+    segment.reset(new MappedFile(segment_path(prefix, segment_number),
+                                 sizeof(SegmentHeader) + segment_records * sizeof(JournalRecord)));
+    segment_used = 0;
+
+    SegmentHeader header = {};
+    std::memcpy(header.magic, segment_magic, sizeof(header.magic));
+    header.version     = segment_version;
+    header.record_size = sizeof(JournalRecord);
+    header.capacity    = segment_records;
+    header.started_at  = started_at;
+
+    std::memcpy(segment->writable_data(), &header, sizeof(header));
+}
+
+void JournalWriter::close_segment() {
+    if ( !segment )
+        return;
+
+    segment->sync();
+    segment.reset();
+    segment_number++;
+}
+
+void JournalWriter::drain() {
+    SegmentHeader* header  = reinterpret_cast<SegmentHeader*>(segment->writable_data());
+    JournalRecord* records = reinterpret_cast<JournalRecord*>(segment->writable_data() + sizeof(SegmentHeader));
+    bool           wrote_sysex = false;
+    Entry          entry;
+
+    while ( entries.try_pop(entry) ) {
+        if ( segment_used == segment_records ) {
+            close_segment();
+            open_segment();
+            header  = reinterpret_cast<SegmentHeader*>(segment->writable_data());
+            records = reinterpret_cast<JournalRecord*>(segment->writable_data() + sizeof(SegmentHeader));
+        }
+
+        JournalRecord& record = records[segment_used];
+        record.time         = entry.time;
+        record.message      = entry.msg.packed() | static_cast<uint32_t>(entry.source) << 24;
+        record.sysex_size   = entry.sysex_size;
+        record.sysex_offset = 0;
+
+        if ( entry.sysex_size ) {
+            // The bytes were queued before the entry, so they are all available
+            sysex_buffer.resize(entry.sysex_size);
+            for ( uint8_t& byte : sysex_buffer )
+                sysex_bytes.try_pop(byte);
+
+            sysex_file.write(reinterpret_cast<const char*>(sysex_buffer.data()), sysex_buffer.size());
+            if ( !sysex_file )
+                throw std::system_error(std::make_error_code(std::errc::io_error), "Could not write sysex file");
+
+            record.sysex_offset = sysex_offset;
+            sysex_offset += entry.sysex_size;
+            wrote_sysex = true;
+        }
+
+        if ( segment_used == 0 )
+            header->first_time = entry.time;
+
+        // Publish the record only once it is complete, for readers of a live journal
+        segment_used++;
+        header->count = segment_used;
+    }
+
+    if ( wrote_sysex )
+        sysex_file.flush();
+}
+
+void JournalWriter::run() {
+    while ( true ) {
+        bool stopping = !running.load(std::memory_order_acquire);
+
+        try {
+            drain();
+        } catch ( std::exception& ) {
+            broken.store(true, std::memory_order_release);
+            return;
+        }
+
+        if ( stopping )
+            return;
+
+        std::this_thread::sleep_for(poll_interval);
+    }
+}
+
+bool JournalWriter::record(const ShortMessage& msg, uint8_t source) noexcept {
+    Entry entry = {now(), msg, source, 0};
+
+    if ( msg.valid() && !broken.load(std::memory_order_acquire) && entries.try_push(entry) )
+        return true;
+
+    dropped_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool JournalWriter::record_sysex(const uint8_t* data, size_t size, uint8_t source) noexcept {
+    Entry entry = {now(), ShortMessage(), source, static_cast<uint32_t>(size)};
+
+    // Check for room first so a message is never recorded partially
+    if ( !broken.load(std::memory_order_acquire) && entries.size() < entries.capacity()
+         && sysex_bytes.capacity() - sysex_bytes.size() >= size ) {
+        for ( size_t i = 0; i < size; i++ )
+            sysex_bytes.try_push(data[i]);
+        entries.try_push(entry);
+        return true;
+    }
+
+    dropped_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool JournalWriter::record(const Message& msg, uint8_t source) noexcept {
+    try {
+        if ( msg.message_type() != MessageType::system_exclusive )
+            return record(ShortMessage::from(msg), source);
+
+        std::basic_string<uint8_t> bytes = msg.serialize();
+        return record_sysex(bytes.data(), bytes.size(), source);
+    } catch ( std::exception& ) {
+
+    }
+
+    dropped_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void JournalWriter::sent(const ShortMessage& msg) noexcept {
+    record(msg);
+}
+
+void JournalWriter::sent(const Message& msg) noexcept {
+    record(msg);
+}
+
+void JournalWriter::sent_raw(const uint8_t* data, size_t size) noexcept {
+    for ( size_t i = 0; i < size; i++ ) {
+        uint8_t byte = data[i];
+
+        // Realtime messages may appear anywhere, even inside a system exclusive message
+        if ( byte >= MessageType::timing_tick ) {
+            record(ShortMessage(byte));
+            continue;
+        }
+
+        if ( raw_in_sysex ) {
+            if ( !(byte & 0x80) || byte == MessageType::end_of_system_exclusive ) {
+                // The rest of the message is skipped as data bytes without a status
+                if ( raw_sysex.size() == raw_sysex.capacity() ) {
+                    raw_in_sysex = false;
+                    dropped_count.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                raw_sysex.push_back(byte);
+
+                if ( byte == MessageType::end_of_system_exclusive ) {
+                    raw_in_sysex = false;
+                    record_sysex(raw_sysex.data(), raw_sysex.size(), 0);
+                }
+                continue;
+            }
+
+            // Cut short by another status byte, which is handled below
+            raw_in_sysex = false;
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if ( byte == MessageType::system_exclusive ) {
+            raw_have    = 0;
+            raw_running = 0;
+            raw_sysex.clear();
+            raw_sysex.push_back(byte);
+            raw_in_sysex = true;
+            continue;
+        }
+
+        if ( byte & 0x80 ) {
+            raw_msg[0]  = byte;
+            raw_have    = 1;
+            raw_need    = short_message_size(byte);
+            raw_running = byte < 0xF0 ? byte : 0;
+
+            if ( raw_need == 0 )
+                raw_have = 0;
+        } else {
+            if ( raw_have == 0 ) {
+                if ( !raw_running )
+                    continue;
+                raw_msg[0] = raw_running;
+                raw_have   = 1;
+                raw_need   = short_message_size(raw_running);
+            }
+            raw_msg[raw_have++] = byte;
+        }
+
+        if ( raw_have != 0 && raw_have == raw_need ) {
+            record(ShortMessage(raw_msg[0], raw_msg[1], raw_msg[2]));
+            raw_have = 0;
+        }
+    }
+}
+
+size_t JournalWriter::dropped() const noexcept {
+    return dropped_count.load(std::memory_order_relaxed);
+}
+
+bool JournalWriter::failed() const noexcept {
+    return broken.load(std::memory_order_acquire);
+}
+
+/********************************/
+/* JournalReader                */
+/********************************/
+JournalReader::JournalReader(const std::string& prefix) {
+    for ( size_t number = 0; ; number++ ) {
+        std::unique_ptr<MappedFile> file;
+
+        try {
+            file.reset(new MappedFile(segment_path(prefix, number)));
+        } catch ( std::system_error& e ) {
+            if ( e.code() == std::errc::no_such_file_or_directory )
+                break;
+            throw;
+        }
+
+        if ( file->size() < sizeof(SegmentHeader) )
+            throw std::domain_error("Truncated journal segment!");
+
+        SegmentHeader header;
+        std::memcpy(&header, file->data(), sizeof(header));
+
+        if ( std::memcmp(header.magic, segment_magic, sizeof(header.magic)) != 0
+             || header.version != segment_version || header.record_size != sizeof(JournalRecord) )
+            throw std::domain_error("Not a journal segment!");
+
+        if ( header.count > header.capacity
+             || (file->size() - sizeof(SegmentHeader)) / sizeof(JournalRecord) < header.count )
+            throw std::domain_error("Malformed journal segment!");
+
+        if ( number == 0 )
+            started_at = header.started_at;
+
+        // Left over from an older journal with the same prefix
+        else if ( header.started_at != started_at )
+            break;
+
+        // Segments after an empty one cannot hold anything yet
+        if ( header.count == 0 )
+            break;
+
+        first_index.push_back(total);
+        first_time.push_back(header.first_time);
+        total += header.count;
+        segments.push_back(std::move(file));
+    }
+
+    first_index.push_back(total);
+    sysex.reset(new MappedFile(sysex_path(prefix)));
+}
+
+const JournalRecord* JournalReader::records(size_t segment) const {
+    return reinterpret_cast<const JournalRecord*>(segments[segment]->data() + sizeof(SegmentHeader));
+}
+
+size_t JournalReader::size() const {
+    return total;
+}
+
+JournalEntry JournalReader::at(size_t index) const {
+    if ( index >= total )
+        throw std::out_of_range("No such record!");
+
+    size_t segment = std::upper_bound(first_index.begin(), first_index.end(), index) - first_index.begin() - 1;
+    const JournalRecord& record = records(segment)[index - first_index[segment]];
+
+    JournalEntry entry;
+    entry.time   = record.time;
+    entry.source = static_cast<uint8_t>(record.message >> 24);
+
+    if ( record.sysex_size == 0 ) {
+        entry.msg = ShortMessage(record.message & 0xFF, record.message >> 8 & 0xFF, record.message >> 16 & 0xFF);
+        return entry;
+    }
+
+    if ( record.sysex_offset > sysex->size() || sysex->size() - record.sysex_offset < record.sysex_size )
+        throw std::domain_error("Missing system exclusive data!");
+
+    entry.sysex      = sysex->data() + record.sysex_offset;
+    entry.sysex_size = record.sysex_size;
+    return entry;
+}
+
+size_t JournalReader::seek(int64_t time) const {
+    // Sparse index first - the last segment starting before the time
+    size_t segment = std::lower_bound(first_time.begin(), first_time.end(), time) - first_time.begin();
+    if ( segment > 0 )
+        segment--;
+
+    for ( ; segment < segments.size(); segment++ ) {
+        const JournalRecord* begin = records(segment);
+        const JournalRecord* end   = begin + (first_index[segment + 1] - first_index[segment]);
+        const JournalRecord* found = std::lower_bound(begin, end, time,
+            [](const JournalRecord& record, int64_t t) { return record.time < t; });
+
+        if ( found != end )
+            return first_index[segment] + (found - begin);
+    }
+
+    return total;
+}
+
+std::chrono::system_clock::time_point JournalReader::started() const {
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::nanoseconds(started_at)));
+}
+
+/********************************/
+/* JournalReplayer              */
+/********************************/
+JournalReplayer::JournalReplayer(const JournalReader& reader, std::shared_ptr<Output> output):
+        reader(reader),
+        output(std::move(output)),
+        stopping(false)
+    {
+        if ( !this->output )
+            throw std::invalid_argument("No output!");
+    }
+
+size_t JournalReplayer::play(int64_t from, int64_t to, double speed) {
+    if ( !(speed > 0) )
+        throw std::invalid_argument("Speed must be positive!");
+
+    stopping.store(false, std::memory_order_release);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t sent = 0;
+
+    for ( size_t i = reader.seek(from); i < reader.size(); i++ ) {
+        JournalEntry entry = reader.at(i);
+        if ( entry.time >= to )
+            break;
+
+        std::chrono::steady_clock::time_point due = start
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::nano>((entry.time - from) / speed));
+
+        // Sleep in short steps so stop() is noticed during long pauses
+        while ( !stopping.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < due )
+            std::this_thread::sleep_until(std::min(due, std::chrono::steady_clock::now() + std::chrono::milliseconds(10)));
+
+        if ( stopping.load(std::memory_order_acquire) )
+            break;
+
+        if ( entry.sysex )
+            output->send_msg(Message::parse(std::basic_string<uint8_t>(entry.sysex, entry.sysex + entry.sysex_size)));
+        else
+            output->send_msg(entry.msg);
+
+        sent++;
+    }
+
+    return sent;
+}
+
+void JournalReplayer::stop() {
+    stopping.store(true, std::memory_order_release);
+}
+}
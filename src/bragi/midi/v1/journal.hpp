@@ -0,0 +1,289 @@
+/**
+ * @file journal.hpp
+ * @brief Recording MIDI traffic to disk and replaying it
+ *
+ * A journal is a set of files sharing a prefix:
+ *  @li @c prefix.00000000.seg, @c prefix.00000001.seg, ... - segments of fixed-size JournalRecord entries, each
+ *      preceded by a small header
+ *  @li @c prefix.sysex - the bytes of every system exclusive message, appended back to back
+ *
+ * Records are stored in time order, so a record can be found by binary search over the segment headers and then
+ * over the records of one segment.
+ */
+#ifndef _BRAGI_MIDI_V1_JOURNAL_HPP_
+#define _BRAGI_MIDI_V1_JOURNAL_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bragi/midi/v1/mapped_file.hpp>
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+#include <bragi/midi/v1/spsc_ring.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief A record as stored in a journal segment
+ */
+struct JournalRecord {
+    /// @brief Nanoseconds since the journal was started
+    int64_t  time;
+
+    /// @brief ShortMessage::packed(), with the source in the top byte
+    uint32_t message;
+
+    /// @brief Length of the system exclusive message in the sysex file, @c 0 for short messages
+    uint32_t sysex_size;
+
+    /// @brief Position of the system exclusive message in the sysex file
+    uint64_t sysex_offset;
+};
+
+/**
+ * @brief Records messages to a journal without blocking the recording thread
+ *
+ * record() copies the message into a queue allocated up front and returns. A background thread moves queued
+ * messages into memory-mapped segments, so the operating system writes them out without further copies.
+ *
+ * record() and the OutputMonitor callbacks must only be called by one thread at a time. Passing the writer to
+ * Output::set_monitor() of a single Output satisfies this, as the Output is locked while the callbacks run.
+ */
+class JournalWriter : public OutputMonitor {
+    protected:
+        struct Entry {
+            int64_t      time;
+            ShortMessage msg;
+            uint8_t      source;
+            uint32_t     sysex_size;
+        };
+
+        std::string                           prefix;
+        size_t                                segment_records;
+        std::chrono::steady_clock::time_point start;
+        int64_t                               started_at;
+        SpscRing<Entry>                       entries;
+        SpscRing<uint8_t>                     sysex_bytes;
+        std::chrono::microseconds             poll_interval;
+        std::atomic<bool>                     running;
+        std::atomic<bool>                     broken;
+        std::atomic<size_t>                   dropped_count;
+
+        // Only touched by the flushing thread
+        std::unique_ptr<MappedFile>           segment;
+        size_t                                segment_number = 0;
+        size_t                                segment_used   = 0;
+        std::ofstream                         sysex_file;
+        uint64_t                              sysex_offset   = 0;
+        std::vector<uint8_t>                  sysex_buffer;
+
+        // Messages being put together from sent_raw(), only touched by the recording thread
+        std::vector<uint8_t>                  raw_sysex;
+        bool                                  raw_in_sysex   = false;
+        uint8_t                               raw_msg[3]     = {0, 0, 0};
+        size_t                                raw_have       = 0;
+        size_t                                raw_need       = 0;
+        uint8_t                               raw_running    = 0;
+
+        std::thread                           worker;
+
+        int64_t now() const noexcept;
+        bool record_sysex(const uint8_t* data, size_t size, uint8_t source) noexcept;
+        void open_segment();
+        void close_segment();
+        void drain();
+        void run();
+
+    public:
+        /// @brief Disable empty constructor
+        JournalWriter() = delete;
+
+        /// @brief Disable copy constructor, the worker thread refers to this object
+        JournalWriter(const JournalWriter&) = delete;
+
+        /// @brief Disable copy assignment, the worker thread refers to this object
+        JournalWriter& operator=(const JournalWriter&) = delete;
+
+        /**
+         * @brief Start a new journal, overwriting any journal with the same prefix
+         *
+         * @param [in] prefix Path and name shared by the journal files
+         * @param [in] segment_records Number of records per segment file
+         * @param [in] queue_capacity Number of messages, and bytes of system exclusive data, which can be queued
+         * @param [in] poll_interval How long the background thread sleeps once the queue is empty
+         *
+         * @throws std::invalid_argument if @b segment_records is @c 0
+         * @throws std::system_error if the files could not be created or the background thread could not be started
+         */
+        JournalWriter(const std::string& prefix, size_t segment_records = 1 << 20, size_t queue_capacity = 1 << 16,
+                      std::chrono::microseconds poll_interval = std::chrono::milliseconds(1));
+
+        /// @brief Writes out anything still queued, then stops the background thread
+        ~JournalWriter();
+
+        /**
+         * @brief Queue a short message, timestamped now
+         *
+         * @param [in] msg Message to record
+         * @param [in] source Identifies where the message came from, eg. which port
+         *
+         * @returns false if the message is invalid, the queue is full or writing has failed
+         */
+        bool record(const ShortMessage& msg, uint8_t source = 0) noexcept;
+
+        /**
+         * @brief Queue any message, timestamped now
+         *
+         * System exclusive messages are serialized first, which allocates.
+         *
+         * @returns false if the message is invalid, the queue is full or writing has failed
+         */
+        bool record(const Message& msg, uint8_t source = 0) noexcept;
+
+        /// @brief Records @b msg with source @c 0
+        void sent(const ShortMessage& msg) noexcept override;
+
+        /// @brief Records @b msg with source @c 0
+        void sent(const Message& msg) noexcept override;
+
+        /**
+         * @brief Records the messages in a stream of bytes with source @c 0
+         *
+         * System exclusive messages sent in slices, eg. by the Pacer, are recorded once complete. Short messages may
+         * use running status. Never allocates; a system exclusive message longer than the queue capacity is dropped.
+         */
+        void sent_raw(const uint8_t* data, size_t size) noexcept override;
+
+        /// @brief Number of messages which could not be recorded
+        size_t dropped() const noexcept;
+
+        /// @brief Check whether writing to disk has failed, after which nothing more is recorded
+        bool failed() const noexcept;
+};
+
+/**
+ * @brief A message read back from a journal
+ */
+struct JournalEntry {
+    /// @brief Nanoseconds since the journal was started
+    int64_t        time       = 0;
+
+    /// @brief Source passed to JournalWriter::record()
+    uint8_t        source     = 0;
+
+    /// @brief The message, invalid for system exclusive messages
+    ShortMessage   msg;
+
+    /// @brief The full system exclusive message, @c nullptr for short messages
+    const uint8_t* sysex      = nullptr;
+
+    /// @brief Length of @b sysex
+    size_t         sysex_size = 0;
+};
+
+/**
+ * @brief Random access to the records of a journal
+ *
+ * The files are memory-mapped, so opening a journal of any size only reads the segment headers. Records added after
+ * opening are not visible.
+ */
+class JournalReader {
+    protected:
+        std::vector<std::unique_ptr<MappedFile>> segments;
+        std::vector<size_t>                      first_index;
+        std::vector<int64_t>                     first_time;
+        std::unique_ptr<MappedFile>              sysex;
+        size_t                                   total = 0;
+        int64_t                                  started_at = 0;
+
+        const JournalRecord* records(size_t segment) const;
+
+    public:
+        /// @brief Disable empty constructor
+        JournalReader() = delete;
+
+        /**
+         * @brief Open a journal
+         *
+         * @param [in] prefix Path and name shared by the journal files
+         *
+         * @throws std::system_error if a file could not be mapped
+         * @throws std::domain_error if a segment is malformed
+         */
+        explicit JournalReader(const std::string& prefix);
+
+        /// @brief Number of records
+        size_t size() const;
+
+        /**
+         * @brief Read a record
+         *
+         * @throws std::out_of_range if @b index is not less than size()
+         * @throws std::domain_error if the record refers to missing system exclusive data
+         */
+        JournalEntry at(size_t index) const;
+
+        /**
+         * @brief Find the first record at or after a time, in O(log n)
+         *
+         * @param [in] time Nanoseconds since the journal was started
+         *
+         * @returns Index of the record, or size() if there is none
+         */
+        size_t seek(int64_t time) const;
+
+        /// @brief Wall clock time at which the journal was started
+        std::chrono::system_clock::time_point started() const;
+};
+
+/**
+ * @brief Plays the records of a journal into an Output with their original timing
+ */
+class JournalReplayer {
+    protected:
+        const JournalReader&    reader;
+        std::shared_ptr<Output> output;
+        std::atomic<bool>       stopping;
+
+    public:
+        /// @brief Disable empty constructor
+        JournalReplayer() = delete;
+
+        /**
+         * @brief Prepare to replay a journal
+         *
+         * @param [in] reader Journal to replay, must outlive the replayer
+         * @param [in] output Connected output to send to
+         *
+         * @throws std::invalid_argument if @b output is empty
+         */
+        JournalReplayer(const JournalReader& reader, std::shared_ptr<Output> output);
+
+        /**
+         * @brief Replay part of the journal, blocking until done or stopped
+         *
+         * @param [in] from Start of the part, in nanoseconds since the journal was started
+         * @param [in] to End of the part, exclusive
+         * @param [in] speed Playback rate, eg. @c 2 plays twice as fast
+         *
+         * @returns Number of records sent
+         *
+         * @throws std::invalid_argument if @b speed is not positive
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        size_t play(int64_t from = 0, int64_t to = std::numeric_limits<int64_t>::max(), double speed = 1);
+
+        /// @brief Make a running play() return early, may be called from any thread
+        void stop();
+};
+}
+
+#endif //_BRAGI_MIDI_V1_JOURNAL_HPP_//
@@ -0,0 +1,210 @@
+#include <bragi/midi/v1/mapped_file.hpp>
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <system_error>
+
+namespace bragi::midi::v1 {
+/********************************/
+/* Impl                         */
+/********************************/
+#ifdef _WIN32
+struct MappedFile::Impl {
+    HANDLE   file     = INVALID_HANDLE_VALUE;
+    HANDLE   mapping  = nullptr;
+    uint8_t* data     = nullptr;
+    size_t   size     = 0;
+    bool     writable = false;
+
+    Impl(const std::string& path) {
+        file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if ( file == INVALID_HANDLE_VALUE )
+            fail();
+
+        LARGE_INTEGER file_size;
+        if ( !::GetFileSizeEx(file, &file_size) )
+            fail();
+
+        size = static_cast<size_t>(file_size.QuadPart);
+        if ( size == 0 )
+            return;
+
+        map(PAGE_READONLY, FILE_MAP_READ);
+    }
+
+    Impl(const std::string& path, size_t new_size): size(new_size), writable(true) {
+        file = ::CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+        if ( file == INVALID_HANDLE_VALUE )
+            fail();
+
+        if ( size == 0 )
+            return;
+
+        // Creating the mapping extends the file to its full size
+        map(PAGE_READWRITE, FILE_MAP_WRITE);
+    }
+
+    void map(DWORD protect, DWORD access) {
+        ULARGE_INTEGER map_size;
+        map_size.QuadPart = size;
+
+        mapping = ::CreateFileMappingA(file, nullptr, protect, map_size.HighPart, map_size.LowPart, nullptr);
+        if ( !mapping )
+            fail();
+
+        data = static_cast<uint8_t*>(::MapViewOfFile(mapping, access, 0, 0, 0));
+        if ( !data )
+            fail();
+    }
+
+    void sync() {
+        if ( data && !::FlushViewOfFile(data, 0) )
+            throw std::system_error(std::error_code(static_cast<int>(::GetLastError()), std::system_category()));
+    }
+
+    void fail() {
+        DWORD err = ::GetLastError();
+        release();
+        throw std::system_error(std::error_code(static_cast<int>(err), std::system_category()));
+    }
+
+    void release() {
+        if ( data )
+            ::UnmapViewOfFile(data);
+        if ( mapping )
+            ::CloseHandle(mapping);
+        if ( file != INVALID_HANDLE_VALUE )
+            ::CloseHandle(file);
+
+        data    = nullptr;
+        mapping = nullptr;
+        file    = INVALID_HANDLE_VALUE;
+    }
+
+    ~Impl() {
+        release();
+    }
+};
+#else
+struct MappedFile::Impl {
+    int      file     = -1;
+    uint8_t* data     = nullptr;
+    size_t   size     = 0;
+    bool     writable = false;
+
+    Impl(const std::string& path) {
+        file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if ( file < 0 )
+            fail();
+
+        struct stat info;
+        if ( ::fstat(file, &info) != 0 )
+            fail();
+
+        size = static_cast<size_t>(info.st_size);
+        if ( size == 0 )
+            return;
+
+        map(PROT_READ, MAP_SHARED);
+        ::madvise(data, size, MADV_SEQUENTIAL);
+    }
+
+    Impl(const std::string& path, size_t new_size): size(new_size), writable(true) {
+        file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if ( file < 0 )
+            fail();
+
+        if ( ::ftruncate(file, static_cast<off_t>(size)) != 0 )
+            fail();
+
+        if ( size == 0 )
+            return;
+
+        map(PROT_READ | PROT_WRITE, MAP_SHARED);
+    }
+
+    void map(int protect, int flags) {
+        void* mapped = ::mmap(nullptr, size, protect, flags, file, 0);
+        if ( mapped == MAP_FAILED )
+            fail();
+
+        data = static_cast<uint8_t*>(mapped);
+
+        // The mapping keeps its own reference to the file
+        ::close(file);
+        file = -1;
+    }
+
+    void sync() {
+        if ( data && ::msync(data, size, MS_ASYNC) != 0 )
+            throw std::system_error(std::error_code(errno, std::system_category()));
+    }
+
+    void fail() {
+        int err = errno;
+        release();
+        throw std::system_error(std::error_code(err, std::system_category()));
+    }
+
+    void release() {
+        if ( data )
+            ::munmap(data, size);
+        if ( file >= 0 )
+            ::close(file);
+
+        data = nullptr;
+        file = -1;
+    }
+
+    ~Impl() {
+        release();
+    }
+};
+#endif
+
+void MappedFile::ImplCleanup::operator()(Impl* ptr) const {
+    if ( ptr )
+        delete ptr;
+}
+
+/********************************/
+/* Implementation               */
+/********************************/
+MappedFile::MappedFile(const std::string& path) {
+    pimpl.reset(new Impl(path));
+}
+
+MappedFile::MappedFile(const std::string& path, size_t size) {
+    pimpl.reset(new Impl(path, size));
+}
+
+const uint8_t* MappedFile::data() const {
+    return pimpl->data;
+}
+
+uint8_t* MappedFile::writable_data() {
+    if ( !pimpl->writable )
+        throw std::logic_error("File is mapped read-only!");
+
+    return pimpl->data;
+}
+
+size_t MappedFile::size() const {
+    return pimpl->size;
+}
+
+void MappedFile::sync() {
+    pimpl->sync();
+}
+}
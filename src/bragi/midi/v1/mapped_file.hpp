@@ -0,0 +1,84 @@
+/**
+ * @file mapped_file.hpp
+ * @brief Memory mapping of files
+ */
+#ifndef _BRAGI_MIDI_V1_MAPPED_FILE_HPP_
+#define _BRAGI_MIDI_V1_MAPPED_FILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Maps a whole file into memory
+ *
+ * Existing files are mapped for reading, while new files are created at a fixed size and mapped for writing. The
+ * mapping is released when the object is destroyed. An empty file is represented by a @c nullptr data pointer and a
+ * size of @c 0.
+ */
+class MappedFile {
+    protected:
+        struct Impl;
+        struct ImplCleanup { void operator()(Impl* ptr) const; };
+
+        std::unique_ptr<Impl, ImplCleanup> pimpl;
+
+    public:
+        /// @brief Disable empty constructor
+        MappedFile() = delete;
+
+        /// @brief Disable copy constructor to enforce single ownership
+        MappedFile(const MappedFile&) = delete;
+
+        /// @brief Disable copy assignment to enforce single ownership
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /// @brief Unmaps the file
+        ~MappedFile() = default;
+
+        /**
+         * @brief Map a file
+         *
+         * @param [in] path Path of the file to map
+         *
+         * @throws std::system_error if the file could not be opened or mapped
+         */
+        explicit MappedFile(const std::string& path);
+
+        /**
+         * @brief Create a file of a fixed size and map it for writing
+         *
+         * An existing file is overwritten. The new file reads as zeroes.
+         *
+         * @param [in] path Path of the file to create
+         * @param [in] size Size of the file in bytes
+         *
+         * @throws std::system_error if the file could not be created or mapped
+         */
+        MappedFile(const std::string& path, size_t size);
+
+        /// @brief Start of the mapped bytes
+        const uint8_t* data() const;
+
+        /**
+         * @brief Start of the mapped bytes, for writing
+         *
+         * @throws std::logic_error if the file was mapped for reading
+         */
+        uint8_t* writable_data();
+
+        /**
+         * @brief Start writing modified pages back to the file, without waiting for them
+         *
+         * @throws std::system_error if the write back could not be scheduled
+         */
+        void sync();
+
+        /// @brief Number of mapped bytes
+        size_t size() const;
+};
+}
+
+#endif //_BRAGI_MIDI_V1_MAPPED_FILE_HPP_//
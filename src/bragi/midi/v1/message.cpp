@@ -1,6 +1,7 @@
 #include <bragi/midi/v1/message.hpp>
 
 #include <stdexcept>
+#include <utility>
 
 namespace bragi::midi::v1 {
 size_t message_size(uint8_t msg_type) {
@@ -62,7 +63,7 @@ Message Message::parse(std::basic_string<uint8_t> msg) {
 
     size_t msg_size = message_size(msg[0]);
 
-    if ( msg_size < msg.size() )
+    if ( msg_size > msg.size() )
         throw std::underflow_error("Missing data!");
 
     Message message;
@@ -72,12 +73,15 @@ Message Message::parse(std::basic_string<uint8_t> msg) {
 
     else  {
         bool found = false;
-        for ( size_t i = 0; i < msg.size(); i++ ) {
+        for ( size_t i = 1; i < msg.size(); i++ ) {
             if ( msg[i] == MessageType::end_of_system_exclusive ) {
                 found = true;
-                message.bytes = msg.substr(0, i);
+                message.bytes = msg.substr(0, i + 1);
                 break;
             }
+
+            if ( msg[i] & 0x80 )
+                break;
         }
         if ( !found )
             throw std::invalid_argument("Malformed system exclusive!");
@@ -90,12 +94,16 @@ std::basic_string<uint8_t> Message::serialize() const {
     return bytes;
 }
 
-// Message Message::system_exclusive(std::basic_string<uint8_t> data) {
-//     data.insert(0, MessageType::system_exclusive);
-//     data.push_back(MessageType::end_of_system_exclusive);
+Message Message::system_exclusive(std::basic_string<uint8_t> data) {
+    for ( uint8_t byte : data )
+        if ( byte & 0x80 )
+            throw std::range_error("Data byte too large!");
 
-//     return Message::parse(std::move(data));
-// }
+    data.insert(data.begin(), MessageType::system_exclusive);
+    data.push_back(MessageType::end_of_system_exclusive);
+
+    return Message::parse(std::move(data));
+}
 
 Message& Message::set_channel(uint8_t channel) {
     if ( channel > 15 )
@@ -239,8 +239,12 @@ class Message {
         /**
          * @brief Parse a MIDI message
          *
+         * Bytes following the message are ignored. A system exclusive message is kept up to and including its
+         * @b end_of_system_exclusive byte.
+         *
          * @throws std::domain_error if the message type is invalid
          * @throws std::underflow_error if the message is missing data
+         * @throws std::invalid_argument if a system exclusive message is not terminated
          */
         static Message parse(std::basic_string<uint8_t> msg);
 
@@ -251,10 +255,14 @@ class Message {
          */
         std::basic_string<uint8_t> serialize() const;
 
-        // /**
-        //  * @brief Create a system exclusive message
-        //  */
-        // static Message system_exclusive(std::basic_string<uint8_t> data);
+        /**
+         * @brief Create a system exclusive message
+         *
+         * @param [in] data Bytes between the @b system_exclusive and @b end_of_system_exclusive bytes
+         *
+         * @throws std::range_error if any byte is greater than 0x7F
+         */
+        static Message system_exclusive(std::basic_string<uint8_t> data);
 
         // /**
         //  * @brief Get data from system exclusive message
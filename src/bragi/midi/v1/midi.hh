@@ -1,4 +1,24 @@
 #include <bragi/midi/v1/message.hpp>
 #include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/output_backend.hpp>
 #include <bragi/midi/v1/constants.hpp>
 #include <bragi/midi/v1/note.hpp>
+#include <bragi/midi/v1/smf.hpp>
+#include <bragi/midi/v1/corpus.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+#include <bragi/midi/v1/realtime.hpp>
+#include <bragi/midi/v1/coalescer.hpp>
+#include <bragi/midi/v1/pacer.hpp>
+#include <bragi/midi/v1/journal.hpp>
+#include <bragi/midi/v1/output_group.hpp>
+#include <bragi/midi/v1/rtp_midi.hpp>
+#include <bragi/midi/v1/sequencer.hpp>
+#include <bragi/midi/v1/parameter_encoder.hpp>
+#include <bragi/midi/v1/device_registry.hpp>
+#include <bragi/midi/v1/pattern_engine.hpp>
+#include <bragi/midi/v1/voice_allocator.hpp>
+#include <bragi/midi/v1/note_span.hpp>
+
+#ifdef __linux__
+    #include <bragi/midi/v1/shm.hpp>
+#endif
@@ -0,0 +1,332 @@
+#include <bragi/midi/v1/note_span.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace bragi::midi::v1 {
+/********************************/
+/* NoteSpanBuilder              */
+/********************************/
+NoteSpanBuilder::NoteSpanBuilder() {
+    std::fill(std::begin(heads), std::end(heads), none);
+    std::fill(std::begin(tails), std::end(tails), none);
+}
+
+bool NoteSpanBuilder::add(int64_t time, const ShortMessage& msg, NoteSpan& span) {
+    uint8_t type = msg.status() & 0xF0;
+    if ( type != MessageType::note_on && type != MessageType::note_off )
+        return false;
+
+    uint8_t  channel = msg.status() & 0x0F;
+    uint8_t  pitch   = msg.data1();
+    uint32_t key     = channel * 128 + pitch;
+
+    if ( type == MessageType::note_on && msg.data2() != 0 ) {
+        uint32_t index;
+        if ( free_head != none ) {
+            index     = free_head;
+            free_head = pool[index].next;
+        } else {
+            index = static_cast<uint32_t>(pool.size());
+            pool.push_back(Held());
+        }
+
+        pool[index] = {time, none, msg.data2()};
+        if ( tails[key] != none )
+            pool[tails[key]].next = index;
+        else
+            heads[key] = index;
+        tails[key] = index;
+
+        held_count++;
+        return false;
+    }
+
+    uint32_t index = heads[key];
+    if ( index == none ) {
+        unmatched_count++;
+        return false;
+    }
+
+    heads[key] = pool[index].next;
+    if ( heads[key] == none )
+        tails[key] = none;
+
+    span.start    = pool[index].start;
+    span.end      = time;
+    span.pitch    = pitch;
+    span.velocity = pool[index].velocity;
+    span.channel  = channel;
+
+    pool[index].next = free_head;
+    free_head        = index;
+    held_count--;
+    return true;
+}
+
+void NoteSpanBuilder::finish(int64_t time, std::vector<NoteSpan>& spans) {
+    NoteSpan span;
+    for ( uint32_t key = 0; key < 16 * 128; key++ )
+        while ( heads[key] != none )
+            if ( add(time, ShortMessage(MessageType::note_off | key / 128, key % 128, 0), span) )
+                spans.push_back(span);
+}
+
+size_t NoteSpanBuilder::held() const {
+    return held_count;
+}
+
+size_t NoteSpanBuilder::unmatched() const {
+    return unmatched_count;
+}
+
+/********************************/
+/* NoteSpanIndex                */
+/********************************/
+uint32_t NoteSpanIndex::make_node(Channel& channel, int64_t center) {
+    uint32_t index;
+    if ( !channel.free_nodes.empty() ) {
+        index = channel.free_nodes.back();
+        channel.free_nodes.pop_back();
+    } else {
+        index = static_cast<uint32_t>(channel.nodes.size());
+        channel.nodes.emplace_back();
+    }
+
+    Node& node  = channel.nodes[index];
+    node.center = center;
+    node.left   = none;
+    node.right  = none;
+    node.size   = 0;
+    node.by_start.clear();
+    node.by_end.clear();
+    return index;
+}
+
+uint32_t NoteSpanIndex::build(Channel& channel, NoteSpan* first, NoteSpan* last) {
+    if ( first == last )
+        return none;
+
+    // The median endpoint leaves fewer than half the spans wholly on either side of it
+    size_t                count     = static_cast<size_t>(last - first);
+    std::vector<int64_t>& endpoints = channel.endpoints;
+    endpoints.clear();
+    for ( const NoteSpan* span = first; span != last; span++ ) {
+        endpoints.push_back(span->start);
+        endpoints.push_back(span->end);
+    }
+    std::nth_element(endpoints.begin(), endpoints.begin() + (count - 1), endpoints.end());
+    int64_t center = endpoints[count - 1];
+
+    NoteSpan* middle = std::partition(first, last, [&](const NoteSpan& span) { return span.end < center; });
+    NoteSpan* right  = std::partition(middle, last, [&](const NoteSpan& span) { return span.start <= center; });
+
+    uint32_t index = make_node(channel, center);
+    {
+        Node& node = channel.nodes[index];
+        node.size  = count;
+        node.by_start.assign(middle, right);
+        node.by_end.assign(middle, right);
+        std::sort(node.by_start.begin(), node.by_start.end(), [](const NoteSpan& a, const NoteSpan& b) {
+            return a.start < b.start;
+        });
+        std::sort(node.by_end.begin(), node.by_end.end(), [](const NoteSpan& a, const NoteSpan& b) {
+            return a.end < b.end;
+        });
+    }
+
+    // Building the children may move the nodes
+    uint32_t left_index  = build(channel, first, middle);
+    uint32_t right_index = build(channel, right, last);
+    channel.nodes[index].left  = left_index;
+    channel.nodes[index].right = right_index;
+    return index;
+}
+
+uint32_t NoteSpanIndex::rebuild(Channel& channel, uint32_t root) {
+    std::vector<NoteSpan>& spans = channel.rebuilt;
+    std::vector<uint32_t>& stack = channel.path;
+    spans.clear();
+    stack.assign(1, root);
+
+    while ( !stack.empty() ) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        if ( index == none )
+            continue;
+
+        const Node& node = channel.nodes[index];
+        spans.insert(spans.end(), node.by_start.begin(), node.by_start.end());
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+        channel.free_nodes.push_back(index);
+    }
+
+    return build(channel, spans.data(), spans.data() + spans.size());
+}
+
+void NoteSpanIndex::add(Channel& channel, const NoteSpan& span) {
+    // A note of no length never sounds, so no query looks for it in the tree
+    if ( span.end <= span.start )
+        return;
+
+    channel.path.clear();
+    uint32_t index = channel.root;
+    bool     held  = false;
+
+    while ( index != none ) {
+        Node& node = channel.nodes[index];
+        channel.path.push_back(index);
+        node.size++;
+
+        if ( span.start <= node.center && node.center <= span.end ) {
+            auto by_start = std::upper_bound(node.by_start.begin(), node.by_start.end(), span,
+                                             [](const NoteSpan& a, const NoteSpan& b) { return a.start < b.start; });
+            node.by_start.insert(by_start, span);
+
+            auto by_end = std::upper_bound(node.by_end.begin(), node.by_end.end(), span,
+                                           [](const NoteSpan& a, const NoteSpan& b) { return a.end < b.end; });
+            node.by_end.insert(by_end, span);
+
+            held = true;
+            break;
+        }
+
+        index = span.end < node.center ? node.left : node.right;
+    }
+
+    if ( !held ) {
+        uint32_t leaf = make_node(channel, span.start);
+        Node&    node = channel.nodes[leaf];
+        node.size     = 1;
+        node.by_start.push_back(span);
+        node.by_end.push_back(span);
+
+        if ( channel.path.empty() ) {
+            channel.root = leaf;
+            return;
+        }
+
+        Node& parent = channel.nodes[channel.path.back()];
+        (span.end < parent.center ? parent.left : parent.right) = leaf;
+    }
+
+    // Rebuild the highest subtree with more than 3/4 of its spans on one side
+    auto size = [&](uint32_t child) { return child == none ? size_t(0) : channel.nodes[child].size; };
+
+    for ( size_t i = 0; i < channel.path.size(); i++ ) {
+        const Node& node = channel.nodes[channel.path[i]];
+        if ( std::max(size(node.left), size(node.right)) * 4 <= node.size * 3 )
+            continue;
+
+        // Rebuilding uses the path and may move the nodes, so the parent is looked up first and linked after
+        uint32_t parent  = i == 0 ? none : channel.path[i - 1];
+        bool     left    = parent != none && channel.nodes[parent].left == channel.path[i];
+        uint32_t subtree = rebuild(channel, channel.path[i]);
+
+        if ( parent == none )
+            channel.root = subtree;
+        else if ( left )
+            channel.nodes[parent].left = subtree;
+        else
+            channel.nodes[parent].right = subtree;
+        return;
+    }
+}
+
+void NoteSpanIndex::merge(Channel& channel) {
+    if ( channel.pending.empty() )
+        return;
+
+    auto by_start = [](const NoteSpan& a, const NoteSpan& b) { return a.start < b.start; };
+    if ( !std::is_sorted(channel.pending.begin(), channel.pending.end(), by_start) )
+        std::stable_sort(channel.pending.begin(), channel.pending.end(), by_start);
+
+    for ( const NoteSpan& span : channel.pending )
+        add(channel, span);
+
+    // Only the spans from the first one starting after the earliest new one move
+    size_t middle = channel.spans.size();
+    size_t first  = std::upper_bound(channel.spans.begin(), channel.spans.end(), channel.pending.front(), by_start)
+                  - channel.spans.begin();
+
+    channel.spans.insert(channel.spans.end(), channel.pending.begin(), channel.pending.end());
+    std::inplace_merge(channel.spans.begin() + first, channel.spans.begin() + middle, channel.spans.end(), by_start);
+    channel.pending.clear();
+}
+
+void NoteSpanIndex::insert(const NoteSpan& span) {
+    if ( span.channel > 15 )
+        throw std::range_error("Channel must be at most 15!");
+
+    channels[span.channel].pending.push_back(span);
+    total++;
+}
+
+void NoteSpanIndex::record(int64_t time, const ShortMessage& msg) {
+    NoteSpan span;
+    if ( builder.add(time, msg, span) )
+        insert(span);
+}
+
+void NoteSpanIndex::finish(int64_t time) {
+    std::vector<NoteSpan> spans;
+    builder.finish(time, spans);
+
+    for ( const NoteSpan& span : spans )
+        insert(span);
+}
+
+size_t NoteSpanIndex::query(uint8_t channel, int64_t from, int64_t to, std::vector<NoteSpan>& result) {
+    if ( channel > 15 )
+        throw std::range_error("Channel must be at most 15!");
+
+    Channel& found = channels[channel];
+    merge(found);
+
+    if ( found.spans.empty() || from >= to )
+        return 0;
+
+    size_t before = result.size();
+
+    // Notes started earlier and still sounding at @b from, on the path of @b from down the tree. Every span of a node
+    // contains its center, so before the center only the start decides, and after it only the end
+    for ( uint32_t index = found.root; index != none; ) {
+        const Node& node = found.nodes[index];
+
+        if ( from < node.center ) {
+            for ( size_t i = 0; i < node.by_start.size() && node.by_start[i].start < from; i++ )
+                result.push_back(node.by_start[i]);
+            index = node.left;
+        } else {
+            // Spans starting at @b from, which can only be held where it is the center, are found with the rest
+            // starting within the range
+            for ( size_t i = node.by_end.size(); i > 0 && node.by_end[i - 1].end > from; i-- )
+                if ( node.by_end[i - 1].start < from )
+                    result.push_back(node.by_end[i - 1]);
+            index = node.right;
+        }
+    }
+
+    // Notes starting within the range
+    auto   by_start = [](const NoteSpan& span, int64_t time) { return span.start < time; };
+    size_t first    = std::lower_bound(found.spans.begin(), found.spans.end(), from, by_start) - found.spans.begin();
+    for ( size_t i = first; i < found.spans.size() && found.spans[i].start < to; i++ )
+        if ( found.spans[i].end > from )
+            result.push_back(found.spans[i]);
+
+    return result.size() - before;
+}
+
+size_t NoteSpanIndex::size() const {
+    return total;
+}
+
+void NoteSpanIndex::clear() {
+    for ( Channel& channel : channels )
+        channel = Channel();
+
+    builder = NoteSpanBuilder();
+    total   = 0;
+}
+}
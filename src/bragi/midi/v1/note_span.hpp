@@ -0,0 +1,184 @@
+/**
+ * @file note_span.hpp
+ * @brief Notes as spans of time, and finding those which sound between two points in time
+ */
+#ifndef _BRAGI_MIDI_V1_NOTE_SPAN_HPP_
+#define _BRAGI_MIDI_V1_NOTE_SPAN_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <bragi/midi/v1/short_message.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief A note from its NOTE ON up to its NOTE OFF
+ *
+ * Times are in whatever unit the messages were timestamped with. The note sounds from @b start up to, but not
+ * including, @b end.
+ */
+struct NoteSpan {
+    int64_t start    = 0;
+    int64_t end      = 0;
+    uint8_t pitch    = 0;
+    uint8_t velocity = 0;
+    uint8_t channel  = 0;
+};
+
+/**
+ * @brief Pairs NOTE ON with NOTE OFF messages in a single pass
+ *
+ * A NOTE ON with a velocity of @c 0 counts as a NOTE OFF. When the same pitch is started several times on a channel
+ * before being ended, each NOTE OFF ends the earliest of those notes still sounding. A NOTE OFF with no note to end is
+ * ignored and counted by unmatched().
+ *
+ * Notes held are kept in intrusive lists in a pool, so adding a message never allocates once the pool has grown to
+ * the most notes held at once.
+ */
+class NoteSpanBuilder {
+    protected:
+        constexpr static uint32_t none = 0xFFFFFFFF;
+
+        struct Held {
+            int64_t  start;
+            uint32_t next;
+            uint8_t  velocity;
+        };
+
+        std::vector<Held> pool;
+        uint32_t          free_head = none;
+        uint32_t          heads[16 * 128];
+        uint32_t          tails[16 * 128];
+        size_t            held_count      = 0;
+        size_t            unmatched_count = 0;
+
+    public:
+        NoteSpanBuilder();
+
+        /**
+         * @brief Add the next message, in order of time
+         *
+         * @param [in] time Time of the message
+         * @param [in] msg Message, anything but NOTE ON and NOTE OFF is ignored
+         * @param [out] span The note ended by @b msg, only set if returning true
+         *
+         * @returns true if @b msg ended a note
+         */
+        bool add(int64_t time, const ShortMessage& msg, NoteSpan& span);
+
+        /**
+         * @brief End every note still held
+         *
+         * @param [in] time Time at which the notes end
+         * @param [out] spans Vector the ended notes are appended to
+         */
+        void finish(int64_t time, std::vector<NoteSpan>& spans);
+
+        /// @brief Number of notes started but not yet ended
+        size_t held() const;
+
+        /// @brief Number of NOTE OFF messages which ended no note
+        size_t unmatched() const;
+};
+
+/**
+ * @brief Finds the notes of a channel sounding between two points in time in O(log n + k)
+ *
+ * A query is answered in two parts. Notes starting within the range are found by binary search in an array of the
+ * spans of the channel sorted by start time, then read one after the other. Notes which started earlier and still
+ * sound at its start are found in a centered interval tree. Each node of the tree holds the spans containing its
+ * center, once sorted by start and once by end, so the query follows a single path from the root and reads from each
+ * node only the spans it returns.
+ *
+ * New spans are collected separately and added by the next query. Since recorded spans arrive roughly in order of
+ * start time, they usually join the array at its end. The tree only rebuilds a subtree once one side of it holds more
+ * than 3/4 of its spans, which keeps it O(log n) deep at an amortized O(log^2 n) per span added.
+ *
+ * The index is not safe to use from several threads at once, as query() may add spans.
+ *
+ * @code
+ * NoteSpanIndex index;
+ * for ( const JournalEntry& entry : entries )
+ *     index.record(entry.time, entry.msg);
+ *
+ * std::vector<NoteSpan> sounding;
+ * index.query(0, from, to, sounding);
+ * @endcode
+ */
+class NoteSpanIndex {
+    protected:
+        constexpr static uint32_t none = 0xFFFFFFFF;
+
+        struct Node {
+            int64_t               center;
+            uint32_t              left  = none;
+            uint32_t              right = none;
+            size_t                size  = 0;    // Spans in the subtree
+            std::vector<NoteSpan> by_start;     // Spans containing the center, sorted by start
+            std::vector<NoteSpan> by_end;       // The same spans, sorted by end
+        };
+
+        struct Channel {
+            std::vector<NoteSpan> spans;        // Sorted by start
+            std::vector<NoteSpan> pending;      // Inserted since the last merge
+            std::vector<Node>     nodes;
+            std::vector<uint32_t> free_nodes;
+            uint32_t              root = none;
+            std::vector<uint32_t> path;         // Nodes passed while adding a span
+            std::vector<NoteSpan> rebuilt;      // Spans of the subtree being rebuilt
+            std::vector<int64_t>  endpoints;    // Of the spans of the node being built
+        };
+
+        Channel         channels[16];
+        NoteSpanBuilder builder;
+        size_t          total = 0;
+
+        static uint32_t make_node(Channel& channel, int64_t center);
+        static uint32_t build(Channel& channel, NoteSpan* first, NoteSpan* last);
+        static uint32_t rebuild(Channel& channel, uint32_t root);
+        static void add(Channel& channel, const NoteSpan& span);
+        static void merge(Channel& channel);
+
+    public:
+        /**
+         * @brief Add a note
+         *
+         * @throws std::range_error if the channel of @b span is greater than 15
+         */
+        void insert(const NoteSpan& span);
+
+        /**
+         * @brief Add the next recorded message, in order of time
+         *
+         * Notes are added once ended, see NoteSpanBuilder.
+         */
+        void record(int64_t time, const ShortMessage& msg);
+
+        /// @brief End every recorded note still held, eg. at the end of a recording
+        void finish(int64_t time);
+
+        /**
+         * @brief Find the notes sounding at any point from @b from up to @b to
+         *
+         * @param [in] channel Channel of the notes
+         * @param [in] from Start of the time range
+         * @param [in] to End of the time range, not included
+         * @param [out] result Vector the notes are appended to - those already sounding at @b from in no particular
+         *             order, then those starting later in order of start time
+         *
+         * @returns Number of notes found, @c 0 if @b to is not after @b from
+         *
+         * @throws std::range_error if @b channel is greater than 15
+         */
+        size_t query(uint8_t channel, int64_t from, int64_t to, std::vector<NoteSpan>& result);
+
+        /// @brief Number of notes, not counting recorded notes still held
+        size_t size() const;
+
+        /// @brief Remove every note, and forget recorded notes still held
+        void clear();
+};
+}
+
+#endif //_BRAGI_MIDI_V1_NOTE_SPAN_HPP_//
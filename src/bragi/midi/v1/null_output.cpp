@@ -0,0 +1,15 @@
+#include <bragi/midi/v1/output_backend.hpp>
+
+#include <stdexcept>
+
+// Platforms without a system MIDI implementation have no devices to offer, custom backends can still be used
+
+namespace bragi::midi::v1 {
+unsigned int system_output_count() {
+    return 0;
+}
+
+std::unique_ptr<OutputBackend> system_output_backend(unsigned int) {
+    throw std::domain_error("No system MIDI outputs on this platform!");
+}
+}
@@ -1,177 +1,111 @@
-#ifndef _WIN32
-    #error "No implementation for non-windows machines added!"
-#endif
-
-#include <Windows.h>
-#include <mmeapi.h>
-// #include <mmsystem.h>
-// winmm.lib
-
 #include <stdexcept>
-#include <system_error>
+#include <utility>
 
 #include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/device_registry.hpp>
 
 namespace bragi::midi::v1 {
-void throw_sys_err(int err_code) {
-    throw std::system_error(std::error_code(err_code, std::system_category()));
-}
-
-/********************************/
-/* Impl                         */
-/********************************/
-struct Output::Impl {
-    UINT        device;
-    MIDIOUTCAPS details = {0};
-    HMIDIOUT    connection = nullptr;
-
-    Impl(UINT dev): device(dev) {
-        int err = ::midiOutGetDevCaps(dev, &details, sizeof(details));
-
-        if ( err != MMSYSERR_NOERROR )
-            throw_sys_err(err);
-    }
-
-    void disconnect() {
-        if ( connection ) {
-            ::midiOutClose(connection);
-            connection = nullptr;
-        }
-    }
-
-    void connect() {
-        if ( connection )
-            throw std::logic_error("Already connected!");
-
-        int err = ::midiOutOpen(&connection, device, 0, 0, CALLBACK_NULL);
-
-        if ( err != MMSYSERR_NOERROR )
-            throw_sys_err(err);
-    }
-
-    void send_short(uint8_t msg_type, uint8_t b1, uint8_t b2) {
-        if ( !connection )
-            throw std::logic_error("Not connected!");
-
-        DWORD msg = msg_type | b1 << 8 | b2 << 16;
-        int err = ::midiOutShortMsg(connection, msg);
-        if ( err != MMSYSERR_NOERROR )
-            throw_sys_err(err);
-    }
-
-    ~Impl() {
-        disconnect();
-    }
-};
-
-void Output::ImplCleanup::operator()(Impl* ptr) const {
-    if ( ptr )
-        delete ptr;
-}
-
 /********************************/
 /* Implementation               */
 /********************************/
-Output::Output(unsigned int out_no) {
-    pimpl.reset(new Impl(out_no));
+Output::Output(unsigned int out_no): Output(DeviceRegistry::instance().open(out_no)) {}
+
+Output::Output(std::unique_ptr<OutputBackend> backend): backend(std::move(backend)) {
+    if ( !this->backend )
+        throw std::invalid_argument("No backend!");
 }
 
 unsigned int Output::output_count() {
-    return ::midiOutGetNumDevs();
+    return DeviceRegistry::instance().count();
 }
 
 void Output::connect() {
     std::lock_guard<std::mutex> lock(mutex);
-    pimpl->connect();
+    backend->connect();
 }
 
 void Output::disconnect() {
     std::lock_guard<std::mutex> lock(mutex);
-    pimpl->disconnect();
+    backend->disconnect();
 }
 
 void Output::send_msg(const Message& msg) {
     std::lock_guard<std::mutex> lock(mutex);
     msg.validate();
 
-    switch( msg.size() ) {
-        case 1:
-            return pimpl->send_short(msg.message_type_raw(), 0, 0);
-
-        case 2:
-            return pimpl->send_short(msg.message_type_raw(), msg.get_first_byte(), 0);
+    if ( msg.message_type() == MessageType::system_exclusive ) {
+        std::basic_string<uint8_t> bytes = msg.serialize();
+        backend->send_long(bytes.data(), bytes.size());
 
-        case 3:
-            return pimpl->send_short(msg.message_type_raw(), msg.get_first_byte(), msg.get_second_byte());
-
-        default:
-            // send_long(...);
-            throw std::runtime_error("Not implemented for size greater than 3 yet!");
+        if ( monitor )
+            monitor->sent(msg);
+        return;
     }
-}
 
-bool Output::physical_device() const {
-    return pimpl->details.wTechnology == MOD_MIDIPORT;
-}
-
-uint16_t Output::manufacturer_id() const {
-    return pimpl->details.wMid;
-}
-
-uint16_t Output::product_id() const {
-    return pimpl->details.wPid;
-}
+    ShortMessage short_msg = ShortMessage::from(msg);
+    if ( !short_msg.valid() )
+        throw std::domain_error("Malformed message!");
 
-std::string Output::product_name() const {
-    // if ( pimpl->details.szPname )
-        // return {pimpl->details.szPname, pimpl->details.szPname + wcslen(pimpl->details.szPname)};
-    return {pimpl->details.szPname, pimpl->details.szPname + strlen(pimpl->details.szPname)};
+    backend->send_short(short_msg.status(), short_msg.data1(), short_msg.data2());
 
-    return "";
-}
+    if ( monitor )
+        monitor->sent(short_msg);
 }
 
+void Output::send_msg(const ShortMessage& msg) {
+    if ( !msg.valid() )
+        throw std::invalid_argument("Invalid short message!");
 
+    std::lock_guard<std::mutex> lock(mutex);
+    backend->send_short(msg.status(), msg.data1(), msg.data2());
 
+    if ( monitor )
+        monitor->sent(msg);
+}
 
-// struct _OutputImpl {
-//     HMIDIOUT    target = nullptr;
-//     UINT        port;
-//     MIDIOUTCAPS details = {0};
-//     bool        connected = false;
-// };
+void Output::send_batch(const ShortMessage* msgs, size_t count) {
+    for ( size_t i = 0; i < count; i++ )
+        if ( !msgs[i].valid() )
+            throw std::invalid_argument("Invalid short message!");
 
-// static inline _OutputImpl* get_output(void* pimpl) {
-//     if ( pimpl == nullptr )
-//         throw std::runtime_error("Incomplete Output!");
+    std::lock_guard<std::mutex> lock(mutex);
+    for ( size_t i = 0; i < count; i++ ) {
+        backend->send_short(msgs[i].status(), msgs[i].data1(), msgs[i].data2());
 
-//     _OutputImpl* impl = reinterpret_cast<_OutputImpl*>(pimpl);
+        if ( monitor )
+            monitor->sent(msgs[i]);
+    }
+}
 
-//     if ( impl->target == nullptr )
-//         throw std::runtime_error("Malformed Output!");
+void Output::send_raw(const uint8_t* data, size_t size) {
+    if ( size == 0 )
+        return;
 
-//     return impl;
-// }
+    std::lock_guard<std::mutex> lock(mutex);
+    backend->send_long(data, size);
 
-// static void cleanup(void* pimpl) {
-//     if ( !pimpl )
-//         return;
+    if ( monitor )
+        monitor->sent_raw(data, size);
+}
 
-//     try {
-//         _OutputImpl* impl = get_output(pimpl);
+void Output::set_monitor(std::shared_ptr<OutputMonitor> monitor) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->monitor = std::move(monitor);
+}
 
-//         if ( impl->connected ) {
-//             ::midiOutClose(impl->target);
-//         }
+bool Output::physical_device() const {
+    return backend->physical_device();
+}
 
+uint16_t Output::manufacturer_id() const {
+    return backend->manufacturer_id();
+}
 
-//     } catch ( std::runtime_error ) {
-//         return;
-//     }
-// }
+uint16_t Output::product_id() const {
+    return backend->product_id();
+}
 
-// namespace bragi::midi {
-//     Output::~Output() {
-//         cleanup(pimpl);
-//     }
-// }
+std::string Output::product_name() const {
+    return backend->product_name();
+}
+}
@@ -6,18 +6,43 @@
 #define _BRAGI_MIDI_V1_OUTPUT_HPP_
 
 #include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output_backend.hpp>
+#include <bragi/midi/v1/short_message.hpp>
 
 #include <memory>
 #include <mutex>
 
 namespace bragi::midi::v1 {
+/**
+ * @brief Receives a copy of every message an Output sends
+ *
+ * The callbacks run on the sending thread while the Output is locked, so they must be quick and must not call back
+ * into the Output.
+ */
+class OutputMonitor {
+public:
+    virtual ~OutputMonitor() = default;
+
+    /// @brief Called after a short message was sent
+    virtual void sent(const ShortMessage& msg) noexcept = 0;
+
+    /// @brief Called after a system exclusive message was sent
+    virtual void sent(const Message& msg) noexcept = 0;
+
+    /**
+     * @brief Called after bytes were sent through Output::send_raw()
+     *
+     * The bytes may be any part of a stream of messages, such as one slice of a system exclusive message. Ignored
+     * unless overridden.
+     */
+    virtual void sent_raw(const uint8_t* /* data */, size_t /* size */) noexcept {}
+};
+
 class Output {
 protected:
-    struct Impl;
-    struct ImplCleanup { void operator()(Impl* ptr) const; };
-
-    std::unique_ptr<Impl, ImplCleanup> pimpl;
+    std::unique_ptr<OutputBackend>     backend;
     std::mutex                         mutex;
+    std::shared_ptr<OutputMonitor>     monitor;
 
 public:
     /// @brief Disable empty constructor
@@ -35,6 +60,9 @@ public:
     /**
      * @brief Select an available output
      *
+     * The device details are taken from DeviceRegistry::instance(), which only asks the device the first time. The
+     * connection is not pooled, use DeviceRegistry::acquire() to share one connection between users.
+     *
      * @param [in] out_no Number of the port for the output
      *
      * @throws std::domain_error if @b out_no is invalid or does not exist
@@ -42,8 +70,19 @@ public:
      */
     Output(unsigned int out_no);
 
+    /**
+     * @brief Send through a custom transport instead of a system device
+     *
+     * @param [in] backend Transport to send through
+     *
+     * @throws std::invalid_argument if @b backend is empty
+     */
+    explicit Output(std::unique_ptr<OutputBackend> backend);
+
     /**
      * @brief Retrieve count of existing devices
+     *
+     * Cached by DeviceRegistry::instance(), so a device plugged in shows up after its recheck interval.
      */
     static unsigned int output_count();
 
@@ -70,12 +109,63 @@ public:
      * @param [in] msg The message to send
      *
      * @throws Whatever is thrown by Message::validate()
+     * @throws std::domain_error if a non system exclusive message is longer than 3 bytes or malformed
      * @throws std::runtime_error if not a valid output
      * @throws std::logic_error if not connected
      * @throws std::system_error if failed to send
      */
     void send_msg(const Message& msg);
 
+    /**
+     * @brief Send a short MIDI message to the output target without building a Message
+     *
+     * @param [in] msg The message to send
+     *
+     * @throws std::invalid_argument if @b msg is invalid
+     * @throws std::runtime_error if not a valid output
+     * @throws std::logic_error if not connected
+     * @throws std::system_error if failed to send
+     */
+    void send_msg(const ShortMessage& msg);
+
+    /**
+     * @brief Send several short MIDI messages, taking the lock once
+     *
+     * All messages are checked before any is sent, and no other thread's messages are sent in between them.
+     *
+     * @param [in] msgs Messages to send
+     * @param [in] count Number of messages
+     *
+     * @throws std::invalid_argument if any message is invalid
+     * @throws std::runtime_error if not a valid output
+     * @throws std::logic_error if not connected
+     * @throws std::system_error if failed to send
+     */
+    void send_batch(const ShortMessage* msgs, size_t count);
+
+    /**
+     * @brief Send bytes to the output target as they are
+     *
+     * Intended for parts of a system exclusive message. No checks are made on the content.
+     *
+     * @param [in] data Bytes to send
+     * @param [in] size Number of bytes
+     *
+     * @throws std::runtime_error if not a valid output
+     * @throws std::logic_error if not connected
+     * @throws std::system_error if failed to send
+     */
+    void send_raw(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Set a monitor to observe sent messages, replacing any previous one
+     *
+     * Bytes sent through send_raw() are reported as they are to OutputMonitor::sent_raw().
+     *
+     * @param [in] monitor Monitor to call, or an empty pointer to remove it
+     */
+    void set_monitor(std::shared_ptr<OutputMonitor> monitor);
+
     /**
      * @brief Check if output is a port to a physical MIDI
      *
@@ -0,0 +1,84 @@
+/**
+ * @file output_backend.hpp
+ * @brief Interface for the transports an Output sends through
+ */
+#ifndef _BRAGI_MIDI_V1_OUTPUT_BACKEND_HPP_
+#define _BRAGI_MIDI_V1_OUTPUT_BACKEND_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief A transport for MIDI messages, such as a system MIDI port
+ *
+ * Output takes care of locking, validation and monitoring, so a backend is only ever called by one thread at a time
+ * and is only passed well-formed messages.
+ */
+class OutputBackend {
+    public:
+        virtual ~OutputBackend() = default;
+
+        /**
+         * @brief Open the transport
+         *
+         * @throws std::logic_error if already connected
+         * @throws std::system_error if failed to connect
+         */
+        virtual void connect() = 0;
+
+        /// @brief Close the transport, does nothing if not connected
+        virtual void disconnect() = 0;
+
+        /**
+         * @brief Send a message of at most 3 bytes, unused data bytes are @c 0
+         *
+         * @throws std::logic_error if not connected
+         * @throws std::system_error if failed to send
+         */
+        virtual void send_short(uint8_t status, uint8_t data1, uint8_t data2) = 0;
+
+        /**
+         * @brief Send bytes as they are, eg. a system exclusive message or part of one
+         *
+         * @throws std::logic_error if not connected
+         * @throws std::system_error if failed to send
+         */
+        virtual void send_long(const uint8_t* data, size_t size) = 0;
+
+        /// @brief Check if the transport is a port to a physical MIDI device
+        virtual bool physical_device() const = 0;
+
+        /// @brief Get the manufacturer ID, @c 0 if not applicable
+        virtual uint16_t manufacturer_id() const = 0;
+
+        /// @brief Get the product ID, @c 0 if not applicable
+        virtual uint16_t product_id() const = 0;
+
+        /// @brief Get a human readable name for the transport
+        virtual std::string product_name() const = 0;
+};
+
+/**
+ * @brief Retrieve count of MIDI output devices known to the system MIDI API
+ *
+ * @note Always @c 0 on platforms without a system MIDI implementation
+ */
+unsigned int system_output_count();
+
+/**
+ * @brief Create a backend for a system MIDI output device
+ *
+ * The capabilities of the device are read when first asked for, so the capability getters of the backend throw
+ * std::system_error if they cannot be read.
+ *
+ * @param [in] out_no Number of the port for the output
+ *
+ * @throws std::domain_error if @b out_no is invalid or does not exist
+ */
+std::unique_ptr<OutputBackend> system_output_backend(unsigned int out_no);
+}
+
+#endif //_BRAGI_MIDI_V1_OUTPUT_BACKEND_HPP_//
@@ -0,0 +1,193 @@
+#include <bragi/midi/v1/output_group.hpp>
+
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace bragi::midi::v1 {
+OutputGroup::OutputGroup(size_t queue_capacity, std::chrono::milliseconds stall_timeout):
+        queue_capacity(queue_capacity),
+        stall_timeout(stall_timeout)
+    {
+        if ( queue_capacity == 0 )
+            throw std::invalid_argument("Queue capacity must be positive!");
+    }
+
+OutputGroup::~OutputGroup() {
+    for ( std::shared_ptr<Device>& device : devices ) {
+        bool isolated;
+        {
+            std::unique_lock<std::mutex> lock(device->mutex);
+            device->running = false;
+            device->wake.notify_one();
+
+            // Same rule as enqueue(), so a driver wedged since the last message cannot hang the destructor
+            while ( !device->finished && !device->isolated ) {
+                clock::time_point oldest = device->busy ? device->busy_since
+                                         : device->queue.empty() ? clock::now()
+                                         : device->queue.front().enqueued;
+
+                if ( clock::now() - oldest > stall_timeout ) {
+                    device->isolated = true;
+                    device->dropped += device->queue.size();
+                    device->queue.clear();
+                    break;
+                }
+
+                device->finished_wake.wait_until(lock, oldest + stall_timeout);
+            }
+            isolated = device->isolated;
+        }
+
+        // The worker holds its own reference to the device, so detaching is safe
+        if ( isolated )
+            device->worker.detach();
+        else
+            device->worker.join();
+    }
+}
+
+void OutputGroup::run(std::shared_ptr<Device> device) {
+    std::unique_lock<std::mutex> lock(device->mutex);
+
+    while ( true ) {
+        device->wake.wait(lock, [&] { return !device->running || !device->queue.empty(); });
+        if ( device->queue.empty() ) {
+            device->finished = true;
+            device->finished_wake.notify_one();
+            return;
+        }
+
+        Queued item = std::move(device->queue.front());
+        device->queue.pop_front();
+        device->busy       = true;
+        device->busy_since = item.enqueued;
+
+        lock.unlock();
+        bool ok = true;
+        try {
+            device->output->send_msg(*item.payload);
+        } catch ( std::exception& ) {
+            ok = false;
+        }
+        item.payload.reset();
+        lock.lock();
+
+        device->busy = false;
+        if ( ok )
+            device->sent++;
+        else
+            device->failed++;
+    }
+}
+
+OutputGroup::Payload OutputGroup::share(const Message& msg) const {
+    msg.validate();
+    return std::make_shared<const Message>(msg);
+}
+
+void OutputGroup::enqueue(Device& device, const Payload& payload, clock::time_point now) {
+    {
+        std::lock_guard<std::mutex> lock(device.mutex);
+
+        if ( !device.isolated ) {
+            clock::time_point oldest = device.busy ? device.busy_since
+                                     : device.queue.empty() ? now
+                                     : device.queue.front().enqueued;
+
+            if ( device.queue.size() >= queue_capacity || now - oldest > stall_timeout ) {
+                device.isolated = true;
+                device.dropped += device.queue.size();
+                device.queue.clear();
+            }
+        }
+
+        if ( device.isolated ) {
+            device.dropped++;
+            return;
+        }
+
+        device.queue.push_back({payload, now});
+    }
+
+    device.wake.notify_one();
+}
+
+size_t OutputGroup::add(std::shared_ptr<Output> output, uint16_t channels) {
+    if ( !output )
+        throw std::invalid_argument("No output!");
+
+    std::shared_ptr<Device> device = std::make_shared<Device>();
+    device->output   = std::move(output);
+    device->channels = channels;
+    device->worker   = std::thread(&OutputGroup::run, device);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    devices.push_back(std::move(device));
+    return devices.size() - 1;
+}
+
+size_t OutputGroup::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return devices.size();
+}
+
+void OutputGroup::broadcast(const Message& msg) {
+    Payload           payload = share(msg);
+    clock::time_point now     = clock::now();
+
+    uint16_t channel_bit = (msg.message_type_raw() & 0xF0) < 0xF0 ? 1 << msg.get_channel() : 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for ( std::shared_ptr<Device>& device : devices )
+        if ( !channel_bit || (device->channels & channel_bit) )
+            enqueue(*device, payload, now);
+}
+
+void OutputGroup::send_to(size_t index, const Message& msg) {
+    Payload payload = share(msg);
+
+    std::shared_ptr<Device> device;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        device = devices.at(index);
+    }
+
+    enqueue(*device, payload, clock::now());
+}
+
+DeviceStats OutputGroup::stats(size_t index) {
+    std::shared_ptr<Device> device;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        device = devices.at(index);
+    }
+
+    std::lock_guard<std::mutex> lock(device->mutex);
+    clock::time_point now = clock::now();
+
+    DeviceStats stats;
+    stats.queued   = device->queue.size();
+    stats.sent     = device->sent;
+    stats.dropped  = device->dropped;
+    stats.failed   = device->failed;
+    stats.isolated = device->isolated;
+
+    if ( device->busy || !device->queue.empty() )
+        stats.lag = std::chrono::duration_cast<std::chrono::microseconds>(
+            now - (device->busy ? device->busy_since : device->queue.front().enqueued));
+
+    return stats;
+}
+
+void OutputGroup::reinstate(size_t index) {
+    std::shared_ptr<Device> device;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        device = devices.at(index);
+    }
+
+    std::lock_guard<std::mutex> lock(device->mutex);
+    device->isolated = false;
+}
+}
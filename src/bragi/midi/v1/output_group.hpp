@@ -0,0 +1,170 @@
+/**
+ * @file output_group.hpp
+ * @brief Driving many outputs from one thread without one device holding up the others
+ */
+#ifndef _BRAGI_MIDI_V1_OUTPUT_GROUP_HPP_
+#define _BRAGI_MIDI_V1_OUTPUT_GROUP_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Snapshot of the state of one device in an OutputGroup
+ */
+struct DeviceStats {
+    /// @brief Messages waiting in the device queue
+    size_t                    queued   = 0;
+
+    /// @brief Age of the oldest message not yet sent, including one the driver is busy with
+    std::chrono::microseconds lag      = std::chrono::microseconds::zero();
+
+    /// @brief Messages sent successfully
+    size_t                    sent     = 0;
+
+    /// @brief Messages not queued because the device was isolated
+    size_t                    dropped  = 0;
+
+    /// @brief Messages which the Output failed to send
+    size_t                    failed   = 0;
+
+    /// @brief Whether the device has been isolated
+    bool                      isolated = false;
+};
+
+/**
+ * @brief Broadcasts or routes messages to many outputs, each drained by its own worker thread
+ *
+ * Calling Output::send_msg() on each output in turn runs every driver call on the sending thread, so a single slow
+ * or wedged driver delays all other devices. Here each device has a bounded queue and a worker thread. A message is
+ * allocated once and shared between the device queues, so sending to many devices costs one reference per device.
+ *
+ * A device is isolated when its queue fills up, or when its oldest unsent message is older than the stall timeout.
+ * Its queue is then cleared, and further messages for it are dropped until reinstate() is called. This can leave
+ * notes hanging on that device.
+ */
+class OutputGroup {
+    protected:
+        using clock   = std::chrono::steady_clock;
+        using Payload = std::shared_ptr<const Message>;
+
+        struct Queued {
+            Payload           payload;
+            clock::time_point enqueued;
+        };
+
+        struct Device {
+            std::shared_ptr<Output> output;
+            uint16_t                channels;
+
+            std::mutex              mutex;
+            std::condition_variable wake;
+            std::condition_variable finished_wake;
+            std::deque<Queued>      queue;
+            bool                    running   = true;
+            bool                    finished  = false;
+            bool                    busy      = false;
+            bool                    isolated  = false;
+            clock::time_point       busy_since;
+            size_t                  sent      = 0;
+            size_t                  dropped   = 0;
+            size_t                  failed    = 0;
+
+            std::thread             worker;
+        };
+
+        size_t                               queue_capacity;
+        clock::duration                      stall_timeout;
+        std::mutex                           mutex;
+        std::vector<std::shared_ptr<Device>> devices;
+
+        static void run(std::shared_ptr<Device> device);
+        void enqueue(Device& device, const Payload& payload, clock::time_point now);
+        Payload share(const Message& msg) const;
+
+    public:
+        /// @brief Disable copy constructor, the worker threads belong to this group
+        OutputGroup(const OutputGroup&) = delete;
+
+        /// @brief Disable copy assignment, the worker threads belong to this group
+        OutputGroup& operator=(const OutputGroup&) = delete;
+
+        /**
+         * @brief Create an empty group
+         *
+         * @param [in] queue_capacity Messages each device can have queued before it is isolated
+         * @param [in] stall_timeout Age of the oldest unsent message at which a device is isolated
+         *
+         * @throws std::invalid_argument if @b queue_capacity is @c 0
+         */
+        OutputGroup(size_t queue_capacity = 1024,
+                    std::chrono::milliseconds stall_timeout = std::chrono::milliseconds(250));
+
+        /**
+         * @brief Stops the worker threads once their queues are sent
+         *
+         * Workers of isolated devices are detached rather than waited for, as their driver may never return. A device
+         * whose oldest unsent message passes the stall timeout while waiting is isolated as well.
+         */
+        ~OutputGroup();
+
+        /**
+         * @brief Add a device
+         *
+         * @param [in] output Connected output
+         * @param [in] channels Mask of the channels routed to this device by broadcast(), bit @c n for channel @c n
+         *
+         * @returns Index of the device in the group
+         *
+         * @throws std::invalid_argument if @b output is empty
+         * @throws std::system_error if the worker thread could not be started
+         */
+        size_t add(std::shared_ptr<Output> output, uint16_t channels = 0xFFFF);
+
+        /// @brief Number of devices
+        size_t size();
+
+        /**
+         * @brief Queue a message for every device routed its channel
+         *
+         * Messages without a channel go to every device.
+         *
+         * @throws Whatever is thrown by Message::validate()
+         */
+        void broadcast(const Message& msg);
+
+        /**
+         * @brief Queue a message for one device, regardless of its channel mask
+         *
+         * @throws std::out_of_range if @b index is not less than size()
+         * @throws Whatever is thrown by Message::validate()
+         */
+        void send_to(size_t index, const Message& msg);
+
+        /**
+         * @brief Get the state of a device
+         *
+         * @throws std::out_of_range if @b index is not less than size()
+         */
+        DeviceStats stats(size_t index);
+
+        /**
+         * @brief Start queueing messages for an isolated device again
+         *
+         * @throws std::out_of_range if @b index is not less than size()
+         */
+        void reinstate(size_t index);
+};
+}
+
+#endif //_BRAGI_MIDI_V1_OUTPUT_GROUP_HPP_//
@@ -0,0 +1,161 @@
+#include <bragi/midi/v1/pacer.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace bragi::midi::v1 {
+Pacer::Pacer(std::shared_ptr<Output> output, double byte_rate, size_t slice_size):
+        output(std::move(output)),
+        slice_size(slice_size),
+        wire_free_at(clock::now())
+    {
+        if ( !this->output )
+            throw std::invalid_argument("No output!");
+        if ( !(byte_rate > 0) || slice_size == 0 )
+            throw std::invalid_argument("Byte rate and slice size must be positive!");
+
+        byte_time = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / byte_rate));
+        worker    = std::thread(&Pacer::run, this);
+    }
+
+Pacer::~Pacer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void Pacer::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while ( true ) {
+        if ( realtime.empty() && queue.empty() ) {
+            if ( !running )
+                return;
+            wake.wait(lock);
+            continue;
+        }
+
+        clock::time_point now = clock::now();
+        if ( wire_free_at > now ) {
+            // Woken early by new messages as well, so a realtime message is picked up as soon as the wire frees
+            wake.wait_until(lock, wire_free_at);
+            continue;
+        }
+
+        size_t   bytes;
+        Pending* slicing = nullptr;
+
+        try {
+            if ( !realtime.empty() ) {
+                ShortMessage msg(realtime.front());
+                realtime.pop_front();
+                queued_bytes -= 1;
+                bytes = 1;
+
+                lock.unlock();
+                output->send_msg(msg);
+                lock.lock();
+            }
+
+            else if ( queue.front().long_msg.empty() ) {
+                ShortMessage msg = queue.front().msg;
+                queue.pop_front();
+                queued_bytes -= msg.size();
+                bytes = msg.size();
+
+                lock.unlock();
+                output->send_msg(msg);
+                lock.lock();
+            }
+
+            else {
+                // Only this thread pops, so the front element stays put while unlocked
+                Pending& head = queue.front();
+                bytes = std::min(slice_size, head.long_msg.size() - head.offset);
+                slicing = &head;
+
+                lock.unlock();
+                output->send_raw(head.long_msg.data() + head.offset, bytes);
+                lock.lock();
+
+                head.offset  += bytes;
+                queued_bytes -= bytes;
+                if ( head.offset == head.long_msg.size() )
+                    queue.pop_front();
+            }
+        } catch ( std::exception& ) {
+            if ( !lock.owns_lock() )
+                lock.lock();
+            failed_count++;
+
+            // The rest of a message cannot be delivered once a slice of it failed
+            if ( slicing ) {
+                queued_bytes -= slicing->long_msg.size() - slicing->offset;
+                queue.pop_front();
+            }
+            continue;
+        }
+
+        wire_free_at = std::max(now, wire_free_at) + static_cast<clock::rep>(bytes) * byte_time;
+    }
+}
+
+void Pacer::send_msg(const ShortMessage& msg) {
+    if ( !msg.valid() )
+        throw std::invalid_argument("Invalid short message!");
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if ( msg.status() >= MessageType::timing_tick ) {
+            realtime.push_back(msg.status());
+        } else {
+            Pending pending;
+            pending.msg = msg;
+            queue.push_back(std::move(pending));
+        }
+
+        queued_bytes += msg.size();
+    }
+
+    wake.notify_one();
+}
+
+void Pacer::send_msg(const Message& msg) {
+    msg.validate();
+
+    if ( msg.message_type() != MessageType::system_exclusive )
+        return send_msg(ShortMessage::from(msg));
+
+    Pending pending;
+    pending.long_msg = msg.serialize();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued_bytes += pending.long_msg.size();
+        queue.push_back(std::move(pending));
+    }
+
+    wake.notify_one();
+}
+
+std::chrono::microseconds Pacer::wire_lag() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    clock::time_point now  = clock::now();
+    clock::duration   busy = wire_free_at > now ? wire_free_at - now : clock::duration::zero();
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        busy + static_cast<clock::rep>(queued_bytes) * byte_time);
+}
+
+size_t Pacer::failed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed_count;
+}
+}
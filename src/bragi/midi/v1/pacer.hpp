@@ -0,0 +1,119 @@
+/**
+ * @file pacer.hpp
+ * @brief Pacing messages to the byte rate of a physical MIDI port
+ */
+#ifndef _BRAGI_MIDI_V1_PACER_HPP_
+#define _BRAGI_MIDI_V1_PACER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Byte rate of a 31.25 kbaud MIDI port - 10 bits on the wire per byte, 320 us each
+ */
+constexpr double midi_port_byte_rate = 3125;
+
+/**
+ * @brief Hands messages to an Output no faster than the port can put them on the wire
+ *
+ * Drivers accept bursts of messages and queue them internally, where a @b timing_tick cannot overtake a chord or a
+ * long system exclusive message. The Pacer keeps its own queues instead and models how long the port is busy with
+ * what it has already sent. A message is only passed on once the modelled wire is idle, and realtime messages
+ * (@c 0xF8 - @c 0xFF) are always taken before anything else.
+ *
+ * Every message is modelled with its status byte. Messages are passed on whole, so whether running status saves any
+ * bytes is up to the driver, and the model errs on the side of the port being busy. System exclusive messages are sent in slices, so realtime messages can be interleaved
+ * between them. Only realtime messages are allowed inside a system exclusive message, so other messages still wait
+ * for the end of it.
+ */
+class Pacer {
+    protected:
+        using clock = std::chrono::steady_clock;
+
+        struct Pending {
+            ShortMessage               msg;
+            std::basic_string<uint8_t> long_msg;
+            size_t                     offset = 0;
+        };
+
+        std::shared_ptr<Output>      output;
+        clock::duration              byte_time;
+        size_t                       slice_size;
+
+        std::mutex                   mutex;
+        std::condition_variable      wake;
+        bool                         running        = true;
+        std::deque<uint8_t>          realtime;
+        std::deque<Pending>          queue;
+        size_t                       queued_bytes   = 0;
+        clock::time_point            wire_free_at;
+        size_t                       failed_count   = 0;
+
+        std::thread                  worker;
+
+        void run();
+
+    public:
+        /// @brief Disable empty constructor
+        Pacer() = delete;
+
+        /// @brief Disable copy constructor, the worker thread refers to this object
+        Pacer(const Pacer&) = delete;
+
+        /// @brief Disable copy assignment, the worker thread refers to this object
+        Pacer& operator=(const Pacer&) = delete;
+
+        /**
+         * @brief Start pacing an output
+         *
+         * @param [in] output Connected output to pass messages on to
+         * @param [in] byte_rate Bytes per second the port carries
+         * @param [in] slice_size Largest part of a system exclusive message sent at once
+         *
+         * @throws std::invalid_argument if @b output is empty, or @b byte_rate or @b slice_size is not positive
+         * @throws std::system_error if the worker thread could not be started
+         */
+        Pacer(std::shared_ptr<Output> output, double byte_rate = midi_port_byte_rate, size_t slice_size = 32);
+
+        /// @brief Sends everything still queued, then stops the worker thread
+        ~Pacer();
+
+        /**
+         * @brief Queue a message
+         *
+         * @throws Whatever is thrown by Message::validate()
+         */
+        void send_msg(const Message& msg);
+
+        /**
+         * @brief Queue a short message
+         *
+         * @throws std::invalid_argument if @b msg is invalid
+         */
+        void send_msg(const ShortMessage& msg);
+
+        /**
+         * @brief Estimated time until everything sent so far has left the port
+         *
+         * Includes both what is still queued here and what the modelled wire is still busy with.
+         */
+        std::chrono::microseconds wire_lag();
+
+        /// @brief Number of messages which the Output failed to send
+        size_t failed();
+};
+}
+
+#endif //_BRAGI_MIDI_V1_PACER_HPP_//
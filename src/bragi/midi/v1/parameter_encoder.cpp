@@ -0,0 +1,149 @@
+#include <bragi/midi/v1/parameter_encoder.hpp>
+
+#include <stdexcept>
+#include <utility>
+
+namespace bragi::midi::v1 {
+ParameterEncoder::ParameterEncoder(std::shared_ptr<Output> output): output(std::move(output)) {
+    if ( !this->output )
+        throw std::invalid_argument("Output must not be empty!");
+
+    invalidate_locked();
+}
+
+void ParameterEncoder::check(const ParameterChange& change) {
+    if ( change.channel > 15 )
+        throw std::range_error("Channel must be at most 15!");
+    if ( change.kind == ParameterChange::controller && change.number >= ParameterController::lsb_offset )
+        throw std::range_error("Controller must be at most 31!");
+    if ( change.number > 0x3FFF )
+        throw std::range_error("Parameter number must be at most 0x3FFF!");
+    if ( change.value > 0x3FFF )
+        throw std::range_error("Value must be at most 0x3FFF!");
+}
+
+void ParameterEncoder::encode(const ParameterChange& change) {
+    ChannelState& state  = channels[change.channel];
+    uint8_t       status = MessageType::controller_change | change.channel;
+    size_t        before = pending.size();
+
+    // The LSB always follows a new MSB, as receivers may clear the LSB when the MSB changes
+    auto set_value = [&](uint16_t& last, uint8_t msb_controller, uint8_t lsb_controller) {
+        if ( last == unknown || last >> 7 != change.value >> 7 ) {
+            pending.push_back(ShortMessage(status, msb_controller, change.value >> 7));
+            pending.push_back(ShortMessage(status, lsb_controller, change.value & 0x7F));
+        } else if ( (last & 0x7F) != (change.value & 0x7F) ) {
+            pending.push_back(ShortMessage(status, lsb_controller, change.value & 0x7F));
+        }
+        last = change.value;
+    };
+
+    if ( change.kind == ParameterChange::controller ) {
+        uint8_t controller = static_cast<uint8_t>(change.number);
+        set_value(state.controllers[controller], controller, controller + ParameterController::lsb_offset);
+        saved_count += 2 - (pending.size() - before);
+        return;
+    }
+
+    bool    non_registered = change.kind == ParameterChange::non_registered;
+    uint8_t select_msb     = non_registered ? ParameterController::nrpn_msb : ParameterController::rpn_msb;
+    uint8_t select_lsb     = non_registered ? ParameterController::nrpn_lsb : ParameterController::rpn_lsb;
+    bool    same_kind      = state.selected != unknown && state.non_registered == non_registered;
+
+    if ( !same_kind || state.selected >> 7 != change.number >> 7 )
+        pending.push_back(ShortMessage(status, select_msb, change.number >> 7));
+    if ( !same_kind || (state.selected & 0x7F) != (change.number & 0x7F) )
+        pending.push_back(ShortMessage(status, select_lsb, change.number & 0x7F));
+
+    // The data entry values last sent belonged to another parameter
+    if ( pending.size() != before )
+        state.data = unknown;
+
+    state.non_registered = non_registered;
+    state.selected       = change.number;
+    set_value(state.data, ParameterController::data_entry_msb, ParameterController::data_entry_lsb);
+    saved_count += 4 - (pending.size() - before);
+}
+
+void ParameterEncoder::flush_locked() {
+    try {
+        output->send_batch(pending.data(), pending.size());
+    } catch ( ... ) {
+        // Whatever the receiver got is unknown now
+        pending.clear();
+        invalidate_locked();
+        throw;
+    }
+
+    sent_count += pending.size();
+    pending.clear();
+}
+
+void ParameterEncoder::invalidate_locked() {
+    for ( ChannelState& state : channels ) {
+        state.selected = unknown;
+        state.data     = unknown;
+        state.controllers.fill(unknown);
+    }
+}
+
+void ParameterEncoder::controller(uint8_t controller, uint16_t value, uint8_t channel) {
+    ParameterChange change = {ParameterChange::controller, channel, controller, value};
+    send(&change, 1);
+}
+
+void ParameterEncoder::registered(uint16_t parameter, uint16_t value, uint8_t channel) {
+    ParameterChange change = {ParameterChange::registered, channel, parameter, value};
+    send(&change, 1);
+}
+
+void ParameterEncoder::non_registered(uint16_t parameter, uint16_t value, uint8_t channel) {
+    ParameterChange change = {ParameterChange::non_registered, channel, parameter, value};
+    send(&change, 1);
+}
+
+void ParameterEncoder::send(const ParameterChange* changes, size_t count) {
+    for ( size_t i = 0; i < count; i++ )
+        check(changes[i]);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for ( size_t i = 0; i < count; i++ )
+        encode(changes[i]);
+
+    flush_locked();
+}
+
+void ParameterEncoder::deselect(uint8_t channel) {
+    if ( channel > 15 )
+        throw std::range_error("Channel must be at most 15!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ChannelState& state = channels[channel];
+    if ( state.selected == ParameterController::null_parameter && !state.non_registered )
+        return;
+
+    uint8_t status = MessageType::controller_change | channel;
+    pending.push_back(ShortMessage(status, ParameterController::rpn_msb, 0x7F));
+    pending.push_back(ShortMessage(status, ParameterController::rpn_lsb, 0x7F));
+
+    state.non_registered = false;
+    state.selected       = ParameterController::null_parameter;
+    state.data           = unknown;
+    flush_locked();
+}
+
+void ParameterEncoder::invalidate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    invalidate_locked();
+}
+
+size_t ParameterEncoder::sent() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sent_count;
+}
+
+size_t ParameterEncoder::saved() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return saved_count;
+}
+}
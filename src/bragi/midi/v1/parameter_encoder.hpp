@@ -0,0 +1,166 @@
+/**
+ * @file parameter_encoder.hpp
+ * @brief Sending 14-bit controllers and RPN / NRPN parameters with as few messages as possible
+ */
+#ifndef _BRAGI_MIDI_V1_PARAMETER_ENCODER_HPP_
+#define _BRAGI_MIDI_V1_PARAMETER_ENCODER_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Controller numbers used to set 14-bit values
+ */
+class ParameterController {
+    public:
+        constexpr static uint8_t data_entry_msb     = 6;
+        constexpr static uint8_t data_entry_lsb     = 38;
+        constexpr static uint8_t nrpn_lsb           = 98;
+        constexpr static uint8_t nrpn_msb           = 99;
+        constexpr static uint8_t rpn_lsb            = 100;
+        constexpr static uint8_t rpn_msb            = 101;
+
+        /// @brief Controllers @c 0 - @c 31 take their LSB from the controller this much higher
+        constexpr static uint8_t lsb_offset         = 32;
+
+        /// @brief Registered parameter number selecting no parameter, so stray data entry is ignored
+        constexpr static uint16_t null_parameter    = 0x3FFF;
+};
+
+/**
+ * @brief One change of a 14-bit value, for sending several at once
+ */
+struct ParameterChange {
+    enum Kind : uint8_t {
+        controller,     ///< @b number is a controller @c 0 - @c 31, paired with the one 32 higher
+        registered,     ///< @b number is a registered parameter number (RPN)
+        non_registered, ///< @b number is a non-registered parameter number (NRPN)
+    };
+
+    Kind     kind;
+    uint8_t  channel;
+    uint16_t number;
+    uint16_t value;
+};
+
+/**
+ * @brief Sends 14-bit values, leaving out the messages the receiver already has
+ *
+ * Setting an RPN or NRPN takes 2 messages to select the parameter and 2 for data entry, and a 14-bit controller takes
+ * 2. The encoder remembers per channel which parameter is selected and which values were last sent, and only sends
+ * the part that changed - a new parameter selection, or a new MSB followed by the LSB, or only a new LSB. Values that
+ * did not change at all are not sent.
+ *
+ * The messages of each call are sent together through Output::send_batch().
+ *
+ * The encoder assumes it is the only one sending these controllers through the output. Call invalidate() if anything
+ * else may have sent them, or the device was reset, so everything is sent in full again.
+ */
+class ParameterEncoder {
+    protected:
+        constexpr static uint16_t unknown = 0xFFFF;
+
+        struct ChannelState {
+            bool                      non_registered = false;
+            uint16_t                  selected       = unknown;
+            uint16_t                  data           = unknown; // Data entry value of the selected parameter
+            std::array<uint16_t, 32>  controllers;
+        };
+
+        std::shared_ptr<Output>       output;
+        std::mutex                    mutex;
+        std::array<ChannelState, 16>  channels;
+        std::vector<ShortMessage>     pending;
+        size_t                        sent_count  = 0;
+        size_t                        saved_count = 0;
+
+        static void check(const ParameterChange& change);
+        void encode(const ParameterChange& change);
+        void flush_locked();
+        void invalidate_locked();
+
+    public:
+        /// @brief Disable empty constructor
+        ParameterEncoder() = delete;
+
+        /**
+         * @brief Encode parameters for an output
+         *
+         * @param [in] output Connected output to send to
+         *
+         * @throws std::invalid_argument if @b output is empty
+         */
+        explicit ParameterEncoder(std::shared_ptr<Output> output);
+
+        /**
+         * @brief Set a 14-bit controller
+         *
+         * @param [in] controller Controller @c 0 - @c 31 holding the MSB, the LSB goes to the one 32 higher
+         * @param [in] value Value @c 0 - @c 0x3FFF
+         * @param [in] channel Channel of the controller
+         *
+         * @throws std::range_error if any parameter is too large
+         * @throws Whatever is thrown by Output::send_batch()
+         */
+        void controller(uint8_t controller, uint16_t value, uint8_t channel = 0);
+
+        /**
+         * @brief Set a registered parameter (RPN)
+         *
+         * @param [in] parameter Parameter number @c 0 - @c 0x3FFF
+         * @param [in] value Value @c 0 - @c 0x3FFF
+         * @param [in] channel Channel of the parameter
+         *
+         * @throws std::range_error if any parameter is too large
+         * @throws Whatever is thrown by Output::send_batch()
+         */
+        void registered(uint16_t parameter, uint16_t value, uint8_t channel = 0);
+
+        /**
+         * @brief Set a non-registered parameter (NRPN)
+         *
+         * @param [in] parameter Parameter number @c 0 - @c 0x3FFF
+         * @param [in] value Value @c 0 - @c 0x3FFF
+         * @param [in] channel Channel of the parameter
+         *
+         * @throws std::range_error if any parameter is too large
+         * @throws Whatever is thrown by Output::send_batch()
+         */
+        void non_registered(uint16_t parameter, uint16_t value, uint8_t channel = 0);
+
+        /**
+         * @brief Apply several changes, sending the messages for all of them together
+         *
+         * @throws std::range_error if any change is out of range, in which case nothing is sent
+         * @throws Whatever is thrown by Output::send_batch()
+         */
+        void send(const ParameterChange* changes, size_t count);
+
+        /**
+         * @brief Select the null RPN, so later data entry messages from elsewhere change nothing
+         *
+         * @throws std::range_error if @b channel is greater than 15
+         * @throws Whatever is thrown by Output::send_batch()
+         */
+        void deselect(uint8_t channel = 0);
+
+        /// @brief Forget what the receiver is known to have, so the next values are sent in full
+        void invalidate();
+
+        /// @brief Number of messages sent
+        size_t sent();
+
+        /// @brief Number of messages left out, compared to always sending every message in full
+        size_t saved();
+};
+}
+
+#endif //_BRAGI_MIDI_V1_PARAMETER_ENCODER_HPP_//
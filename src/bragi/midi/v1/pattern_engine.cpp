@@ -0,0 +1,467 @@
+#include <bragi/midi/v1/pattern_engine.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace bragi::midi::v1 {
+/********************************/
+/* Helpers                      */
+/********************************/
+static uint64_t mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15;
+    value  = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+    value  = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+    return value ^ (value >> 31);
+}
+
+static double step_ticks(const Pattern& pattern) {
+    return static_cast<double>(PatternEngine::ticks_per_beat) / pattern.steps_per_beat;
+}
+
+// Absolute tick of the NOTE ON of a step, counting steps from the first bar
+static uint64_t note_on_tick(const Pattern& pattern, uint64_t step) {
+    double length = step_ticks(pattern);
+    double tick   = step * length + (step & 1 ? pattern.swing * length : 0);
+    return static_cast<uint64_t>(tick + 0.5);
+}
+
+static uint64_t note_off_tick(const Pattern& pattern, uint64_t step, uint64_t on) {
+    uint64_t length = static_cast<uint64_t>(pattern.steps[step % pattern.steps.size()].gate * step_ticks(pattern) + 0.5);
+    return on + std::max<uint64_t>(length, 1);
+}
+
+// First and last step which may start or end within a bar, when no note is longer than @b gate steps, pass @c 0 for
+// only the steps which may start within it
+static void step_range(const Pattern& pattern, float gate, uint64_t bar_start, uint64_t bar_end,
+                       uint64_t& first, uint64_t& last) {
+    double length = step_ticks(pattern);
+    double reach  = (gate + pattern.swing + 1) * length;
+
+    first = bar_start > reach ? static_cast<uint64_t>((bar_start - reach) / length) : 0;
+    last  = static_cast<uint64_t>(bar_end / length) + 1;
+}
+
+/********************************/
+/* Implementation               */
+/********************************/
+PatternEngine::PatternEngine(std::shared_ptr<Output> output, double bpm, unsigned int beats_per_bar, size_t lookahead,
+                             uint64_t seed, std::chrono::microseconds poll_interval):
+        output(std::move(output)),
+        beats_per_bar(beats_per_bar),
+        seed(seed),
+        poll_interval(poll_interval),
+        slot_count(lookahead),
+        claimed(0),
+        bpm(bpm),
+        missed_count(0),
+        failed_count(0)
+    {
+        if ( !this->output )
+            throw std::invalid_argument("No output!");
+        if ( !(bpm > 0) )
+            throw std::invalid_argument("Tempo must be positive!");
+        if ( beats_per_bar == 0 )
+            throw std::invalid_argument("Beats per bar must be positive!");
+        if ( lookahead < 2 )
+            throw std::invalid_argument("Lookahead must be at least 2 bars!");
+
+        slots  = std::unique_ptr<Slot[]>(new Slot[slot_count]);
+        worker = std::thread(&PatternEngine::render, this);
+    }
+
+PatternEngine::~PatternEngine() {
+    stop();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rendering = false;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void PatternEngine::check(const Pattern& pattern) {
+    if ( pattern.channel > 15 )
+        throw std::invalid_argument("Channel must be at most 15!");
+    if ( pattern.steps_per_beat == 0 || pattern.steps_per_beat > ticks_per_beat )
+        throw std::invalid_argument("Steps per beat must be from 1 to 960!");
+    if ( !(pattern.swing >= 0 && pattern.swing < 1) )
+        throw std::invalid_argument("Swing must be at least 0 and below 1!");
+
+    for ( const PatternStep& step : pattern.steps ) {
+        if ( step.pitch > 0x7F || step.velocity > 0x7F )
+            throw std::invalid_argument("Pitch and velocity must be at most 0x7F!");
+        if ( !(step.gate > 0 && step.gate <= 256) )
+            throw std::invalid_argument("Gate must be above 0 and at most 256 steps!");
+        if ( !(step.probability >= 0 && step.probability <= 1) )
+            throw std::invalid_argument("Probability must be from 0 to 1!");
+    }
+}
+
+uint32_t PatternEngine::bar_ticks() const {
+    return beats_per_bar * ticks_per_beat;
+}
+
+bool PatternEngine::plays(const Entry& entry, uint64_t step) const {
+    const PatternStep& value = entry.pattern.steps[step % entry.pattern.steps.size()];
+    if ( value.velocity == 0 || value.probability <= 0 )
+        return false;
+    if ( value.probability >= 1 )
+        return true;
+
+    // Decided by position rather than by a running generator, so any bar renders the same on its own
+    uint64_t hash = mix(seed ^ mix(entry.salt ^ mix(step)));
+    return static_cast<double>(hash >> 11) * 0x1.0p-53 < value.probability;
+}
+
+bool PatternEngine::touches(const Entry& entry, size_t step, float gate, uint64_t bar) const {
+    uint64_t first, last;
+    uint64_t count = entry.pattern.steps.size();
+    step_range(entry.pattern, gate, bar * bar_ticks(), (bar + 1) * bar_ticks(), first, last);
+
+    // First repetition of the step from @b first
+    uint64_t occurrence = first + (step + count - first % count) % count;
+    return occurrence <= last;
+}
+
+void PatternEngine::mark_locked(size_t id, size_t step, float gate) {
+    uint64_t playing_bar = claimed.load();
+
+    for ( size_t i = 0; i < slot_count; i++ ) {
+        Slot& slot = slots[i];
+        if ( slot.bar != none && slot.bar >= playing_bar && touches(entries[id], step, gate, slot.bar) )
+            slot.dirty = true;
+    }
+    wake.notify_one();
+}
+
+void PatternEngine::mark_all_locked() {
+    for ( size_t i = 0; i < slot_count; i++ )
+        slots[i].dirty = true;
+    wake.notify_one();
+}
+
+void PatternEngine::absorb_locked() {
+    uint64_t first = claimed.load();
+
+    // Only the worker renders, so the slots of bars claimed since the last call still hold what was played
+    for ( ; unclaimed < first; unclaimed++ ) {
+        const Slot& slot      = slots[unclaimed % slot_count];
+        uint64_t    published = slot.published.load();
+
+        if ( published >> 2 == unclaimed + 1 && published & 2 ) {
+            const std::vector<Pending>& carried = slot.buffers[published & 1].carried;
+            held.insert(held.end(), carried.begin(), carried.end());
+        }
+    }
+
+    // Those due before the first bar which may still be rendered are in bars already claimed
+    uint64_t from = first * bar_ticks();
+    held.erase(std::remove_if(held.begin(), held.end(), [from](const Pending& pending) {
+        return pending.tick < from;
+    }), held.end());
+}
+
+void PatternEngine::render_locked(Slot& slot, uint64_t bar) {
+    uint64_t bar_start = bar * bar_ticks();
+    uint64_t bar_end   = bar_start + bar_ticks();
+
+    // The timing thread may still read the published buffer, but never the other one
+    uint64_t published = slot.published.load();
+    size_t   index     = (published & 1) ^ 1;
+    Buffer&  buffer    = slot.buffers[index];
+
+    // Claimed since absorb_locked(), the next call keeps what it carries
+    if ( published >> 2 == bar + 1 && published & 2 )
+        return;
+    buffer.carried.clear();
+
+    auto add_off = [&](const Pending& pending) {
+        if ( pending.tick >= bar_start && pending.tick < bar_end )
+            scratch.push_back({static_cast<uint32_t>(pending.tick - bar_start), false, pending.msg});
+    };
+
+    scratch.clear();
+    for ( const Entry& entry : entries ) {
+        if ( !entry.active || entry.pattern.steps.empty() )
+            continue;
+
+        const Pattern& pattern = entry.pattern;
+        uint64_t       first, last;
+        step_range(pattern, 0, bar_start, bar_end, first, last);
+
+        for ( uint64_t step = first; step <= last; step++ ) {
+            uint64_t on = note_on_tick(pattern, step);
+            if ( on < bar_start || on >= bar_end || !plays(entry, step) )
+                continue;
+
+            const PatternStep& value = pattern.steps[step % pattern.steps.size()];
+            uint64_t           off   = note_off_tick(pattern, step, on);
+            ShortMessage       note_off(MessageType::note_off | pattern.channel, value.pitch, 0);
+
+            scratch.push_back({static_cast<uint32_t>(on - bar_start), true,
+                ShortMessage(MessageType::note_on | pattern.channel, value.pitch, value.velocity)});
+            if ( off < bar_end )
+                add_off({off, note_off});
+            else
+                buffer.carried.push_back({off, note_off});
+        }
+    }
+
+    // Notes started in earlier bars end as those bars were rendered, not as the pattern is now
+    for ( const Pending& pending : held )
+        add_off(pending);
+    for ( uint64_t earlier = unclaimed; earlier < bar; earlier++ ) {
+        const Slot& other = slots[earlier % slot_count];
+        uint64_t    state = other.published.load();
+        if ( state >> 2 == earlier + 1 )
+            for ( const Pending& pending : other.buffers[state & 1].carried )
+                add_off(pending);
+    }
+
+    // A note ending where the next one of the same pitch starts must end first
+    std::stable_sort(scratch.begin(), scratch.end(), [](const Event& a, const Event& b) {
+        return a.tick != b.tick ? a.tick < b.tick : !a.on && b.on;
+    });
+
+    buffer.ticks.clear();
+    buffer.messages.clear();
+    for ( const Event& event : scratch ) {
+        buffer.ticks.push_back(event.tick);
+        buffer.messages.push_back(event.msg);
+    }
+
+    // Fails if the timing thread claimed the bar meanwhile, it then plays what was published before
+    if ( !slot.published.compare_exchange_strong(published, ((bar + 1) << 2) | index) )
+        return;
+
+    // Later bars end the notes carried out of this one, so must be rendered again if those changed
+    const std::vector<Pending>& before = slot.buffers[index ^ 1].carried;
+    bool changed = published >> 2 != bar + 1 || before.size() != buffer.carried.size() ||
+        !std::equal(before.begin(), before.end(), buffer.carried.begin(), [](const Pending& a, const Pending& b) {
+            return a.tick == b.tick && a.msg.packed() == b.msg.packed();
+        });
+
+    if ( changed )
+        for ( size_t i = 0; i < slot_count; i++ )
+            if ( slots[i].bar != none && slots[i].bar > bar )
+                slots[i].dirty = true;
+
+    slot.bar   = bar;
+    slot.dirty = false;
+    render_count++;
+}
+
+void PatternEngine::render() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while ( rendering ) {
+        absorb_locked();
+
+        // The claimed bar is being played, so only the ones after it may be rendered
+        uint64_t first    = unclaimed;
+        bool     rendered = false;
+
+        for ( uint64_t bar = first; bar < first + slot_count - 1; bar++ ) {
+            Slot& slot = slots[bar % slot_count];
+            if ( slot.bar == bar && !slot.dirty )
+                continue;
+
+            render_locked(slot, bar);
+            rendered = true;
+            break;
+        }
+
+        if ( !rendered )
+            wake.wait_for(lock, poll_interval);
+    }
+}
+
+void PatternEngine::play(clock::time_point start) {
+    clock::time_point bar_start = start;
+
+    // Returns false once stopped
+    auto wait_until = [this](clock::time_point due) {
+        std::unique_lock<std::mutex> lock(timing_mutex);
+        return !timing_wake.wait_until(lock, due, [this]() { return !playing; });
+    };
+
+    for ( uint64_t bar = 0; ; bar++ ) {
+        if ( !wait_until(bar_start) )
+            return;
+
+        claimed.store(bar + 1);
+
+        clock::duration bar_length = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(beats_per_bar * 60.0 / bpm.load()));
+
+        // Marked claimed, so the worker keeps the NOTE OFF messages of exactly the buffer played
+        Slot&    slot      = slots[bar % slot_count];
+        uint64_t published = slot.published.fetch_or(2);
+
+        if ( published >> 2 != bar + 1 ) {
+            // Notes held over from the previous bar lose their NOTE OFF
+            missed_count++;
+            silence();
+        } else {
+            const Buffer& buffer = slot.buffers[published & 1];
+            size_t        count  = buffer.ticks.size();
+
+            for ( size_t i = 0; i < count; ) {
+                size_t end = i + 1;
+                while ( end < count && buffer.ticks[end] == buffer.ticks[i] )
+                    end++;
+
+                if ( !wait_until(bar_start + bar_length * buffer.ticks[i] / bar_ticks()) )
+                    return;
+
+                try {
+                    output->send_batch(&buffer.messages[i], end - i);
+                } catch ( std::exception& ) {
+                    failed_count++;
+                }
+                i = end;
+            }
+        }
+
+        bar_start += bar_length;
+    }
+}
+
+void PatternEngine::silence() {
+    ShortMessage all_notes_off[16];
+    for ( uint8_t channel = 0; channel < 16; channel++ )
+        all_notes_off[channel] = ShortMessage(MessageType::controller_change | channel, 123, 0);
+
+    try {
+        output->send_batch(all_notes_off, 16);
+    } catch ( std::exception& ) {
+        failed_count++;
+    }
+}
+
+size_t PatternEngine::add(Pattern pattern) {
+    check(pattern);
+
+    Entry entry;
+    entry.active  = true;
+    entry.pattern = std::move(pattern);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entry.salt = next_salt++;
+    entries.push_back(std::move(entry));
+    mark_all_locked();
+    return entries.size() - 1;
+}
+
+void PatternEngine::set(size_t id, Pattern pattern) {
+    check(pattern);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if ( id >= entries.size() || !entries[id].active )
+        throw std::domain_error("No such pattern!");
+
+    entries[id].pattern = std::move(pattern);
+    mark_all_locked();
+}
+
+void PatternEngine::set_step(size_t id, size_t step, PatternStep value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if ( id >= entries.size() || !entries[id].active )
+        throw std::domain_error("No such pattern!");
+
+    Entry& entry = entries[id];
+    if ( step >= entry.pattern.steps.size() )
+        throw std::domain_error("No such step!");
+
+    Pattern changed = entry.pattern;
+    changed.steps[step] = value;
+    check(changed);
+
+    // Both the bars the old note reached and those the new one reaches change
+    float gate = std::max(entry.pattern.steps[step].gate, value.gate);
+    entry.pattern.steps[step] = value;
+    mark_locked(id, step, gate);
+}
+
+void PatternEngine::remove(size_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if ( id >= entries.size() || !entries[id].active )
+        throw std::domain_error("No such pattern!");
+
+    entries[id].active = false;
+    entries[id].pattern.steps.clear();
+    mark_all_locked();
+}
+
+void PatternEngine::start(clock::time_point at) {
+    {
+        std::lock_guard<std::mutex> lock(timing_mutex);
+        if ( playing )
+            throw std::logic_error("Already playing!");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        claimed.store(0);
+        unclaimed = 0;
+        held.clear();
+        for ( size_t i = 0; i < slot_count; i++ ) {
+            slots[i].published.store(0);
+            slots[i].bar = none;
+        }
+
+        // The rest is rendered by the worker while the first bar plays
+        render_locked(slots[0], 0);
+    }
+    wake.notify_one();
+
+    std::lock_guard<std::mutex> lock(timing_mutex);
+    playing = true;
+    timer   = std::thread(&PatternEngine::play, this, at);
+}
+
+void PatternEngine::stop() {
+    {
+        std::lock_guard<std::mutex> lock(timing_mutex);
+        if ( !playing )
+            return;
+        playing = false;
+    }
+    timing_wake.notify_one();
+    timer.join();
+
+    silence();
+}
+
+void PatternEngine::set_tempo(double bpm) {
+    if ( !(bpm > 0) )
+        throw std::invalid_argument("Tempo must be positive!");
+    this->bpm.store(bpm);
+}
+
+double PatternEngine::tempo() const {
+    return bpm.load();
+}
+
+uint64_t PatternEngine::bar() const {
+    uint64_t playing_bar = claimed.load();
+    return playing_bar ? playing_bar - 1 : 0;
+}
+
+size_t PatternEngine::renders() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return render_count;
+}
+
+size_t PatternEngine::missed() const {
+    return missed_count.load();
+}
+
+size_t PatternEngine::failed() const {
+    return failed_count.load();
+}
+}
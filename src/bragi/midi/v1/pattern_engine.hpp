@@ -0,0 +1,244 @@
+/**
+ * @file pattern_engine.hpp
+ * @brief Looping step patterns, rendered ahead of time so playing them costs the same however complex they are
+ */
+#ifndef _BRAGI_MIDI_V1_PATTERN_ENGINE_HPP_
+#define _BRAGI_MIDI_V1_PATTERN_ENGINE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief One step of a Pattern
+ */
+struct PatternStep {
+    uint8_t pitch       = 60;
+    uint8_t velocity    = 0;    ///< Velocity of the note, @c 0 for a rest
+    float   gate        = 0.5;  ///< Length of the note in steps, may be longer than @c 1 to tie into later steps
+    float   probability = 1;    ///< Chance of the note playing each time round, from @c 0 to @c 1
+};
+
+/**
+ * @brief Steps played one after the other on a channel, looping for as long as the engine plays
+ */
+struct Pattern {
+    uint8_t                  channel        = 0;
+    unsigned int             steps_per_beat = 4;
+    float                    swing          = 0;  ///< Delay of every second step as a fraction of a step, below @c 1
+    std::vector<PatternStep> steps;
+};
+
+/**
+ * @brief Plays patterns from bars rendered ahead of time by a worker thread
+ *
+ * The worker renders each bar into a buffer of timestamped ShortMessage values, deciding probabilities, swing and
+ * note lengths up front. The timing thread owned by the engine only waits for each timestamp and passes the messages
+ * due to Output::send_batch(), so its work per message is the same for any number of patterns.
+ *
+ * Bars are rendered up to @b lookahead - 1 bars ahead of the one playing. Each bar has two buffers; the worker fills
+ * the one not published, then publishes it unless the timing thread claimed the bar meanwhile. A claimed bar is never
+ * rendered again, so the timing thread reads it without locking.
+ *
+ * Edits re-render the bars already rendered which they change, from the bar after the one playing. set_step() only
+ * re-renders the bars in which that step plays. Whether a note plays is decided by hashing the seed, the pattern and
+ * the position of the step, so re-rendering a bar does not change notes which were not edited.
+ *
+ * The NOTE OFF of a note held past the end of its bar is kept with the bar which starts it, and later bars are
+ * rendered from those rather than from the pattern. Once a bar is claimed its NOTE OFF messages are kept until sent,
+ * so a note which is edited, muted or removed while it sounds still ends as it was started.
+ *
+ * Patterns start with the first bar. Tempo changes take effect from the next bar.
+ */
+class PatternEngine {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /// @brief Resolution of the rendered timestamps
+        constexpr static uint32_t ticks_per_beat = 960;
+
+    protected:
+        constexpr static uint64_t none = ~uint64_t(0);
+
+        struct Pending {
+            uint64_t     tick;  // From the start of the first bar
+            ShortMessage msg;
+        };
+
+        struct Buffer {
+            std::vector<uint32_t>     ticks;    // From the start of the bar, in ascending order
+            std::vector<ShortMessage> messages;
+            std::vector<Pending>      carried;  // NOTE OFF of notes started in the bar but ending after it
+        };
+
+        struct Slot {
+            // (bar + 1) << 2 | claimed << 1 | index of the buffer holding it, 0 if nothing was published
+            std::atomic<uint64_t>     published{0};
+            Buffer                    buffers[2];
+            uint64_t                  bar       = none;
+            bool                      dirty     = false;
+        };
+
+        struct Entry {
+            bool     active = false;
+            uint64_t salt   = 0;
+            Pattern  pattern;
+        };
+
+        struct Event {
+            uint32_t     tick;
+            bool         on;
+            ShortMessage msg;
+        };
+
+        std::shared_ptr<Output>      output;
+        unsigned int                 beats_per_bar;
+        uint64_t                     seed;
+        std::chrono::microseconds    poll_interval;
+
+        std::mutex                   mutex;
+        std::condition_variable      wake;
+        bool                         rendering  = true;
+        std::vector<Entry>           entries;
+        uint64_t                     next_salt  = 0;
+        std::unique_ptr<Slot[]>      slots;
+        size_t                       slot_count;
+        std::vector<Event>           scratch;
+        size_t                       render_count = 0;
+        uint64_t                     unclaimed    = 0; // First bar whose NOTE OFF messages are not yet in held
+        std::vector<Pending>         held;             // NOTE OFF of notes started in claimed bars, not yet rendered
+
+        // Bar being played + 1, 0 before the first
+        std::atomic<uint64_t>        claimed;
+        std::atomic<double>          bpm;
+        std::atomic<size_t>          missed_count;
+        std::atomic<size_t>          failed_count;
+
+        std::mutex                   timing_mutex;
+        std::condition_variable      timing_wake;
+        bool                         playing    = false;
+        std::thread                  timer;
+        std::thread                  worker;
+
+        static void check(const Pattern& pattern);
+        uint32_t bar_ticks() const;
+        bool plays(const Entry& entry, uint64_t step) const;
+        bool touches(const Entry& entry, size_t step, float gate, uint64_t bar) const;
+        void mark_locked(size_t id, size_t step, float gate);
+        void mark_all_locked();
+        void absorb_locked();
+        void render_locked(Slot& slot, uint64_t bar);
+        void render();
+        void play(clock::time_point start);
+        void silence();
+
+    public:
+        /// @brief Disable empty constructor
+        PatternEngine() = delete;
+
+        /// @brief Disable copy constructor, the worker threads refer to this object
+        PatternEngine(const PatternEngine&) = delete;
+
+        /// @brief Disable copy assignment, the worker threads refer to this object
+        PatternEngine& operator=(const PatternEngine&) = delete;
+
+        /**
+         * @brief Allocate the bar buffers and start the rendering thread
+         *
+         * @param [in] output Connected output to play to
+         * @param [in] bpm Tempo in beats per minute
+         * @param [in] beats_per_bar Length of a bar, the unit rendered at once
+         * @param [in] lookahead Number of bar buffers, at least @c 2
+         * @param [in] seed Seed deciding which notes with a probability below @c 1 play
+         * @param [in] poll_interval How often the rendering thread checks whether the next bar started
+         *
+         * @throws std::invalid_argument if @b output is empty or any other parameter is out of range
+         * @throws std::system_error if the rendering thread could not be started
+         */
+        PatternEngine(std::shared_ptr<Output> output, double bpm = 120, unsigned int beats_per_bar = 4,
+                      size_t lookahead = 4, uint64_t seed = 0,
+                      std::chrono::microseconds poll_interval = std::chrono::milliseconds(10));
+
+        /// @brief Stops playing and rendering
+        ~PatternEngine();
+
+        /**
+         * @brief Add a pattern
+         *
+         * @returns Id of the pattern for later edits
+         *
+         * @throws std::invalid_argument if any setting of @b pattern is out of range
+         */
+        size_t add(Pattern pattern);
+
+        /**
+         * @brief Replace a pattern, re-rendering every bar not yet played
+         *
+         * @throws std::domain_error if @b id does not exist
+         * @throws std::invalid_argument if any setting of @b pattern is out of range
+         */
+        void set(size_t id, Pattern pattern);
+
+        /**
+         * @brief Replace one step of a pattern, re-rendering only the bars it plays in
+         *
+         * @throws std::domain_error if @b id or @b step does not exist
+         * @throws std::invalid_argument if any setting of @b value is out of range
+         */
+        void set_step(size_t id, size_t step, PatternStep value);
+
+        /**
+         * @brief Remove a pattern
+         *
+         * @throws std::domain_error if @b id does not exist
+         */
+        void remove(size_t id);
+
+        /**
+         * @brief Start playing from the first bar
+         *
+         * @param [in] at Time the first bar starts, leaving time to render it
+         *
+         * @throws std::logic_error if already playing
+         * @throws std::system_error if the timing thread could not be started
+         */
+        void start(clock::time_point at = clock::now());
+
+        /// @brief Stop playing and silence every channel, does nothing if not playing
+        void stop();
+
+        /**
+         * @brief Change the tempo from the next bar
+         *
+         * @throws std::invalid_argument if @b bpm is not positive
+         */
+        void set_tempo(double bpm);
+
+        /// @brief Current tempo in beats per minute
+        double tempo() const;
+
+        /// @brief Number of the bar playing, starting with @c 0
+        uint64_t bar() const;
+
+        /// @brief Number of bars rendered, including those rendered again after edits
+        size_t renders();
+
+        /// @brief Number of bars skipped because they were not rendered in time
+        size_t missed() const;
+
+        /// @brief Number of batches which the Output failed to send
+        size_t failed() const;
+};
+}
+
+#endif //_BRAGI_MIDI_V1_PATTERN_ENGINE_HPP_//
@@ -0,0 +1,73 @@
+#include <bragi/midi/v1/realtime.hpp>
+
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace bragi::midi::v1 {
+RealtimeOutput::RealtimeOutput(std::shared_ptr<Output> output, size_t capacity,
+                               std::chrono::microseconds poll_interval):
+        output(std::move(output)),
+        queue(capacity),
+        poll_interval(poll_interval),
+        running(true),
+        dropped_count(0),
+        failed_count(0)
+    {
+        if ( !this->output )
+            throw std::invalid_argument("No output!");
+
+        worker = std::thread(&RealtimeOutput::run, this);
+    }
+
+RealtimeOutput::~RealtimeOutput() {
+    running.store(false, std::memory_order_release);
+    worker.join();
+}
+
+void RealtimeOutput::drain() {
+    ShortMessage msg;
+
+    while ( queue.try_pop(msg) ) {
+        try {
+            output->send_msg(msg);
+        } catch ( std::exception& ) {
+            failed_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void RealtimeOutput::run() {
+    // The producer never signals, so waking up is left to polling
+    while ( running.load(std::memory_order_acquire) ) {
+        drain();
+        std::this_thread::sleep_for(poll_interval);
+    }
+
+    drain();
+}
+
+bool RealtimeOutput::send(const ShortMessage& msg) noexcept {
+    if ( msg.valid() && queue.try_push(msg) )
+        return true;
+
+    dropped_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool RealtimeOutput::note_on(uint8_t pitch, uint8_t velocity, uint8_t channel) noexcept {
+    return send(channel > 15 ? ShortMessage() : ShortMessage(MessageType::note_on | channel, pitch, velocity));
+}
+
+bool RealtimeOutput::note_off(uint8_t pitch, uint8_t velocity, uint8_t channel) noexcept {
+    return send(channel > 15 ? ShortMessage() : ShortMessage(MessageType::note_off | channel, pitch, velocity));
+}
+
+size_t RealtimeOutput::dropped() const noexcept {
+    return dropped_count.load(std::memory_order_relaxed);
+}
+
+size_t RealtimeOutput::failed() const noexcept {
+    return failed_count.load(std::memory_order_relaxed);
+}
+}
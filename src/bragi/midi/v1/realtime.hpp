@@ -0,0 +1,110 @@
+/**
+ * @file realtime.hpp
+ * @brief Sending MIDI from real-time threads such as audio callbacks
+ *
+ * Output::send_msg() builds a Message, which allocates, and takes a blocking mutex, while Note also touches the
+ * reference counts of a weak pointer. None of these belong in an audio callback.
+ *
+ * In real-time mode the callback only calls RealtimeOutput::send() and friends. These copy a ShortMessage into a
+ * queue allocated up front and return, without allocating, locking, making system calls or throwing. A worker
+ * thread owned by the RealtimeOutput drains the queue into the Output, so driver latency and errors stay off the
+ * real-time thread.
+ */
+#ifndef _BRAGI_MIDI_V1_REALTIME_HPP_
+#define _BRAGI_MIDI_V1_REALTIME_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include <bragi/midi/v1/constants.hpp>
+#include <bragi/midi/v1/output.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+#include <bragi/midi/v1/spsc_ring.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Real-time-safe front end for an Output
+ *
+ * The sending functions must only be called from a single thread, typically the audio callback. They are wait-free
+ * and report a full queue or an invalid message by returning false rather than throwing.
+ *
+ * @code
+ * RealtimeOutput rt(output, 4096);
+ *
+ * // Inside the audio callback
+ * rt.note_on(middle_c);
+ * @endcode
+ */
+class RealtimeOutput {
+    protected:
+        std::shared_ptr<Output>   output;
+        SpscRing<ShortMessage>    queue;
+        std::chrono::microseconds poll_interval;
+        std::atomic<bool>         running;
+        std::atomic<size_t>       dropped_count;
+        std::atomic<size_t>       failed_count;
+        std::thread               worker;
+
+        void run();
+        void drain();
+
+    public:
+        /// @brief Disable empty constructor
+        RealtimeOutput() = delete;
+
+        /// @brief Disable copy constructor, the worker thread refers to this object
+        RealtimeOutput(const RealtimeOutput&) = delete;
+
+        /// @brief Disable copy assignment, the worker thread refers to this object
+        RealtimeOutput& operator=(const RealtimeOutput&) = delete;
+
+        /**
+         * @brief Allocate the queue and start the worker thread
+         *
+         * @param [in] output Connected output to drain messages into
+         * @param [in] capacity Number of messages which can be queued, rounded up to a power of 2
+         * @param [in] poll_interval How long the worker sleeps once the queue is empty
+         *
+         * @throws std::invalid_argument if @b output is empty
+         * @throws std::system_error if the worker thread could not be started
+         */
+        RealtimeOutput(std::shared_ptr<Output> output, size_t capacity = 1024,
+                       std::chrono::microseconds poll_interval = std::chrono::microseconds(250));
+
+        /// @brief Sends anything still queued, then stops the worker thread
+        ~RealtimeOutput();
+
+        /**
+         * @brief Queue a message
+         *
+         * @returns false if the message is invalid or the queue is full
+         */
+        bool send(const ShortMessage& msg) noexcept;
+
+        /**
+         * @brief Queue a NOTE ON message
+         *
+         * @returns false if any parameter is out of range or the queue is full
+         */
+        bool note_on(uint8_t pitch, uint8_t velocity = max_velocity, uint8_t channel = 0) noexcept;
+
+        /**
+         * @brief Queue a NOTE OFF message
+         *
+         * @returns false if any parameter is out of range or the queue is full
+         */
+        bool note_off(uint8_t pitch, uint8_t velocity = max_velocity, uint8_t channel = 0) noexcept;
+
+        /// @brief Number of messages rejected by send() because they were invalid or the queue was full
+        size_t dropped() const noexcept;
+
+        /// @brief Number of queued messages which the Output failed to send
+        size_t failed() const noexcept;
+};
+}
+
+#endif //_BRAGI_MIDI_V1_REALTIME_HPP_//
@@ -0,0 +1,1043 @@
+#include <bragi/midi/v1/rtp_midi.hpp>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace bragi::midi::v1 {
+/********************************/
+/* Sockets                      */
+/********************************/
+#ifdef _WIN32
+using socket_t = SOCKET;
+constexpr static socket_t invalid_socket = INVALID_SOCKET;
+
+static int socket_error() {
+    return ::WSAGetLastError();
+}
+
+static void close_socket(socket_t sock) {
+    ::closesocket(sock);
+}
+
+// WSAStartup() counts its callers, so every session starts and cleans up its own reference
+struct SocketLibrary {
+    SocketLibrary() {
+        WSADATA info;
+        int     err = ::WSAStartup(MAKEWORD(2, 2), &info);
+        if ( err != 0 )
+            throw std::system_error(std::error_code(err, std::system_category()));
+    }
+
+    ~SocketLibrary() {
+        ::WSACleanup();
+    }
+};
+#else
+using socket_t = int;
+constexpr static socket_t invalid_socket = -1;
+
+static int socket_error() {
+    return errno;
+}
+
+static void close_socket(socket_t sock) {
+    ::close(sock);
+}
+
+struct SocketLibrary {};
+#endif
+
+static std::system_error socket_failure() {
+    return std::system_error(std::error_code(socket_error(), std::system_category()));
+}
+
+static socket_t open_udp(uint16_t port) {
+    socket_t sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if ( sock == invalid_socket )
+        throw socket_failure();
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+
+    if ( ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ) {
+        std::system_error err = socket_failure();
+        close_socket(sock);
+        throw err;
+    }
+
+    return sock;
+}
+
+static sockaddr_in resolve(const std::string& host, uint16_t port) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    addrinfo* found = nullptr;
+    if ( ::getaddrinfo(host.c_str(), nullptr, &hints, &found) != 0 || !found )
+        throw std::invalid_argument("Could not resolve host!");
+
+    sockaddr_in addr;
+    std::memcpy(&addr, found->ai_addr, sizeof(addr));
+    addr.sin_port = htons(port);
+    ::freeaddrinfo(found);
+    return addr;
+}
+
+static bool same_host(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr;
+}
+
+/********************************/
+/* Wire format                  */
+/********************************/
+constexpr static uint8_t  rtp_version      = 0x80;
+constexpr static uint8_t  rtp_payload_type = 0x61;
+constexpr static uint32_t apple_version    = 2;
+
+// Command lists are kept well below a typical MTU, so a packet is never fragmented
+constexpr static size_t max_commands = 1024;
+
+// Bits of the MIDI command section header
+constexpr static uint8_t long_header   = 0x80;
+constexpr static uint8_t journal_flag  = 0x40;
+constexpr static uint8_t first_delta   = 0x20;
+
+// Bits of the recovery journal header, and the table of contents of a channel journal
+constexpr static uint8_t system_journal   = 0x40;
+constexpr static uint8_t channel_journals = 0x20;
+constexpr static uint8_t chapter_p        = 0x80;
+constexpr static uint8_t chapter_c        = 0x40;
+constexpr static uint8_t chapter_m        = 0x20;
+constexpr static uint8_t chapter_w        = 0x10;
+constexpr static uint8_t chapter_n        = 0x08;
+
+constexpr static uint16_t apple_command(char a, char b) {
+    return static_cast<uint16_t>(static_cast<uint8_t>(a) << 8 | static_cast<uint8_t>(b));
+}
+
+constexpr static uint16_t invitation          = apple_command('I', 'N');
+constexpr static uint16_t invitation_accepted = apple_command('O', 'K');
+constexpr static uint16_t invitation_rejected = apple_command('N', 'O');
+constexpr static uint16_t end_session         = apple_command('B', 'Y');
+constexpr static uint16_t synchronization     = apple_command('C', 'K');
+constexpr static uint16_t receiver_feedback   = apple_command('R', 'S');
+
+static void put16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(value >> 8 & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+static void put32(std::vector<uint8_t>& out, uint32_t value) {
+    put16(out, value >> 16 & 0xFFFF);
+    put16(out, value & 0xFFFF);
+}
+
+static void put64(std::vector<uint8_t>& out, uint64_t value) {
+    put32(out, value >> 32 & 0xFFFFFFFF);
+    put32(out, value & 0xFFFFFFFF);
+}
+
+static uint16_t get16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+static uint32_t get32(const uint8_t* data) {
+    return static_cast<uint32_t>(get16(data)) << 16 | get16(data + 2);
+}
+
+static uint64_t get64(const uint8_t* data) {
+    return static_cast<uint64_t>(get32(data)) << 32 | get32(data + 4);
+}
+
+/// @brief Compare sequence numbers which wrap around
+static bool seq_before(uint16_t a, uint16_t b) {
+    return static_cast<int16_t>(a - b) < 0;
+}
+
+/********************************/
+/* Impl                         */
+/********************************/
+enum class SessionState { idle, inviting_control, inviting_data, accepting, connected };
+
+/**
+ * @brief What the recovery journal knows about one note
+ *
+ * @b dirty marks a change in a packet the peer has not yet confirmed, @b seq is the packet of the latest change.
+ */
+struct NoteState {
+    bool     on       = false;
+    bool     dirty    = false;
+    uint8_t  velocity = 0;
+    uint16_t seq      = 0;
+};
+
+/// @brief A NOTE ON or NOTE OFF in the current batch, applied to the journal once the batch is sent
+struct NoteChange {
+    uint8_t channel;
+    uint8_t pitch;
+    uint8_t velocity; // 0 for NOTE OFF
+};
+
+struct RtpMidiSession::Impl {
+    using clock = std::chrono::steady_clock;
+
+    SocketLibrary             library;
+    std::string               name;
+    uint16_t                  port;
+    std::chrono::microseconds batch_interval;
+    socket_t                  control = invalid_socket;
+    socket_t                  data    = invalid_socket;
+    uint32_t                  ssrc;
+    clock::time_point         start = clock::now();
+
+    mutable std::mutex      mutex;
+    std::condition_variable state_changed;
+    std::condition_variable batch_started;
+    SessionState            state     = SessionState::idle;
+    bool                    initiator = false;
+    bool                    rejected  = false;
+    uint32_t                token     = 0;
+    uint32_t                peer_ssrc = 0;
+    sockaddr_in             peer_control;
+    sockaddr_in             peer_data;
+    clock::time_point       last_sync;
+
+    // Sending
+    std::vector<uint8_t>                     commands;
+    std::vector<NoteChange>                  batch_notes;
+    std::vector<uint8_t>                     packet;
+    clock::time_point                        batch_since;
+    uint32_t                                 batch_time     = 0;
+    uint32_t                                 last_time      = 0;
+    uint8_t                                  running_status = 0;
+    uint16_t                                 send_seq       = 0;
+    uint16_t                                 checkpoint     = 0;
+    std::array<std::array<NoteState, 128>, 16> notes;
+
+    // Receiving
+    bool                               have_seq      = false;
+    uint16_t                           expected_seq  = 0;
+    uint16_t                           received_seq  = 0;
+    bool                               feedback_due  = false;
+    clock::time_point                  last_feedback;
+    std::array<std::bitset<128>, 16>   sounding;
+    std::function<void(const Message&)> receiver;
+
+    RtpMidiStats      stats;
+    std::atomic<bool> active{true};
+    std::mt19937      random{std::random_device{}()};
+    std::thread       listener;
+    std::thread       sender;
+
+    Impl(const std::string& name, uint16_t port, std::chrono::microseconds batch_interval):
+            name(name),
+            port(port),
+            batch_interval(batch_interval)
+        {
+            if ( port == 0 || port == 0xFFFF )
+                throw std::invalid_argument("Control port must leave room for the data port!");
+
+            std::memset(&peer_control, 0, sizeof(peer_control));
+            std::memset(&peer_data, 0, sizeof(peer_data));
+            ssrc = random();
+
+            try {
+                control  = open_udp(port);
+                data     = open_udp(port + 1);
+                listener = std::thread(&Impl::listen, this);
+                sender   = std::thread(&Impl::send_batches, this);
+            } catch ( ... ) {
+                stop();
+                throw;
+            }
+        }
+
+    ~Impl() {
+        try {
+            end();
+        } catch ( std::exception& ) {
+        }
+        stop();
+    }
+
+    void stop() {
+        active = false;
+        batch_started.notify_all();
+        if ( listener.joinable() )
+            listener.join();
+        if ( sender.joinable() )
+            sender.join();
+        if ( control != invalid_socket )
+            close_socket(control);
+        if ( data != invalid_socket )
+            close_socket(data);
+        control = invalid_socket;
+        data    = invalid_socket;
+    }
+
+    /// @brief Current time in RTP timestamp units of 100 microseconds
+    uint64_t now_ticks() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count() / 100;
+    }
+
+    void send_to(socket_t sock, const sockaddr_in& addr, const std::vector<uint8_t>& bytes) {
+        int sent = ::sendto(sock, reinterpret_cast<const char*>(bytes.data()), static_cast<int>(bytes.size()), 0,
+                            reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+        if ( sent < 0 )
+            throw socket_failure();
+    }
+
+    /****************************/
+    /* Session control          */
+    /****************************/
+    void send_session(socket_t sock, const sockaddr_in& addr, uint16_t command, uint32_t command_token) {
+        std::vector<uint8_t> bytes = {0xFF, 0xFF};
+        put16(bytes, command);
+        put32(bytes, apple_version);
+        put32(bytes, command_token);
+        put32(bytes, ssrc);
+        if ( command == invitation || command == invitation_accepted ) {
+            bytes.insert(bytes.end(), name.begin(), name.end());
+            bytes.push_back(0);
+        }
+        send_to(sock, addr, bytes);
+    }
+
+    void send_sync(uint8_t count, uint64_t ts1, uint64_t ts2, uint64_t ts3) {
+        std::vector<uint8_t> bytes = {0xFF, 0xFF};
+        put16(bytes, synchronization);
+        put32(bytes, ssrc);
+        bytes.push_back(count);
+        bytes.insert(bytes.end(), 3, 0);
+        put64(bytes, ts1);
+        put64(bytes, ts2);
+        put64(bytes, ts3);
+        send_to(data, peer_data, bytes);
+    }
+
+    void send_feedback() {
+        std::vector<uint8_t> bytes = {0xFF, 0xFF};
+        put16(bytes, receiver_feedback);
+        put32(bytes, ssrc);
+        put16(bytes, received_seq);
+        put16(bytes, 0);
+        send_to(control, peer_control, bytes);
+    }
+
+    void invite(const std::string& host, uint16_t peer_port, std::chrono::milliseconds timeout) {
+        sockaddr_in addr = resolve(host, peer_port);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if ( state != SessionState::idle )
+            throw std::logic_error("Session already established!");
+
+        state        = SessionState::inviting_control;
+        initiator    = true;
+        rejected     = false;
+        token        = random();
+        peer_control = addr;
+        peer_data    = addr;
+        peer_data.sin_port = htons(peer_port + 1);
+
+        clock::time_point deadline = clock::now() + timeout;
+        while ( state == SessionState::inviting_control || state == SessionState::inviting_data ) {
+            if ( clock::now() >= deadline ) {
+                state = SessionState::idle;
+                throw std::runtime_error("Invitation timed out!");
+            }
+
+            if ( state == SessionState::inviting_control )
+                send_session(control, peer_control, invitation, token);
+            else
+                send_session(data, peer_data, invitation, token);
+
+            state_changed.wait_until(lock, std::min(deadline, clock::now() + std::chrono::milliseconds(500)));
+        }
+
+        if ( rejected )
+            throw std::runtime_error("Invitation rejected!");
+        if ( state != SessionState::connected )
+            throw std::runtime_error("Session ended while inviting!");
+
+        last_sync = clock::now();
+        send_sync(0, now_ticks(), 0, 0);
+    }
+
+    void end() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if ( state == SessionState::connected || state == SessionState::accepting )
+            send_session(control, peer_control, end_session, token);
+        state = SessionState::idle;
+        state_changed.notify_all();
+    }
+
+    /// @brief Reset the stream state once both ports are connected
+    void established() {
+        state          = SessionState::connected;
+        send_seq       = static_cast<uint16_t>(random());
+        checkpoint     = send_seq;
+        running_status = 0;
+        have_seq       = false;
+        feedback_due   = false;
+        commands.clear();
+        batch_notes.clear();
+        for ( std::array<NoteState, 128>& channel : notes )
+            channel.fill(NoteState());
+        for ( std::bitset<128>& channel : sounding )
+            channel.reset();
+        state_changed.notify_all();
+    }
+
+    void handle_session(bool on_control, const uint8_t* bytes, size_t size, const sockaddr_in& from,
+                        std::vector<Message>& delivered) {
+        uint16_t command = get16(bytes + 2);
+
+        if ( command == synchronization ) {
+            if ( size < 36 || state != SessionState::connected || get32(bytes + 4) != peer_ssrc )
+                return;
+            if ( bytes[8] == 0 )
+                send_sync(1, get64(bytes + 12), now_ticks(), 0);
+            else if ( bytes[8] == 1 )
+                send_sync(2, get64(bytes + 12), get64(bytes + 20), now_ticks());
+            return;
+        }
+
+        if ( command == receiver_feedback ) {
+            if ( size < 10 || state != SessionState::connected || get32(bytes + 4) != peer_ssrc )
+                return;
+            confirmed(get16(bytes + 8));
+            return;
+        }
+
+        if ( size < 16 )
+            return;
+
+        uint32_t their_token = get32(bytes + 8);
+        uint32_t their_ssrc  = get32(bytes + 12);
+        socket_t sock        = on_control ? control : data;
+
+        if ( command == invitation ) {
+            bool same_peer = state != SessionState::idle && their_ssrc == peer_ssrc && same_host(from, peer_control);
+
+            if ( on_control && (state == SessionState::idle || same_peer) && state != SessionState::connected ) {
+                state        = SessionState::accepting;
+                initiator    = false;
+                token        = their_token;
+                peer_ssrc    = their_ssrc;
+                peer_control = from;
+                send_session(sock, from, invitation_accepted, token);
+            } else if ( !on_control && same_peer && state == SessionState::accepting ) {
+                peer_data = from;
+                send_session(sock, from, invitation_accepted, token);
+                established();
+            } else if ( same_peer && state == SessionState::connected ) {
+                // Our answer was lost, the peer is asking again
+                send_session(sock, from, invitation_accepted, token);
+            } else {
+                send_session(sock, from, invitation_rejected, their_token);
+            }
+        } else if ( command == invitation_accepted && their_token == token ) {
+            if ( on_control && state == SessionState::inviting_control ) {
+                peer_ssrc    = their_ssrc;
+                peer_control = from;
+                state        = SessionState::inviting_data;
+                state_changed.notify_all();
+            } else if ( !on_control && state == SessionState::inviting_data && their_ssrc == peer_ssrc ) {
+                peer_data = from;
+                established();
+            }
+        } else if ( command == invitation_rejected && their_token == token ) {
+            if ( state == SessionState::inviting_control || state == SessionState::inviting_data ) {
+                state    = SessionState::idle;
+                rejected = true;
+                state_changed.notify_all();
+            }
+        } else if ( command == end_session && state != SessionState::idle && their_ssrc == peer_ssrc ) {
+            // Nothing will turn off the notes the peer left sounding
+            release_all(delivered);
+            state = SessionState::idle;
+            state_changed.notify_all();
+        }
+    }
+
+    /****************************/
+    /* Sending                  */
+    /****************************/
+    void append(const uint8_t* bytes, size_t size) {
+        if ( state != SessionState::connected )
+            throw std::logic_error("No session established!");
+
+        if ( !commands.empty() && commands.size() + size + 4 > max_commands )
+            flush();
+
+        uint32_t now = static_cast<uint32_t>(now_ticks());
+        if ( commands.empty() ) {
+            batch_time  = now;
+            batch_since = clock::now();
+            batch_started.notify_one();
+        } else {
+            // Delta time since the previous command, 7 bits per byte with the top bit marking more to follow
+            uint32_t delta = std::min<uint32_t>(now - last_time, 0x0FFFFFFF);
+            for ( int shift = 21; shift > 0; shift -= 7 )
+                if ( delta >> shift )
+                    commands.push_back(0x80 | (delta >> shift & 0x7F));
+            commands.push_back(delta & 0x7F);
+        }
+        last_time = now;
+
+        uint8_t status = bytes[0];
+        if ( status >= 0xF0 || status != running_status )
+            commands.push_back(status);
+        commands.insert(commands.end(), bytes + 1, bytes + size);
+
+        if ( status < 0xF0 )
+            running_status = status;
+        else if ( status < 0xF8 )
+            running_status = 0;
+
+        uint8_t type = status & 0xF0;
+        if ( (type == MessageType::note_on || type == MessageType::note_off) && size == 3 )
+            batch_notes.push_back({static_cast<uint8_t>(status & 0x0F), bytes[1],
+                                   type == MessageType::note_on ? bytes[2] : static_cast<uint8_t>(0)});
+    }
+
+    /**
+     * @brief Append the recovery journal, covering every packet since the checkpoint up to the previous one
+     *
+     * All S bits are left clear, so a receiver always processes the whole journal.
+     */
+    void append_journal(std::vector<uint8_t>& out) {
+        size_t header_at = out.size();
+        out.insert(out.end(), 3, 0);
+
+        int channels = 0;
+        for ( uint8_t channel = 0; channel < 16; channel++ ) {
+            std::array<NoteState, 128>& channel_notes = notes[channel];
+
+            int logs = 0;
+            int low  = 16;
+            int high = -1;
+            for ( int pitch = 0; pitch < 128; pitch++ ) {
+                if ( !channel_notes[pitch].dirty )
+                    continue;
+                if ( channel_notes[pitch].on ) {
+                    logs++;
+                } else {
+                    low  = std::min(low, pitch / 8);
+                    high = std::max(high, pitch / 8);
+                }
+            }
+            if ( logs == 0 && high < 0 )
+                continue;
+
+            // A LOW greater than HIGH means there are no OFFBITS
+            if ( high < 0 ) {
+                low  = 1;
+                high = 0;
+            }
+
+            size_t channel_at = out.size();
+            out.insert(out.end(), 2, 0);
+            out.push_back(chapter_n);
+
+            logs = std::min(logs, 127);
+            out.push_back(static_cast<uint8_t>(logs));
+            out.push_back(static_cast<uint8_t>(low << 4 | high));
+
+            int logged = 0;
+            for ( int pitch = 0; pitch < 128 && logged < logs; pitch++ ) {
+                if ( channel_notes[pitch].dirty && channel_notes[pitch].on ) {
+                    out.push_back(static_cast<uint8_t>(pitch));
+                    out.push_back(0x80 | channel_notes[pitch].velocity);
+                    logged++;
+                }
+            }
+
+            for ( int octet = low; octet <= high; octet++ ) {
+                uint8_t bits = 0;
+                for ( int bit = 0; bit < 8; bit++ ) {
+                    const NoteState& note = channel_notes[octet * 8 + bit];
+                    if ( note.dirty && !note.on )
+                        bits |= 0x80 >> bit;
+                }
+                out.push_back(bits);
+            }
+
+            size_t length     = out.size() - channel_at;
+            out[channel_at]     = static_cast<uint8_t>(channel << 3 | (length >> 8 & 0x03));
+            out[channel_at + 1] = static_cast<uint8_t>(length & 0xFF);
+            channels++;
+        }
+
+        out[header_at]     = channels ? static_cast<uint8_t>(channel_journals | (channels - 1)) : 0;
+        out[header_at + 1] = checkpoint >> 8 & 0xFF;
+        out[header_at + 2] = checkpoint & 0xFF;
+    }
+
+    void flush() {
+        if ( commands.empty() )
+            return;
+
+        packet.clear();
+        packet.push_back(rtp_version);
+        packet.push_back(rtp_payload_type);
+        put16(packet, send_seq);
+        put32(packet, batch_time);
+        put32(packet, ssrc);
+
+        size_t length = commands.size();
+        if ( length <= 0x0F ) {
+            packet.push_back(static_cast<uint8_t>(journal_flag | length));
+        } else {
+            packet.push_back(static_cast<uint8_t>(long_header | journal_flag | length >> 8));
+            packet.push_back(static_cast<uint8_t>(length & 0xFF));
+        }
+        packet.insert(packet.end(), commands.begin(), commands.end());
+        append_journal(packet);
+
+        // Update the journal even if sending fails, so the next packet lets the peer recover this one
+        uint16_t seq = send_seq++;
+        for ( const NoteChange& change : batch_notes ) {
+            NoteState& note = notes[change.channel][change.pitch];
+            note.on         = change.velocity != 0;
+            note.velocity   = change.velocity;
+            note.dirty      = true;
+            note.seq        = seq;
+        }
+        commands.clear();
+        batch_notes.clear();
+        running_status = 0;
+
+        stats.packets_sent++;
+        send_to(data, peer_data, packet);
+    }
+
+    /// @brief The peer has received every packet up to @b seq, so they no longer need to be journalled
+    void confirmed(uint16_t seq) {
+        uint16_t next = seq + 1;
+        if ( seq_before(next, checkpoint) || !seq_before(seq, send_seq) )
+            return;
+
+        for ( std::array<NoteState, 128>& channel : notes )
+            for ( NoteState& note : channel )
+                if ( note.dirty && !seq_before(seq, note.seq) )
+                    note.dirty = false;
+        checkpoint = next;
+    }
+
+    void send_batches() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while ( active ) {
+            clock::time_point now = clock::now();
+            clock::time_point wake = commands.empty() ? now + std::chrono::milliseconds(100)
+                                   : batch_since + batch_interval;
+            batch_started.wait_until(lock, wake);
+            if ( !active )
+                return;
+
+            now = clock::now();
+            if ( state != SessionState::connected )
+                continue;
+
+            try {
+                if ( !commands.empty() && now >= batch_since + batch_interval )
+                    flush();
+
+                if ( feedback_due && now - last_feedback >= std::chrono::milliseconds(100) ) {
+                    send_feedback();
+                    feedback_due  = false;
+                    last_feedback = now;
+                }
+
+                if ( initiator && now - last_sync >= std::chrono::seconds(10) ) {
+                    send_sync(0, now_ticks(), 0, 0);
+                    last_sync = now;
+                }
+            } catch ( std::system_error& ) {
+                // A packet which failed to send counts as lost, the journal of the next one covers it
+            }
+        }
+    }
+
+    /****************************/
+    /* Receiving                */
+    /****************************/
+    void release(uint8_t channel, uint8_t pitch, std::vector<Message>& delivered) {
+        sounding[channel].reset(pitch);
+        delivered.push_back(note_off(pitch, 0, channel));
+        stats.notes_recovered++;
+    }
+
+    void release_all(std::vector<Message>& delivered) {
+        for ( uint8_t channel = 0; channel < 16; channel++ )
+            for ( uint8_t pitch = 0; pitch < 128; pitch++ )
+                if ( sounding[channel].test(pitch) )
+                    release(channel, pitch, delivered);
+    }
+
+    /**
+     * @brief Release every sounding note the journal says was turned off in the lost packets
+     *
+     * Notes turned on in lost packets are not played, since they would sound late.
+     */
+    void recover(const uint8_t* pos, const uint8_t* end, std::vector<Message>& delivered) {
+        if ( end - pos < 3 )
+            return release_all(delivered);
+
+        uint8_t  header      = pos[0];
+        uint16_t covers_from = get16(pos + 1);
+        pos += 3;
+
+        if ( seq_before(expected_seq, covers_from) )
+            return release_all(delivered);
+
+        if ( header & system_journal ) {
+            if ( end - pos < 2 )
+                return;
+            pos += (pos[0] & 0x03) << 8 | pos[1];
+        }
+
+        if ( !(header & channel_journals) )
+            return;
+
+        for ( int i = 0; i <= (header & 0x0F); i++ ) {
+            if ( end - pos < 3 )
+                return;
+
+            uint8_t        channel     = pos[0] >> 3 & 0x0F;
+            size_t         length      = (pos[0] & 0x03) << 8 | pos[1];
+            uint8_t        toc         = pos[2];
+            const uint8_t* channel_end = pos + length;
+            if ( length < 3 || channel_end > end )
+                return;
+
+            const uint8_t* chapter = pos + 3;
+            if ( toc & chapter_p )
+                chapter += 3;
+            if ( (toc & chapter_c) && chapter < channel_end )
+                chapter += 1 + 2 * ((chapter[0] & 0x7F) + 1);
+            if ( (toc & chapter_m) && chapter + 2 <= channel_end )
+                chapter += (chapter[0] & 0x03) << 8 | chapter[1];
+            if ( toc & chapter_w )
+                chapter += 2;
+
+            if ( (toc & chapter_n) && chapter + 2 <= channel_end ) {
+                int logs = chapter[0] & 0x7F;
+                int low  = chapter[1] >> 4;
+                int high = chapter[1] & 0x0F;
+                if ( logs == 127 && low == 15 && high == 0 )
+                    logs = 128;
+                chapter += 2;
+
+                std::bitset<128> logged;
+                for ( int log = 0; log < logs && chapter + 2 <= channel_end; log++, chapter += 2 )
+                    logged.set(chapter[0] & 0x7F);
+
+                for ( int octet = low; octet <= high && chapter < channel_end; octet++, chapter++ )
+                    for ( int bit = 0; bit < 8; bit++ ) {
+                        uint8_t pitch = static_cast<uint8_t>(octet * 8 + bit);
+                        if ( (chapter[0] & 0x80 >> bit) && !logged.test(pitch) && sounding[channel].test(pitch) )
+                            release(channel, pitch, delivered);
+                    }
+            }
+
+            pos = channel_end;
+        }
+    }
+
+    void read_commands(const uint8_t* pos, const uint8_t* end, bool has_first_delta,
+                       std::vector<Message>& delivered) {
+        uint8_t running = 0;
+
+        for ( bool first = true; pos < end; first = false ) {
+            if ( !first || has_first_delta ) {
+                for ( int i = 0; i < 4 && pos < end && (*pos++ & 0x80); i++ ) {}
+                if ( pos >= end )
+                    return;
+            }
+
+            uint8_t status = running;
+            if ( *pos & 0x80 )
+                status = *pos++;
+            if ( !status )
+                return;
+
+            if ( status == MessageType::system_exclusive ) {
+                const uint8_t* stop = pos;
+                while ( stop < end && *stop != MessageType::end_of_system_exclusive && *stop != 0xF0 && *stop != 0xF4 )
+                    stop++;
+                if ( stop >= end )
+                    return;
+
+                // Only complete messages are delivered, segments of longer ones are skipped
+                if ( *stop == MessageType::end_of_system_exclusive )
+                    delivered.push_back(Message::system_exclusive(std::basic_string<uint8_t>(pos, stop)));
+                pos     = stop + 1;
+                running = 0;
+                continue;
+            }
+
+            size_t size = short_message_size(status);
+            if ( size == 0 || static_cast<size_t>(end - pos) < size - 1 )
+                return;
+
+            ShortMessage msg(status, size > 1 ? pos[0] : 0, size > 2 ? pos[1] : 0);
+            pos += size - 1;
+            if ( !msg.valid() )
+                return;
+
+            if ( status < 0xF0 )
+                running = status;
+            else if ( status < 0xF8 )
+                running = 0;
+
+            uint8_t type    = status & 0xF0;
+            uint8_t channel = status & 0x0F;
+            if ( type == MessageType::note_on && msg.data2() )
+                sounding[channel].set(msg.data1());
+            else if ( type == MessageType::note_on || type == MessageType::note_off )
+                sounding[channel].reset(msg.data1());
+
+            delivered.push_back(msg.to_message());
+        }
+    }
+
+    void handle_packet(const uint8_t* bytes, size_t size, std::vector<Message>& delivered) {
+        if ( state != SessionState::connected || size < 13 || (bytes[0] & 0xC0) != rtp_version
+             || (bytes[1] & 0x7F) != rtp_payload_type || get32(bytes + 8) != peer_ssrc )
+            return;
+
+        uint16_t       seq = get16(bytes + 2);
+        const uint8_t* pos = bytes + 12 + 4 * (bytes[0] & 0x0F);
+        const uint8_t* end = bytes + size;
+        if ( pos >= end )
+            return;
+
+        uint8_t flags  = *pos;
+        size_t  length = flags & 0x0F;
+        if ( flags & long_header ) {
+            if ( end - pos < 2 )
+                return;
+            length = length << 8 | pos[1];
+            pos += 2;
+        } else {
+            pos += 1;
+        }
+        if ( static_cast<size_t>(end - pos) < length )
+            return;
+
+        if ( have_seq && seq_before(seq, expected_seq) )
+            return;
+
+        if ( have_seq && seq != expected_seq ) {
+            stats.packets_lost += static_cast<uint16_t>(seq - expected_seq);
+            if ( flags & journal_flag )
+                recover(pos + length, end, delivered);
+            else
+                release_all(delivered);
+        }
+
+        have_seq     = true;
+        expected_seq = seq + 1;
+        received_seq = seq;
+        feedback_due = true;
+        stats.packets_received++;
+
+        read_commands(pos, pos + length, flags & first_delta, delivered);
+    }
+
+    void listen() {
+        std::vector<uint8_t> buffer(65536);
+        std::vector<Message> delivered;
+
+        while ( active ) {
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(control, &readable);
+            FD_SET(data, &readable);
+
+            // Wake up regularly to notice the session being destroyed
+            timeval timeout = {0, 50000};
+            int     ready   = ::select(static_cast<int>(std::max(control, data) + 1), &readable, nullptr, nullptr,
+                                       &timeout);
+            if ( ready <= 0 )
+                continue;
+
+            std::function<void(const Message&)> deliver;
+
+            // Data first, so packets sent just before the session ended are not dropped
+            for ( socket_t sock : {data, control} ) {
+                if ( !FD_ISSET(sock, &readable) )
+                    continue;
+
+                sockaddr_in from;
+                socklen_t   from_size = sizeof(from);
+                int received = ::recvfrom(sock, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()),
+                                          0, reinterpret_cast<sockaddr*>(&from), &from_size);
+                if ( received < 4 )
+                    continue;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                try {
+                    if ( buffer[0] == 0xFF && buffer[1] == 0xFF )
+                        handle_session(sock == control, buffer.data(), received, from, delivered);
+                    else if ( sock == data )
+                        handle_packet(buffer.data(), received, delivered);
+                } catch ( std::exception& ) {
+                    // Answers which fail to send are retried by the peer
+                }
+                deliver = receiver;
+            }
+
+            // The receiver is called without the lock held, so it may send through this session
+            if ( deliver )
+                for ( const Message& msg : delivered )
+                    deliver(msg);
+            delivered.clear();
+        }
+    }
+};
+
+void RtpMidiSession::ImplCleanup::operator()(Impl* ptr) const {
+    if ( ptr )
+        delete ptr;
+}
+
+/********************************/
+/* RtpMidiSession               */
+/********************************/
+RtpMidiSession::RtpMidiSession(const std::string& name, uint16_t control_port,
+                               std::chrono::microseconds batch_interval) {
+    pimpl.reset(new Impl(name, control_port, batch_interval));
+}
+
+RtpMidiSession::~RtpMidiSession() = default;
+
+void RtpMidiSession::invite(const std::string& host, uint16_t control_port, std::chrono::milliseconds timeout) {
+    pimpl->invite(host, control_port, timeout);
+}
+
+bool RtpMidiSession::connected() const {
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    return pimpl->state == SessionState::connected;
+}
+
+void RtpMidiSession::end() {
+    pimpl->end();
+}
+
+void RtpMidiSession::send(const ShortMessage& msg) {
+    if ( !msg.valid() )
+        throw std::invalid_argument("Invalid message!");
+
+    uint8_t bytes[3] = {msg.status(), msg.data1(), msg.data2()};
+
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    pimpl->append(bytes, msg.size());
+}
+
+void RtpMidiSession::send(const Message& msg) {
+    std::basic_string<uint8_t> bytes = msg.validate().serialize();
+    if ( bytes.size() > max_commands - 4 )
+        throw std::length_error("Message too long for a packet!");
+
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    pimpl->append(bytes.data(), bytes.size());
+}
+
+void RtpMidiSession::flush() {
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    pimpl->flush();
+}
+
+void RtpMidiSession::set_receiver(std::function<void(const Message&)> receiver) {
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    pimpl->receiver = std::move(receiver);
+}
+
+uint16_t RtpMidiSession::control_port() const {
+    return pimpl->port;
+}
+
+RtpMidiStats RtpMidiSession::stats() const {
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    return pimpl->stats;
+}
+
+/********************************/
+/* RtpMidiOutput                */
+/********************************/
+RtpMidiOutput::RtpMidiOutput(std::shared_ptr<RtpMidiSession> session): session(std::move(session)) {
+    if ( !this->session )
+        throw std::invalid_argument("Session must not be empty!");
+}
+
+void RtpMidiOutput::connect() {
+    if ( open )
+        throw std::logic_error("Already connected!");
+    open = true;
+}
+
+void RtpMidiOutput::disconnect() {
+    if ( open )
+        session->flush();
+    open = false;
+}
+
+void RtpMidiOutput::send_short(uint8_t status, uint8_t data1, uint8_t data2) {
+    if ( !open )
+        throw std::logic_error("Not connected!");
+    session->send(ShortMessage(status, data1, data2));
+}
+
+void RtpMidiOutput::send_long(const uint8_t* data, size_t size) {
+    if ( !open )
+        throw std::logic_error("Not connected!");
+    session->send(Message::parse(std::basic_string<uint8_t>(data, size)));
+}
+
+bool RtpMidiOutput::physical_device() const {
+    return false;
+}
+
+uint16_t RtpMidiOutput::manufacturer_id() const {
+    return 0;
+}
+
+uint16_t RtpMidiOutput::product_id() const {
+    return 0;
+}
+
+std::string RtpMidiOutput::product_name() const {
+    return "rtp:" + std::to_string(session->control_port());
+}
+}
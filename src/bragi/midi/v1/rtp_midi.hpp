@@ -0,0 +1,186 @@
+/**
+ * @file rtp_midi.hpp
+ * @brief MIDI over the network using RTP-MIDI (RFC 6295) with AppleMIDI session management
+ *
+ * A session connects this host to one peer over a pair of UDP ports - a control port and the data port directly
+ * above it. Messages are collected into batches and sent as one RTP packet per batch. Within a packet the commands
+ * carry delta times and use running status.
+ *
+ * Every packet carries a recovery journal of the notes changed since the last packet the peer confirmed receiving.
+ * When a packet is lost the receiving side uses the journal of the next packet to release notes whose NOTE OFF was
+ * lost, so a dropped packet does not leave notes hanging.
+ *
+ * @note Only chapter N (notes) of the recovery journal is produced. Other chapters are skipped when received.
+ */
+#ifndef _BRAGI_MIDI_V1_RTP_MIDI_HPP_
+#define _BRAGI_MIDI_V1_RTP_MIDI_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output_backend.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Counters of an RtpMidiSession
+ */
+struct RtpMidiStats {
+    size_t packets_sent     = 0;
+    size_t packets_received = 0;
+    size_t packets_lost     = 0;
+    size_t notes_recovered  = 0;
+};
+
+/**
+ * @brief An RTP-MIDI session with a single peer
+ *
+ * Invitations from a peer are accepted automatically while no session is established. A background thread handles
+ * the session protocol, receives packets and sends batches once they are older than the batch interval.
+ *
+ * Received messages, including NOTE OFF messages produced from the recovery journal, are passed to the receiver
+ * callback on the background thread.
+ */
+class RtpMidiSession {
+    protected:
+        struct Impl;
+        struct ImplCleanup { void operator()(Impl* ptr) const; };
+
+        std::unique_ptr<Impl, ImplCleanup> pimpl;
+
+    public:
+        /// @brief Disable empty constructor
+        RtpMidiSession() = delete;
+
+        /// @brief Disable copy constructor, the background thread refers to this session
+        RtpMidiSession(const RtpMidiSession&) = delete;
+
+        /// @brief Disable copy assignment, the background thread refers to this session
+        RtpMidiSession& operator=(const RtpMidiSession&) = delete;
+
+        /**
+         * @brief Open the UDP ports and start listening for invitations
+         *
+         * @param [in] name Name announced to the peer
+         * @param [in] control_port Control port, the data port is the one above it
+         * @param [in] batch_interval Longest time a message waits in a batch before it is sent
+         *
+         * @throws std::system_error if the ports could not be opened or the background thread could not be started
+         */
+        RtpMidiSession(const std::string& name, uint16_t control_port = 5004,
+                       std::chrono::microseconds batch_interval = std::chrono::milliseconds(1));
+
+        /// @brief Ends the session, if established, and closes the ports
+        ~RtpMidiSession();
+
+        /**
+         * @brief Invite a peer, blocking until it accepts
+         *
+         * @param [in] host Address or host name of the peer, IPv4 only
+         * @param [in] control_port Control port of the peer
+         * @param [in] timeout How long to keep inviting
+         *
+         * @throws std::logic_error if a session is already established
+         * @throws std::invalid_argument if @b host could not be resolved
+         * @throws std::runtime_error if the peer rejected the invitation or did not answer in time
+         */
+        void invite(const std::string& host, uint16_t control_port,
+                    std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+        /// @brief Check whether a session with a peer is established
+        bool connected() const;
+
+        /// @brief Tell the peer the session is over, does nothing if not connected
+        void end();
+
+        /**
+         * @brief Add a short message to the current batch
+         *
+         * @throws std::invalid_argument if @b msg is invalid
+         * @throws std::logic_error if no session is established
+         */
+        void send(const ShortMessage& msg);
+
+        /**
+         * @brief Add a message to the current batch
+         *
+         * @throws std::length_error if a system exclusive message does not fit in a packet
+         * @throws std::logic_error if no session is established
+         * @throws Whatever is thrown by Message::validate()
+         */
+        void send(const Message& msg);
+
+        /**
+         * @brief Send the current batch now
+         *
+         * @throws std::system_error if the packet could not be sent
+         */
+        void flush();
+
+        /// @brief Set the callback for received messages, replacing any previous one
+        void set_receiver(std::function<void(const Message&)> receiver);
+
+        /// @brief Control port this session listens on
+        uint16_t control_port() const;
+
+        /// @brief Current counters
+        RtpMidiStats stats() const;
+};
+
+/**
+ * @brief Output backend sending through an RtpMidiSession
+ *
+ * @code
+ * std::shared_ptr<RtpMidiSession> session = std::make_shared<RtpMidiSession>("stage-left");
+ * session->invite("192.168.1.20", 5004);
+ *
+ * Output output(std::unique_ptr<OutputBackend>(new RtpMidiOutput(session)));
+ * output.connect();
+ * output.send_msg(note_on(middle_c));
+ * @endcode
+ */
+class RtpMidiOutput : public OutputBackend {
+    protected:
+        std::shared_ptr<RtpMidiSession> session;
+        bool                            open = false;
+
+    public:
+        /**
+         * @brief Send through a session
+         *
+         * @throws std::invalid_argument if @b session is empty
+         */
+        explicit RtpMidiOutput(std::shared_ptr<RtpMidiSession> session);
+
+        /// @throws std::logic_error if already connected
+        void connect() override;
+
+        void disconnect() override;
+
+        /// @throws std::logic_error if not connected, or no session is established
+        void send_short(uint8_t status, uint8_t data1, uint8_t data2) override;
+
+        /**
+         * @brief Send a complete message, segments of a system exclusive message are not supported
+         *
+         * @throws std::logic_error if not connected, or no session is established
+         * @throws std::length_error if the message does not fit in a packet
+         * @throws Whatever is thrown by Message::parse()
+         */
+        void send_long(const uint8_t* data, size_t size) override;
+
+        bool physical_device() const override;
+        uint16_t manufacturer_id() const override;
+        uint16_t product_id() const override;
+
+        /// @brief @c rtp: followed by the control port
+        std::string product_name() const override;
+};
+}
+
+#endif //_BRAGI_MIDI_V1_RTP_MIDI_HPP_//
@@ -0,0 +1,152 @@
+#include <bragi/midi/v1/sequencer.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace bragi::midi::v1 {
+/********************************/
+/* Voice                        */
+/********************************/
+void Voice::promise_type::unhandled_exception() noexcept {
+    sequencer->fail(std::current_exception());
+}
+
+Voice& Voice::operator=(Voice&& other) noexcept {
+    if ( this != &other ) {
+        if ( coroutine )
+            coroutine.destroy();
+        coroutine       = other.coroutine;
+        other.coroutine = nullptr;
+    }
+    return *this;
+}
+
+Voice::~Voice() {
+    if ( coroutine )
+        coroutine.destroy();
+}
+
+/********************************/
+/* Sequencer                    */
+/********************************/
+Sequencer::Sequencer(std::shared_ptr<Output> output, double bpm):
+        output(std::move(output)),
+        bpm(bpm)
+    {
+        if ( !this->output )
+            throw std::invalid_argument("Output must not be empty!");
+        if ( !(bpm > 0) )
+            throw std::invalid_argument("Tempo must be positive!");
+    }
+
+Sequencer::~Sequencer() {
+    while ( !queue.empty() ) {
+        queue.top().coroutine.destroy();
+        queue.pop();
+    }
+}
+
+void Sequencer::schedule(clock::time_point due, std::coroutine_handle<> coroutine) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push({due, next_order++, coroutine});
+    }
+    wake.notify_one();
+}
+
+void Sequencer::fail(std::exception_ptr exception) noexcept {
+    std::lock_guard<std::mutex> lock(mutex);
+    if ( !error )
+        error = exception;
+}
+
+void Sequencer::spawn(Voice voice) {
+    spawn(std::move(voice), now());
+}
+
+void Sequencer::spawn(Voice voice, clock::time_point at) {
+    if ( !voice.coroutine )
+        throw std::invalid_argument("Voice was already spawned!");
+
+    voice.coroutine.promise().sequencer = this;
+    schedule(at, std::exchange(voice.coroutine, nullptr));
+}
+
+void Sequencer::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = false;
+    runner   = std::this_thread::get_id();
+
+    while ( !stopping && !queue.empty() ) {
+        Entry next = queue.top();
+
+        // Spawning an earlier voice or stopping wakes this up early, so check again either way
+        if ( clock::now() < next.due ) {
+            wake.wait_until(lock, next.due);
+            continue;
+        }
+
+        queue.pop();
+        current  = next.due;
+        resuming = true;
+        worst_lateness = std::max(worst_lateness, clock::now() - next.due);
+
+        lock.unlock();
+        next.coroutine.resume();
+        lock.lock();
+
+        resuming = false;
+        if ( error )
+            std::rethrow_exception(std::exchange(error, nullptr));
+    }
+}
+
+void Sequencer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+}
+
+Sequencer::clock::time_point Sequencer::now() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return resuming && std::this_thread::get_id() == runner ? current : clock::now();
+}
+
+Sequencer::Timer Sequencer::at(clock::time_point due) {
+    return {this, due};
+}
+
+Sequencer::Timer Sequencer::wait(clock::duration duration) {
+    return {this, now() + duration};
+}
+
+Sequencer::Timer Sequencer::beats(double count) {
+    std::chrono::duration<double> length(count * 60 / tempo());
+    return {this, now() + std::chrono::duration_cast<clock::duration>(length)};
+}
+
+void Sequencer::set_tempo(double bpm) {
+    if ( !(bpm > 0) )
+        throw std::invalid_argument("Tempo must be positive!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    this->bpm = bpm;
+}
+
+double Sequencer::tempo() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bpm;
+}
+
+void Sequencer::send(const Message& msg) {
+    output->send_msg(msg);
+}
+
+Sequencer::clock::duration Sequencer::lateness() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return worst_lateness;
+}
+}
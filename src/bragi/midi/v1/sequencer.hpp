@@ -0,0 +1,221 @@
+/**
+ * @file sequencer.hpp
+ * @brief Sequencing with coroutines, many voices on a single thread
+ */
+#ifndef _BRAGI_MIDI_V1_SEQUENCER_HPP_
+#define _BRAGI_MIDI_V1_SEQUENCER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output.hpp>
+
+namespace bragi::midi::v1 {
+class Sequencer;
+
+/**
+ * @brief A coroutine played by a Sequencer
+ *
+ * Any function returning a Voice which uses @c co_await is a voice. It does not start running until passed to
+ * Sequencer::spawn(), which takes ownership of it.
+ *
+ * @code
+ * Voice pulse(Sequencer& seq, uint8_t pitch) {
+ *     for ( int i = 0; i < 16; i++ ) {
+ *         seq.send(note_on(pitch));
+ *         co_await seq.beats(0.5);
+ *         seq.send(note_off(pitch));
+ *         co_await seq.beats(0.5);
+ *     }
+ * }
+ * @endcode
+ */
+class Voice {
+    public:
+        struct promise_type;
+
+    protected:
+        std::coroutine_handle<promise_type> coroutine;
+
+        explicit Voice(std::coroutine_handle<promise_type> coroutine) noexcept: coroutine(coroutine) {}
+
+        friend class Sequencer;
+
+    public:
+        /// @brief Coroutine state, the frame is freed as soon as the voice finishes
+        struct promise_type {
+            Sequencer* sequencer = nullptr;
+
+            Voice get_return_object() noexcept {
+                return Voice(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+
+            /// @brief Passes the exception on to be rethrown by Sequencer::run()
+            void unhandled_exception() noexcept;
+        };
+
+        /// @brief Disable copy constructor to enforce single ownership
+        Voice(const Voice&) = delete;
+
+        /// @brief Disable copy assignment to enforce single ownership
+        Voice& operator=(const Voice&) = delete;
+
+        /// @brief Take over a voice which has not been spawned
+        Voice(Voice&& other) noexcept: coroutine(other.coroutine) { other.coroutine = nullptr; }
+
+        /// @brief Take over a voice which has not been spawned, freeing the current one
+        Voice& operator=(Voice&& other) noexcept;
+
+        /// @brief Frees the coroutine if it was never spawned
+        ~Voice();
+};
+
+/**
+ * @brief Runs voices on a single thread, resuming each when the time it waits for comes
+ *
+ * Waiting is relative to the time a voice was due to resume, rather than the time it actually did, so timing errors
+ * do not add up over a long phrase. Scheduling costs a heap insertion per wait, however many voices there are.
+ */
+class Sequencer {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /// @brief Awaitable returned by at(), wait() and beats()
+        struct Timer {
+            Sequencer*        sequencer;
+            clock::time_point due;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> coroutine) { sequencer->schedule(due, coroutine); }
+            void await_resume() const noexcept {}
+        };
+
+    protected:
+        struct Entry {
+            clock::time_point       due;
+            uint64_t                order;
+            std::coroutine_handle<> coroutine;
+
+            bool operator>(const Entry& other) const {
+                return due != other.due ? due > other.due : order > other.order;
+            }
+        };
+
+        std::shared_ptr<Output> output;
+
+        mutable std::mutex                                              mutex;
+        std::condition_variable                                         wake;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        uint64_t                                                        next_order = 0;
+        double                                                          bpm;
+        bool                                                            stopping   = false;
+        bool                                                            resuming   = false;
+        std::thread::id                                                 runner;
+        clock::time_point                                               current;
+        clock::duration                                                 worst_lateness = clock::duration::zero();
+        std::exception_ptr                                              error;
+
+        void schedule(clock::time_point due, std::coroutine_handle<> coroutine);
+        void fail(std::exception_ptr exception) noexcept;
+
+        friend struct Voice::promise_type;
+
+    public:
+        /// @brief Disable empty constructor
+        Sequencer() = delete;
+
+        /// @brief Disable copy constructor, voices refer to their sequencer
+        Sequencer(const Sequencer&) = delete;
+
+        /// @brief Disable copy assignment, voices refer to their sequencer
+        Sequencer& operator=(const Sequencer&) = delete;
+
+        /**
+         * @brief Create a sequencer feeding an output
+         *
+         * @param [in] output Connected output which send() passes messages to
+         * @param [in] bpm Tempo used by beats()
+         *
+         * @throws std::invalid_argument if @b output is empty or @b bpm is not positive
+         */
+        explicit Sequencer(std::shared_ptr<Output> output, double bpm = 120);
+
+        /// @brief Frees any voices that have not finished
+        ~Sequencer();
+
+        /**
+         * @brief Start a voice now
+         *
+         * Called from within a voice, now is the time that voice was due, so the new voice starts in step with it.
+         * May be called from any thread.
+         *
+         * @throws std::invalid_argument if @b voice was already spawned
+         */
+        void spawn(Voice voice);
+
+        /**
+         * @brief Start a voice at a given time
+         *
+         * @throws std::invalid_argument if @b voice was already spawned
+         */
+        void spawn(Voice voice, clock::time_point at);
+
+        /**
+         * @brief Resume voices as they become due until all have finished or stop() is called
+         *
+         * @throws Whatever is thrown out of a voice, which is then freed
+         */
+        void run();
+
+        /// @brief Make run() return before resuming another voice, may be called from any thread
+        void stop();
+
+        /// @brief Time the running voice was due, or the current time outside of a voice
+        clock::time_point now() const;
+
+        /// @brief Wait until a point in time
+        Timer at(clock::time_point due);
+
+        /// @brief Wait for a duration after now()
+        Timer wait(clock::duration duration);
+
+        /// @brief Wait for a number of beats after now(), at the current tempo
+        Timer beats(double count);
+
+        /**
+         * @brief Change the tempo, affecting waits started from now on
+         *
+         * @throws std::invalid_argument if @b bpm is not positive
+         */
+        void set_tempo(double bpm);
+
+        /// @brief Current tempo in beats per minute
+        double tempo() const;
+
+        /**
+         * @brief Send a message to the output
+         *
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        void send(const Message& msg);
+
+        /// @brief Longest delay between a voice being due and being resumed
+        clock::duration lateness() const;
+};
+}
+
+#endif //_BRAGI_MIDI_V1_SEQUENCER_HPP_//
@@ -0,0 +1,363 @@
+#ifndef __linux__
+    #error "Shared memory transport is only available on Linux!"
+#endif
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+
+#include <bragi/midi/v1/shm.hpp>
+#include <bragi/midi/v1/short_message.hpp>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "Atomics in shared memory must be lock-free to work across processes");
+
+namespace bragi::midi::v1 {
+constexpr static uint64_t shm_magic       = 0x474E524947415242ULL; // "BRAGIRNG" read little-endian
+constexpr static uint32_t shm_version     = 1;
+constexpr static size_t   slot_words      = 5;
+constexpr static size_t   slot_payload    = slot_words * sizeof(uint64_t);
+constexpr static uint64_t continuation    = 1ULL << 63;
+
+/**
+ * @brief One slot of the ring, guarded by a sequence lock
+ *
+ * @b seq is odd while the writer fills the slot, and @c 2n+2 once it holds ring position @c n.
+ */
+struct ShmSlot {
+    std::atomic<uint64_t> seq;
+    std::atomic<int64_t>  time;
+    std::atomic<uint64_t> meta;  // Message size in the first slot of a message, continuation flag in the others
+    std::atomic<uint64_t> words[slot_words];
+};
+
+static_assert(sizeof(ShmSlot) == 64, "Slots must fill exactly one cache line");
+
+/**
+ * @brief Header of the shared region, the slots follow directly after
+ */
+struct ShmRegion {
+    std::atomic<uint64_t>             magic;
+    uint32_t                          version;
+    uint32_t                          slot_count;
+    alignas(64) std::atomic<uint64_t> write_seq;
+    alignas(64) std::atomic<uint32_t> futex;
+    std::atomic<uint32_t>             waiters;
+};
+
+static ShmSlot* slots_of(ShmRegion* region) {
+    return reinterpret_cast<ShmSlot*>(reinterpret_cast<uint8_t*>(region) + sizeof(ShmRegion));
+}
+
+static size_t region_size(size_t slot_count) {
+    return sizeof(ShmRegion) + slot_count * sizeof(ShmSlot);
+}
+
+static std::string shm_path(const std::string& name) {
+    return name.size() && name[0] == '/' ? name : "/" + name;
+}
+
+static int64_t steady_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void throw_errno() {
+    throw std::system_error(std::error_code(errno, std::system_category()));
+}
+
+static ShmRegion* map_region(int fd, size_t size) {
+    void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int   err    = errno;
+    ::close(fd);
+
+    if ( mapped == MAP_FAILED )
+        throw std::system_error(std::error_code(err, std::system_category()));
+
+    return static_cast<ShmRegion*>(mapped);
+}
+
+/********************************/
+/* ShmOutput                    */
+/********************************/
+ShmOutput::ShmOutput(const std::string& name, size_t slot_count): name(name), slot_count(2) {
+    while ( this->slot_count < slot_count )
+        this->slot_count <<= 1;
+}
+
+ShmOutput::~ShmOutput() {
+    disconnect();
+}
+
+void ShmOutput::connect() {
+    if ( region )
+        throw std::logic_error("Already connected!");
+
+    std::string path = shm_path(name);
+
+    // Readers still attached to an older region keep their mapping, new readers find this one
+    ::shm_unlink(path.c_str());
+
+    int fd = ::shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0660);
+    if ( fd < 0 )
+        throw_errno();
+
+    if ( ::ftruncate(fd, static_cast<off_t>(region_size(slot_count))) != 0 ) {
+        int err = errno;
+        ::close(fd);
+        ::shm_unlink(path.c_str());
+        throw std::system_error(std::error_code(err, std::system_category()));
+    }
+
+    ShmRegion* mapped;
+    try {
+        mapped = map_region(fd, region_size(slot_count));
+    } catch ( ... ) {
+        ::shm_unlink(path.c_str());
+        throw;
+    }
+
+    new (mapped) ShmRegion();
+    mapped->version    = shm_version;
+    mapped->slot_count = static_cast<uint32_t>(slot_count);
+    mapped->write_seq.store(0, std::memory_order_relaxed);
+    mapped->futex.store(0, std::memory_order_relaxed);
+    mapped->waiters.store(0, std::memory_order_relaxed);
+
+    ShmSlot* slots = slots_of(mapped);
+    for ( size_t i = 0; i < slot_count; i++ ) {
+        new (&slots[i]) ShmSlot();
+        slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+
+    // Readers check the magic number last, once everything else is in place
+    mapped->magic.store(shm_magic, std::memory_order_release);
+
+    region   = mapped;
+    next_seq = 0;
+}
+
+void ShmOutput::disconnect() {
+    if ( !region )
+        return;
+
+    ::munmap(region, region_size(slot_count));
+    ::shm_unlink(shm_path(name).c_str());
+    region = nullptr;
+}
+
+void ShmOutput::publish(const uint8_t* data, size_t size) {
+    if ( !region )
+        throw std::logic_error("Not connected!");
+
+    size_t needed = std::max<size_t>(1, (size + slot_payload - 1) / slot_payload);
+    if ( needed > slot_count / 2 )
+        throw std::length_error("Message too long for the ring!");
+
+    ShmSlot* slots = slots_of(region);
+    int64_t  now   = steady_now();
+
+    for ( size_t k = 0; k < needed; k++ ) {
+        uint64_t seq  = next_seq + k;
+        ShmSlot& slot = slots[seq & (slot_count - 1)];
+
+        slot.seq.store(2 * seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.time.store(now, std::memory_order_relaxed);
+        slot.meta.store(k == 0 ? size : continuation | k, std::memory_order_relaxed);
+
+        for ( size_t w = 0; w < slot_words; w++ ) {
+            size_t   offset = k * slot_payload + w * sizeof(uint64_t);
+            uint64_t word   = 0;
+            if ( offset < size )
+                std::memcpy(&word, data + offset, std::min(sizeof(word), size - offset));
+            slot.words[w].store(word, std::memory_order_relaxed);
+        }
+
+        slot.seq.store(2 * seq + 2, std::memory_order_release);
+    }
+
+    next_seq += needed;
+    region->write_seq.store(next_seq);
+
+    // Readers register as waiters before checking write_seq, so either they see the new value or we see them
+    region->futex.fetch_add(1);
+    if ( region->waiters.load() )
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&region->futex), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void ShmOutput::send_short(uint8_t status, uint8_t data1, uint8_t data2) {
+    uint8_t bytes[3] = {status, data1, data2};
+    publish(bytes, short_message_size(status));
+}
+
+void ShmOutput::send_long(const uint8_t* data, size_t size) {
+    publish(data, size);
+}
+
+bool ShmOutput::physical_device() const {
+    return false;
+}
+
+uint16_t ShmOutput::manufacturer_id() const {
+    return 0;
+}
+
+uint16_t ShmOutput::product_id() const {
+    return 0;
+}
+
+std::string ShmOutput::product_name() const {
+    return "shm:" + name;
+}
+
+/********************************/
+/* ShmReader                    */
+/********************************/
+Message ShmMessage::message() const {
+    return Message::parse(bytes);
+}
+
+ShmReader::ShmReader(const std::string& name) {
+    int fd = ::shm_open(shm_path(name).c_str(), O_RDWR | O_CLOEXEC, 0);
+    if ( fd < 0 )
+        throw_errno();
+
+    struct stat info;
+    if ( ::fstat(fd, &info) != 0 ) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(std::error_code(err, std::system_category()));
+    }
+
+    map_size = static_cast<size_t>(info.st_size);
+    if ( map_size < sizeof(ShmRegion) ) {
+        ::close(fd);
+        throw std::domain_error("Not a MIDI ring!");
+    }
+
+    region = map_region(fd, map_size);
+
+    if ( region->magic.load(std::memory_order_acquire) != shm_magic || region->version != shm_version
+         || region_size(region->slot_count) != map_size ) {
+        ::munmap(region, map_size);
+        throw std::domain_error("Not a MIDI ring!");
+    }
+
+    cursor = region->write_seq.load(std::memory_order_acquire);
+}
+
+ShmReader::~ShmReader() {
+    ::munmap(region, map_size);
+}
+
+/**
+ * @brief Copy a slot if it still holds ring position @b seq
+ */
+static bool read_slot(ShmSlot& slot, uint64_t seq, int64_t& time, uint64_t& meta, uint64_t (&words)[slot_words]) {
+    uint64_t before = slot.seq.load(std::memory_order_acquire);
+    if ( before != 2 * seq + 2 )
+        return false;
+
+    time = slot.time.load(std::memory_order_relaxed);
+    meta = slot.meta.load(std::memory_order_relaxed);
+    for ( size_t w = 0; w < slot_words; w++ )
+        words[w] = slot.words[w].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == before;
+}
+
+bool ShmReader::try_read(ShmMessage& msg) {
+    ShmSlot* slots = slots_of(region);
+    uint64_t mask  = region->slot_count - 1;
+
+    while ( true ) {
+        uint64_t published = region->write_seq.load(std::memory_order_acquire);
+        if ( cursor >= published )
+            return false;
+
+        int64_t  time;
+        uint64_t meta;
+        uint64_t words[slot_words];
+
+        bool lapped = published - cursor > region->slot_count
+                   || !read_slot(slots[cursor & mask], cursor, time, meta, words);
+
+        if ( !lapped && (meta & continuation) ) {
+            // Landed in the middle of a message after an overrun
+            cursor++;
+            continue;
+        }
+
+        size_t size   = lapped ? 0 : static_cast<size_t>(meta);
+        size_t needed = std::max<size_t>(1, (size + slot_payload - 1) / slot_payload);
+
+        if ( !lapped ) {
+            msg.time = time;
+            msg.bytes.resize(size);
+
+            for ( size_t k = 0; !lapped && k < needed; k++ ) {
+                if ( k > 0 )
+                    lapped = !read_slot(slots[(cursor + k) & mask], cursor + k, time, meta, words);
+
+                size_t offset = k * slot_payload;
+                if ( !lapped && offset < size )
+                    std::memcpy(&msg.bytes[offset], words, std::min(slot_payload, size - offset));
+            }
+        }
+
+        if ( lapped ) {
+            overrun_count++;
+            cursor = region->write_seq.load(std::memory_order_acquire);
+            continue;
+        }
+
+        cursor += needed;
+        return true;
+    }
+}
+
+bool ShmReader::read(ShmMessage& msg, std::chrono::microseconds timeout) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+    while ( true ) {
+        if ( try_read(msg) )
+            return true;
+
+        std::chrono::nanoseconds remaining = deadline - std::chrono::steady_clock::now();
+        if ( remaining.count() <= 0 )
+            return false;
+
+        region->waiters.fetch_add(1);
+        uint32_t seen = region->futex.load();
+
+        if ( region->write_seq.load() <= cursor ) {
+            struct timespec wait;
+            wait.tv_sec  = static_cast<time_t>(remaining.count() / 1000000000);
+            wait.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&region->futex), FUTEX_WAIT, seen, &wait, nullptr, 0);
+        }
+
+        region->waiters.fetch_sub(1);
+    }
+}
+
+size_t ShmReader::overruns() const {
+    return overrun_count;
+}
+}
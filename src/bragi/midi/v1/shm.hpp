@@ -0,0 +1,159 @@
+/**
+ * @file shm.hpp
+ * @brief Exchanging MIDI between local processes through shared memory
+ *
+ * A ShmOutput publishes every message it is given into a ring buffer in a named shared memory region. Any number of
+ * ShmReader instances, in any process, can follow the ring with their own cursor. The writer never waits for
+ * readers, so a reader which falls more than a ring behind skips ahead and counts an overrun.
+ *
+ * Readers block on a futex in the shared region, so a message reaches a waiting reader without passing through a
+ * kernel buffer or being copied by the kernel.
+ *
+ * @note Only available on Linux
+ */
+#ifndef _BRAGI_MIDI_V1_SHM_HPP_
+#define _BRAGI_MIDI_V1_SHM_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <bragi/midi/v1/message.hpp>
+#include <bragi/midi/v1/output_backend.hpp>
+
+namespace bragi::midi::v1 {
+struct ShmRegion;
+
+/**
+ * @brief Output backend publishing into a shared memory ring
+ *
+ * There must be only one writer per region name. Connecting creates the region, replacing any older region of the
+ * same name, and disconnecting removes the name again.
+ *
+ * @code
+ * Output output(std::unique_ptr<OutputBackend>(new ShmOutput("bragi-sequencer")));
+ * output.connect();
+ * output.send_msg(note_on(middle_c));
+ * @endcode
+ */
+class ShmOutput : public OutputBackend {
+    protected:
+        std::string name;
+        size_t      slot_count;
+        ShmRegion*  region   = nullptr;
+        uint64_t    next_seq = 0;
+
+        void publish(const uint8_t* data, size_t size);
+
+    public:
+        /// @brief Disable copy constructor to enforce single ownership of the region
+        ShmOutput(const ShmOutput&) = delete;
+
+        /// @brief Disable copy assignment to enforce single ownership of the region
+        ShmOutput& operator=(const ShmOutput&) = delete;
+
+        /**
+         * @brief Describe the region, it is created by connect()
+         *
+         * @param [in] name Name of the region, shared with the readers
+         * @param [in] slot_count Number of 64-byte slots in the ring, rounded up to a power of 2. A message takes one
+         *                        slot per 40 bytes.
+         */
+        explicit ShmOutput(const std::string& name, size_t slot_count = 4096);
+
+        /// @brief Disconnects if connected
+        ~ShmOutput();
+
+        /// @throws std::logic_error if already connected
+        /// @throws std::system_error if the region could not be created
+        void connect() override;
+
+        void disconnect() override;
+
+        /// @throws std::logic_error if not connected
+        void send_short(uint8_t status, uint8_t data1, uint8_t data2) override;
+
+        /// @throws std::logic_error if not connected
+        /// @throws std::length_error if the message needs more than half the ring
+        void send_long(const uint8_t* data, size_t size) override;
+
+        bool physical_device() const override;
+        uint16_t manufacturer_id() const override;
+        uint16_t product_id() const override;
+
+        /// @brief @c shm: followed by the region name
+        std::string product_name() const override;
+};
+
+/**
+ * @brief A message received by a ShmReader
+ */
+struct ShmMessage {
+    /// @brief When the message was published, in nanoseconds of @c std::chrono::steady_clock
+    int64_t                    time = 0;
+
+    /// @brief The bytes of the message
+    std::basic_string<uint8_t> bytes;
+
+    /**
+     * @brief Parse the bytes
+     *
+     * @throws Whatever is thrown by Message::parse()
+     */
+    Message message() const;
+};
+
+/**
+ * @brief Follows the ring of a ShmOutput, possibly in another process
+ *
+ * A reader starts at the newest message, so it only sees messages published after it was created. Each reader is
+ * meant for a single thread.
+ */
+class ShmReader {
+    protected:
+        ShmRegion* region    = nullptr;
+        size_t     map_size  = 0;
+        uint64_t   cursor    = 0;
+        size_t     overrun_count = 0;
+
+    public:
+        /// @brief Disable copy constructor to enforce single ownership of the mapping
+        ShmReader(const ShmReader&) = delete;
+
+        /// @brief Disable copy assignment to enforce single ownership of the mapping
+        ShmReader& operator=(const ShmReader&) = delete;
+
+        /**
+         * @brief Attach to a region
+         *
+         * @param [in] name Name passed to the ShmOutput
+         *
+         * @throws std::system_error if the region does not exist or could not be mapped
+         * @throws std::domain_error if the region is not a MIDI ring
+         */
+        explicit ShmReader(const std::string& name);
+
+        /// @brief Unmaps the region
+        ~ShmReader();
+
+        /**
+         * @brief Read the next message if there is one
+         *
+         * @returns false if no message is available
+         */
+        bool try_read(ShmMessage& msg);
+
+        /**
+         * @brief Read the next message, waiting for one if necessary
+         *
+         * @returns false if no message arrived within @b timeout
+         */
+        bool read(ShmMessage& msg, std::chrono::microseconds timeout);
+
+        /// @brief Number of times the writer overtook this reader, losing messages
+        size_t overruns() const;
+};
+}
+
+#endif //_BRAGI_MIDI_V1_SHM_HPP_//
@@ -0,0 +1,36 @@
+#include <bragi/midi/v1/short_message.hpp>
+
+#include <stdexcept>
+
+namespace bragi::midi::v1 {
+ShortMessage ShortMessage::from(const Message& msg) {
+    switch ( msg.size() ) {
+        case 1:
+            return ShortMessage(msg.message_type_raw());
+
+        case 2:
+            return ShortMessage(msg.message_type_raw(), msg.get_first_byte());
+
+        case 3:
+            return ShortMessage(msg.message_type_raw(), msg.get_first_byte(), msg.get_second_byte());
+
+        default:
+            throw std::domain_error("Not a short message!");
+    }
+}
+
+Message ShortMessage::to_message() const {
+    if ( !valid() )
+        throw std::invalid_argument("Invalid short message!");
+
+    Message message(bytes[0]);
+
+    if ( length > 1 )
+        message.set_first_byte(bytes[1]);
+
+    if ( length > 2 )
+        message.set_second_byte(bytes[2]);
+
+    return message;
+}
+}
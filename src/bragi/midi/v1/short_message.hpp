@@ -0,0 +1,100 @@
+/**
+ * @file short_message.hpp
+ * @brief Fixed-size MIDI message for paths which must not allocate or throw
+ */
+#ifndef _BRAGI_MIDI_V1_SHORT_MESSAGE_HPP_
+#define _BRAGI_MIDI_V1_SHORT_MESSAGE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <bragi/midi/v1/message.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Size of a non-system-exclusive message, without throwing
+ *
+ * @returns Same as message_size(), or @c 0 if @b status is not a status byte, is @b system_exclusive or is not
+ *          recognized
+ */
+constexpr size_t short_message_size(uint8_t status) noexcept {
+    return !(status & 0x80)                                         ? 0
+         : (status & 0xF0) < MessageType::program_change            ? 3
+         : (status & 0xF0) == MessageType::pitch_bend               ? 3
+         : (status & 0xF0) < 0xF0                                   ? 2
+         : status == MessageType::song_position                     ? 3
+         : status == MessageType::song_select                       ? 2
+         : status == MessageType::bus_select                        ? 2
+         : status == MessageType::tune_request                      ? 1
+         : status == MessageType::timing_tick                       ? 1
+         : status >= MessageType::start_song && status != 0xFD      ? 1
+         : 0;
+}
+
+/**
+ * @brief A MIDI message of at most 3 bytes, stored inline
+ *
+ * Unlike Message this never allocates and none of its operations throw. An invalid message has a size() of @c 0 and
+ * is rejected by anything it is passed to.
+ */
+class ShortMessage {
+    protected:
+        uint8_t bytes[3] = {0, 0, 0};
+        uint8_t length   = 0;
+
+    public:
+        /// @brief An invalid, empty message
+        ShortMessage() = default;
+
+        /**
+         * @brief Create a message from its bytes
+         *
+         * Unused data bytes are ignored. If @b status is not a short message type or a data byte is greater than
+         * @c 0x7F the message is invalid.
+         */
+        ShortMessage(uint8_t status, uint8_t data1 = 0, uint8_t data2 = 0) noexcept {
+            size_t size = short_message_size(status);
+            if ( size == 0 || (size > 1 && data1 > 0x7F) || (size > 2 && data2 > 0x7F) )
+                return;
+
+            bytes[0] = status;
+            bytes[1] = size > 1 ? data1 : 0;
+            bytes[2] = size > 2 ? data2 : 0;
+            length   = static_cast<uint8_t>(size);
+        }
+
+        /**
+         * @brief Convert a Message
+         *
+         * @throws std::domain_error if @b msg is longer than 3 bytes
+         */
+        static ShortMessage from(const Message& msg);
+
+        /**
+         * @brief Convert to a Message
+         *
+         * @throws std::invalid_argument if this message is invalid
+         */
+        Message to_message() const;
+
+        /// @brief Message type including the channel
+        uint8_t status() const noexcept { return bytes[0]; }
+
+        /// @brief First data byte, @c 0 if unused
+        uint8_t data1() const noexcept { return bytes[1]; }
+
+        /// @brief Second data byte, @c 0 if unused
+        uint8_t data2() const noexcept { return bytes[2]; }
+
+        /// @brief Number of bytes, @c 0 if invalid
+        size_t size() const noexcept { return length; }
+
+        /// @brief Check the message is valid
+        bool valid() const noexcept { return length != 0; }
+
+        /// @brief Bytes packed little-endian into an integer, status in the lowest byte
+        uint32_t packed() const noexcept { return bytes[0] | bytes[1] << 8 | bytes[2] << 16; }
+};
+}
+
+#endif //_BRAGI_MIDI_V1_SHORT_MESSAGE_HPP_//
@@ -0,0 +1,167 @@
+#include <bragi/midi/v1/smf.hpp>
+#include <bragi/midi/v1/message.hpp>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace bragi::midi::v1 {
+static uint32_t read_be32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint16_t read_be16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+/********************************/
+/* SmfTrack                     */
+/********************************/
+SmfTrack::SmfTrack(const uint8_t* data, size_t size): pos(data), end(data + size) {}
+
+uint32_t SmfTrack::read_variable_length() {
+    uint32_t value = 0;
+
+    // At most 4 bytes are allowed for a variable length quantity
+    for ( int i = 0; i < 4; i++ ) {
+        if ( pos == end )
+            throw std::underflow_error("Truncated variable length quantity!");
+
+        uint8_t byte = *pos++;
+        value = value << 7 | (byte & 0x7F);
+
+        if ( !(byte & 0x80) )
+            return value;
+    }
+
+    throw std::domain_error("Variable length quantity too long!");
+}
+
+bool SmfTrack::next(SmfEvent& event) {
+    if ( pos == end )
+        return false;
+
+    event.delta = read_variable_length();
+
+    if ( pos == end )
+        throw std::underflow_error("Missing event after delta time!");
+
+    uint8_t status = *pos;
+
+    if ( status & 0x80 )
+        pos++;
+
+    else if ( running_status )
+        status = running_status;
+
+    else
+        throw std::domain_error("Data byte without running status!");
+
+    event.status       = status;
+    event.meta_type    = 0;
+    event.payload      = nullptr;
+    event.payload_size = 0;
+
+    if ( status == 0xFF || status == MessageType::system_exclusive || status == MessageType::end_of_system_exclusive ) {
+        // Meta and system exclusive events cancel running status
+        running_status = 0;
+
+        if ( status == 0xFF ) {
+            if ( pos == end )
+                throw std::underflow_error("Truncated meta event!");
+            event.meta_type = *pos++;
+        }
+
+        uint32_t length = read_variable_length();
+        if ( static_cast<size_t>(end - pos) < length )
+            throw std::underflow_error("Truncated event payload!");
+
+        event.payload      = pos;
+        event.payload_size = length;
+        pos += length;
+        return true;
+    }
+
+    // System common and realtime bytes are not valid in a file
+    if ( status >= 0xF0 )
+        throw std::domain_error("Unexpected system message in track!");
+
+    size_t data_size = message_size(status) - 1;
+
+    if ( static_cast<size_t>(end - pos) < data_size )
+        throw std::underflow_error("Truncated channel message!");
+
+    for ( size_t i = 0; i < 2; i++ )
+        event.data[i] = i < data_size ? pos[i] : 0;
+
+    for ( size_t i = 0; i < data_size; i++ )
+        if ( event.data[i] & 0x80 )
+            throw std::domain_error("Status byte in place of data byte!");
+
+    pos += data_size;
+    running_status = status;
+    return true;
+}
+
+/********************************/
+/* SmfFile                      */
+/********************************/
+SmfFile::SmfFile(const uint8_t* data, size_t size) {
+    if ( size < 14 || std::memcmp(data, "MThd", 4) != 0 )
+        throw std::domain_error("Missing MThd header!");
+
+    uint32_t header_size = read_be32(data + 4);
+    if ( header_size < 6 )
+        throw std::domain_error("MThd header too short!");
+    if ( size - 8 < header_size )
+        throw std::underflow_error("Truncated MThd header!");
+
+    file_format   = read_be16(data + 8);
+    file_division = read_be16(data + 12);
+    uint16_t declared_tracks = read_be16(data + 10);
+
+    if ( file_format > 2 )
+        throw std::domain_error("Unsupported file format!");
+    if ( file_division == 0 )
+        throw std::domain_error("Invalid division!");
+
+    track_data.reserve(declared_tracks);
+    track_size.reserve(declared_tracks);
+
+    // Unknown chunk types must be skipped
+    size_t offset = 8 + header_size;
+    while ( size - offset >= 8 ) {
+        uint32_t chunk_size = read_be32(data + offset + 4);
+        if ( size - offset - 8 < chunk_size )
+            throw std::underflow_error("Truncated chunk!");
+
+        if ( std::memcmp(data + offset, "MTrk", 4) == 0 ) {
+            track_data.push_back(data + offset + 8);
+            track_size.push_back(chunk_size);
+        }
+
+        offset += 8 + static_cast<size_t>(chunk_size);
+    }
+
+    if ( track_data.size() < declared_tracks )
+        throw std::underflow_error("Missing tracks!");
+}
+
+uint16_t SmfFile::format() const {
+    return file_format;
+}
+
+uint16_t SmfFile::division() const {
+    return file_division;
+}
+
+size_t SmfFile::track_count() const {
+    return track_data.size();
+}
+
+SmfTrack SmfFile::track(size_t index) const {
+    if ( index >= track_data.size() )
+        throw std::out_of_range("No such track!");
+
+    return SmfTrack(track_data[index], track_size[index]);
+}
+}
@@ -0,0 +1,116 @@
+/**
+ * @file smf.hpp
+ * @brief Reading Standard MIDI Files (.mid)
+ */
+#ifndef _BRAGI_MIDI_V1_SMF_HPP_
+#define _BRAGI_MIDI_V1_SMF_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Meta event types found in Standard MIDI Files
+ */
+class MetaType {
+    public:
+        /// @brief End of track, must be the last event of each track
+        constexpr static uint8_t end_of_track   = 0x2F;
+
+        /// @brief Tempo in microseconds per quarter note, as a @c 3-byte integer
+        constexpr static uint8_t set_tempo      = 0x51;
+
+        /// @brief Time signature
+        constexpr static uint8_t time_signature = 0x58;
+};
+
+/**
+ * @brief A single event read from a track
+ *
+ * For channel messages @b status holds the message type including the channel, and @b data holds the data bytes.
+ * For meta events @b status is @c 0xFF and @b meta_type is set. For meta and system exclusive events @b payload
+ * points into the file buffer.
+ */
+struct SmfEvent {
+    uint32_t       delta        = 0;
+    uint8_t        status       = 0;
+    uint8_t        meta_type    = 0;
+    uint8_t        data[2]      = {0, 0};
+    const uint8_t* payload      = nullptr;
+    uint32_t       payload_size = 0;
+};
+
+/**
+ * @brief Sequential reader over a single MTrk chunk
+ *
+ * Running status is resolved, so each channel event carries its full status byte.
+ */
+class SmfTrack {
+    protected:
+        const uint8_t* pos;
+        const uint8_t* end;
+        uint8_t        running_status = 0;
+
+        uint32_t read_variable_length();
+
+    public:
+        /// @brief Reader over the bytes of a track chunk, excluding the chunk header
+        SmfTrack(const uint8_t* data, size_t size);
+
+        /**
+         * @brief Read the next event
+         *
+         * @returns false once the track has no more events
+         *
+         * @throws std::underflow_error if an event is truncated
+         * @throws std::domain_error if an event is malformed
+         */
+        bool next(SmfEvent& event);
+};
+
+/**
+ * @brief Read-only view of a Standard MIDI File held in memory
+ *
+ * The buffer is not copied and must outlive the view and any tracks or events read from it.
+ */
+class SmfFile {
+    protected:
+        uint16_t                    file_format = 0;
+        uint16_t                    file_division = 0;
+        std::vector<const uint8_t*> track_data;
+        std::vector<size_t>         track_size;
+
+    public:
+        /**
+         * @brief Parse the chunk layout of a file
+         *
+         * @throws std::domain_error if the file has no MThd header or an unsupported format
+         * @throws std::underflow_error if a chunk is truncated
+         */
+        SmfFile(const uint8_t* data, size_t size);
+
+        /// @brief File format - @c 0, @c 1 or @c 2
+        uint16_t format() const;
+
+        /**
+         * @brief Raw division field
+         *
+         * If the top bit is clear this is ticks per quarter note, otherwise it is a negative SMPTE frame rate in the
+         * upper byte and ticks per frame in the lower byte.
+         */
+        uint16_t division() const;
+
+        /// @brief Number of MTrk chunks found
+        size_t track_count() const;
+
+        /**
+         * @brief Get a reader for a track
+         *
+         * @throws std::out_of_range if @b index is not less than track_count()
+         */
+        SmfTrack track(size_t index) const;
+};
+}
+
+#endif //_BRAGI_MIDI_V1_SMF_HPP_//
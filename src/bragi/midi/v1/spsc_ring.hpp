@@ -0,0 +1,107 @@
+/**
+ * @file spsc_ring.hpp
+ * @brief Bounded single-producer single-consumer queue
+ */
+#ifndef _BRAGI_MIDI_V1_SPSC_RING_HPP_
+#define _BRAGI_MIDI_V1_SPSC_RING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Wait-free bounded queue between exactly one producer thread and one consumer thread
+ *
+ * All storage is allocated by the constructor. try_push() and try_pop() never allocate, lock or throw, as long as
+ * copying @b T does not.
+ *
+ * @tparam T Element type, should be trivially copyable
+ */
+template <typename T>
+class SpscRing {
+    protected:
+        // Keep the indices on separate cache lines so producer and consumer do not contend
+        struct alignas(64) Index {
+            std::atomic<size_t> value{0};
+            size_t              cached = 0;
+        };
+
+        std::unique_ptr<T[]> slots;
+        size_t               mask;
+        Index                head; // Next slot to pop, owned by the consumer
+        Index                tail; // Next slot to push, owned by the producer
+
+        static size_t round_up(size_t capacity) {
+            size_t size = 2;
+            while ( size < capacity )
+                size <<= 1;
+            return size;
+        }
+
+    public:
+        /**
+         * @brief Allocate the queue
+         *
+         * @param [in] capacity Minimum number of elements, rounded up to a power of 2
+         */
+        explicit SpscRing(size_t capacity): slots(new T[round_up(capacity)]()), mask(round_up(capacity) - 1) {}
+
+        /// @brief Disable copy constructor, the queue is shared by reference
+        SpscRing(const SpscRing&) = delete;
+
+        /// @brief Disable copy assignment, the queue is shared by reference
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        /**
+         * @brief Add an element, called only by the producer
+         *
+         * @returns false if the queue is full
+         */
+        bool try_push(const T& value) noexcept {
+            size_t pos = tail.value.load(std::memory_order_relaxed);
+
+            if ( pos - tail.cached > mask ) {
+                tail.cached = head.value.load(std::memory_order_acquire);
+                if ( pos - tail.cached > mask )
+                    return false;
+            }
+
+            slots[pos & mask] = value;
+            tail.value.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Remove the oldest element, called only by the consumer
+         *
+         * @returns false if the queue is empty
+         */
+        bool try_pop(T& value) noexcept {
+            size_t pos = head.value.load(std::memory_order_relaxed);
+
+            if ( pos == head.cached ) {
+                head.cached = tail.value.load(std::memory_order_acquire);
+                if ( pos == head.cached )
+                    return false;
+            }
+
+            value = slots[pos & mask];
+            head.value.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// @brief Approximate number of queued elements, may be called from either thread
+        size_t size() const noexcept {
+            size_t pos = head.value.load(std::memory_order_acquire);
+            return tail.value.load(std::memory_order_acquire) - pos;
+        }
+
+        /// @brief Maximum number of queued elements
+        size_t capacity() const noexcept {
+            return mask + 1;
+        }
+};
+}
+
+#endif //_BRAGI_MIDI_V1_SPSC_RING_HPP_//
@@ -0,0 +1,292 @@
+#include <bragi/midi/v1/voice_allocator.hpp>
+
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+#include <bragi/midi/v1/short_message.hpp>
+
+namespace bragi::midi::v1 {
+/********************************/
+/* Lists                        */
+/********************************/
+void VoiceAllocator::push_back(List& list, Links Voice::* links, uint16_t index) {
+    Links& node = voices[index].*links;
+    node.prev = list.tail;
+    node.next = nil;
+
+    if ( list.tail != nil )
+        (voices[list.tail].*links).next = index;
+    else
+        list.head = index;
+
+    list.tail = index;
+    list.count++;
+}
+
+void VoiceAllocator::unlink(List& list, Links Voice::* links, uint16_t index) {
+    Links& node = voices[index].*links;
+
+    if ( node.prev != nil )
+        (voices[node.prev].*links).next = node.next;
+    else
+        list.head = node.next;
+
+    if ( node.next != nil )
+        (voices[node.next].*links).prev = node.prev;
+    else
+        list.tail = node.prev;
+
+    node.prev = nil;
+    node.next = nil;
+    list.count--;
+}
+
+VoiceAllocator::List& VoiceAllocator::state_list(State state) {
+    return state == free_state ? free_voices : state == sounding_state ? sounding : released;
+}
+
+/********************************/
+/* Implementation               */
+/********************************/
+VoiceAllocator::VoiceAllocator(std::shared_ptr<Output> output, std::vector<uint8_t> channels, StealPolicy policy):
+        output(std::move(output)),
+        policy(policy)
+    {
+        if ( !this->output )
+            throw std::invalid_argument("No output!");
+        if ( channels.empty() || channels.size() >= nil )
+            throw std::invalid_argument("Voice count must be from 1 to 65534!");
+
+        voices.resize(channels.size());
+        for ( size_t i = 0; i < channels.size(); i++ ) {
+            if ( channels[i] > 15 )
+                throw std::invalid_argument("Channel must be at most 15!");
+
+            voices[i].channel = channels[i];
+            push_back(free_voices, &Voice::order, static_cast<uint16_t>(i));
+        }
+    }
+
+std::vector<uint8_t> VoiceAllocator::mpe_lower_zone(uint8_t members) {
+    if ( members == 0 || members > 15 )
+        throw std::invalid_argument("Member channels must be from 1 to 15!");
+
+    std::vector<uint8_t> channels;
+    for ( uint8_t channel = 1; channel <= members; channel++ )
+        channels.push_back(channel);
+    return channels;
+}
+
+std::vector<uint8_t> VoiceAllocator::mpe_upper_zone(uint8_t members) {
+    if ( members == 0 || members > 15 )
+        throw std::invalid_argument("Member channels must be from 1 to 15!");
+
+    std::vector<uint8_t> channels;
+    for ( uint8_t channel = 14; channels.size() < members; channel-- )
+        channels.push_back(channel);
+    return channels;
+}
+
+uint16_t VoiceAllocator::choose_locked() {
+    if ( free_voices.head != nil )
+        return free_voices.head;
+    if ( released.head != nil )
+        return released.head;
+
+    switch ( policy ) {
+        case StealPolicy::oldest:
+            return sounding.head;
+
+        case StealPolicy::newest:
+            return sounding.tail;
+
+        case StealPolicy::quietest: {
+            // Every voice is sounding, so some level is in use
+            size_t level = used_levels[0] ? std::countr_zero(used_levels[0]) : 64 + std::countr_zero(used_levels[1]);
+            return levels[level].head;
+        }
+
+        default:
+            return nil;
+    }
+}
+
+VoiceAllocator::Voice* VoiceAllocator::find_locked(uint64_t note) {
+    uint16_t index = note & 0xFFFF;
+    if ( index >= voices.size() )
+        return nullptr;
+
+    Voice& voice = voices[index];
+    if ( voice.state != sounding_state || voice.generation != note >> 16 )
+        return nullptr;
+    return &voice;
+}
+
+uint64_t VoiceAllocator::note_on(uint8_t pitch, uint8_t velocity) {
+    if ( pitch > 0x7F )
+        throw std::range_error("Pitch must be at most 0x7F!");
+    if ( velocity == 0 || velocity > 0x7F )
+        throw std::range_error("Velocity must be from 1 to 0x7F!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uint16_t index = choose_locked();
+    if ( index == nil ) {
+        dropped_count++;
+        return no_voice;
+    }
+
+    Voice&       voice = voices[index];
+    ShortMessage batch[5];
+    size_t       count = 0;
+
+    if ( voice.state == sounding_state )
+        batch[count++] = ShortMessage(MessageType::note_off | voice.channel, voice.pitch, 0x40);
+    if ( voice.bend != 0x2000 )
+        batch[count++] = ShortMessage(MessageType::pitch_bend | voice.channel, 0x00, 0x40);
+    if ( voice.pressure != 0 )
+        batch[count++] = ShortMessage(MessageType::channel_pressure | voice.channel, 0);
+    if ( voice.timbre != 64 )
+        batch[count++] = ShortMessage(MessageType::controller_change | voice.channel, timbre_controller, 64);
+    batch[count++] = ShortMessage(MessageType::note_on | voice.channel, pitch, velocity);
+
+    output->send_batch(batch, count);
+
+    if ( voice.state == sounding_state ) {
+        stolen_count++;
+        unlink(levels[voice.velocity], &Voice::level, index);
+        if ( levels[voice.velocity].head == nil )
+            used_levels[voice.velocity >> 6] &= ~(uint64_t(1) << (voice.velocity & 63));
+    }
+    unlink(state_list(voice.state), &Voice::order, index);
+
+    voice.state    = sounding_state;
+    voice.pitch    = pitch;
+    voice.velocity = velocity;
+    voice.bend     = 0x2000;
+    voice.pressure = 0;
+    voice.timbre   = 64;
+    voice.generation++;
+
+    push_back(sounding, &Voice::order, index);
+    push_back(levels[velocity], &Voice::level, index);
+    used_levels[velocity >> 6] |= uint64_t(1) << (velocity & 63);
+
+    return uint64_t(voice.generation) << 16 | index;
+}
+
+bool VoiceAllocator::note_off(uint64_t note, uint8_t velocity) {
+    if ( velocity > 0x7F )
+        throw std::range_error("Velocity must be at most 0x7F!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Voice* voice = find_locked(note);
+    if ( !voice )
+        return false;
+
+    output->send_msg(ShortMessage(MessageType::note_off | voice->channel, voice->pitch, velocity));
+
+    uint16_t index = note & 0xFFFF;
+    unlink(levels[voice->velocity], &Voice::level, index);
+    if ( levels[voice->velocity].head == nil )
+        used_levels[voice->velocity >> 6] &= ~(uint64_t(1) << (voice->velocity & 63));
+    unlink(sounding, &Voice::order, index);
+
+    voice->state = released_state;
+    push_back(released, &Voice::order, index);
+    return true;
+}
+
+bool VoiceAllocator::pitch_bend(uint64_t note, uint16_t value) {
+    if ( value > 0x3FFF )
+        throw std::range_error("Pitch bend must be at most 0x3FFF!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Voice* voice = find_locked(note);
+    if ( !voice )
+        return false;
+
+    output->send_msg(ShortMessage(MessageType::pitch_bend | voice->channel, value & 0x7F, value >> 7));
+    voice->bend = value;
+    return true;
+}
+
+bool VoiceAllocator::pressure(uint64_t note, uint8_t value) {
+    if ( value > 0x7F )
+        throw std::range_error("Pressure must be at most 0x7F!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Voice* voice = find_locked(note);
+    if ( !voice )
+        return false;
+
+    output->send_msg(ShortMessage(MessageType::channel_pressure | voice->channel, value));
+    voice->pressure = value;
+    return true;
+}
+
+bool VoiceAllocator::timbre(uint64_t note, uint8_t value) {
+    if ( value > 0x7F )
+        throw std::range_error("Timbre must be at most 0x7F!");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Voice* voice = find_locked(note);
+    if ( !voice )
+        return false;
+
+    output->send_msg(ShortMessage(MessageType::controller_change | voice->channel, timbre_controller, value));
+    voice->timbre = value;
+    return true;
+}
+
+uint8_t VoiceAllocator::channel(uint64_t note) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Voice* voice = find_locked(note);
+    if ( !voice )
+        throw std::domain_error("No such note!");
+    return voice->channel;
+}
+
+void VoiceAllocator::release_all() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<ShortMessage> batch;
+    batch.reserve(sounding.count);
+    for ( uint16_t index = sounding.head; index != nil; index = voices[index].order.next )
+        batch.push_back(ShortMessage(MessageType::note_off | voices[index].channel, voices[index].pitch, 0x40));
+
+    output->send_batch(batch.data(), batch.size());
+
+    while ( sounding.head != nil ) {
+        uint16_t index = sounding.head;
+        Voice&   voice = voices[index];
+
+        unlink(levels[voice.velocity], &Voice::level, index);
+        unlink(sounding, &Voice::order, index);
+        voice.state = released_state;
+        push_back(released, &Voice::order, index);
+    }
+    used_levels[0] = 0;
+    used_levels[1] = 0;
+}
+
+void VoiceAllocator::set_policy(StealPolicy policy) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->policy = policy;
+}
+
+size_t VoiceAllocator::sounding_count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sounding.count;
+}
+
+size_t VoiceAllocator::stolen() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stolen_count;
+}
+
+size_t VoiceAllocator::dropped() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped_count;
+}
+}
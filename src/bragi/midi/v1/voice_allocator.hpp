@@ -0,0 +1,220 @@
+/**
+ * @file voice_allocator.hpp
+ * @brief Assigning notes to a limited set of voices, such as the member channels of an MPE zone
+ */
+#ifndef _BRAGI_MIDI_V1_VOICE_ALLOCATOR_HPP_
+#define _BRAGI_MIDI_V1_VOICE_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <bragi/midi/v1/constants.hpp>
+#include <bragi/midi/v1/output.hpp>
+
+namespace bragi::midi::v1 {
+/**
+ * @brief Which sounding note to end when a note starts and every voice is in use
+ */
+enum class StealPolicy : uint8_t {
+    oldest,     ///< The note which started first
+    newest,     ///< The note which started last
+    quietest,   ///< The note with the lowest velocity, the oldest of those if several
+    none,       ///< Do not steal, drop the new note instead
+};
+
+/**
+ * @brief Assigns each note to a voice, stealing one when all are in use
+ *
+ * Each voice plays on a channel given to the constructor. For MPE every voice gets its own member channel, so pitch
+ * bend, channel pressure and timbre (CC74) sent for a note only affect that note. For a synth playing a limited number
+ * of notes on one channel, give that channel once per voice.
+ *
+ * Voices are kept in intrusive lists - free, sounding and released - and sounding voices are also listed by velocity,
+ * so starting, ending and stealing a note take constant time however many voices there are. A new note takes a free
+ * voice first, then the voice released longest ago, so release tails ring as long as possible, and only then steals
+ * according to the StealPolicy. A stolen note is sent its NOTE OFF before the new note starts.
+ *
+ * Expression set for a note is reset with the NOTE ON of the next note on the same voice, sending only the values that
+ * are not already at their defaults - no pitch bend, no pressure and a timbre of @c 64.
+ *
+ * Notes are identified by the number note_on() returns, holding the voice and a 32-bit count of the notes that voice
+ * has played, so an id only comes back after 2^32 notes on the same voice. Calls for a note that ended or was stolen
+ * do nothing.
+ */
+class VoiceAllocator {
+    public:
+        /// @brief Returned by note_on() when no voice was free and nothing could be stolen
+        constexpr static uint64_t no_voice = ~uint64_t(0);
+
+        /// @brief Controller of the MPE timbre dimension
+        constexpr static uint8_t timbre_controller = 74;
+
+    protected:
+        constexpr static uint16_t nil = 0xFFFF;
+
+        enum State : uint8_t {
+            free_state,
+            sounding_state,
+            released_state,
+        };
+
+        struct Links {
+            uint16_t prev = nil;
+            uint16_t next = nil;
+        };
+
+        struct List {
+            uint16_t head  = nil;
+            uint16_t tail  = nil;
+            uint16_t count = 0;
+        };
+
+        struct Voice {
+            Links    order;             // In the list of its state, oldest first
+            Links    level;             // In the list of its velocity, while sounding
+            State    state      = free_state;
+            uint8_t  channel    = 0;
+            uint8_t  pitch      = 0;
+            uint8_t  velocity   = 0;
+            uint32_t generation = 0;
+            uint16_t bend       = 0x2000;
+            uint8_t  pressure   = 0;
+            uint8_t  timbre     = 64;
+        };
+
+        std::shared_ptr<Output>  output;
+        StealPolicy              policy;
+
+        std::mutex               mutex;
+        std::vector<Voice>       voices;
+        List                     free_voices;
+        List                     sounding;
+        List                     released;
+        List                     levels[128];
+        uint64_t                 used_levels[2] = {0, 0};
+        size_t                   stolen_count   = 0;
+        size_t                   dropped_count  = 0;
+
+        void push_back(List& list, Links Voice::* links, uint16_t index);
+        void unlink(List& list, Links Voice::* links, uint16_t index);
+        List& state_list(State state);
+        uint16_t choose_locked();
+        Voice* find_locked(uint64_t note);
+
+    public:
+        /// @brief Disable empty constructor
+        VoiceAllocator() = delete;
+
+        /**
+         * @brief Allocate voices on an output
+         *
+         * @param [in] output Connected output to send to
+         * @param [in] channels Channel of each voice, the same channel may be given several times
+         * @param [in] policy What to do when a note starts while every voice is sounding
+         *
+         * @throws std::invalid_argument if @b output is empty, @b channels is empty or has more than 65534 voices, or
+         *         any channel is greater than 15
+         */
+        VoiceAllocator(std::shared_ptr<Output> output, std::vector<uint8_t> channels,
+                       StealPolicy policy = StealPolicy::oldest);
+
+        /**
+         * @brief Member channels of an MPE lower zone, managed on channel @c 0
+         *
+         * @param [in] members Number of member channels @c 1 - @c 15, starting with channel @c 1
+         *
+         * @throws std::invalid_argument if @b members is not from 1 to 15
+         */
+        static std::vector<uint8_t> mpe_lower_zone(uint8_t members = 15);
+
+        /**
+         * @brief Member channels of an MPE upper zone, managed on channel @c 15
+         *
+         * @param [in] members Number of member channels @c 1 - @c 15, starting with channel @c 14 and counting down
+         *
+         * @throws std::invalid_argument if @b members is not from 1 to 15
+         */
+        static std::vector<uint8_t> mpe_upper_zone(uint8_t members = 15);
+
+        /**
+         * @brief Start a note on a voice
+         *
+         * @returns Id of the note, or no_voice if every voice is sounding and the policy is StealPolicy::none
+         *
+         * @throws std::range_error if @b pitch is greater than @c 0x7F or @b velocity is not from @c 1 to @c 0x7F
+         * @throws Whatever is thrown by Output::send_batch()
+         */
+        uint64_t note_on(uint8_t pitch, uint8_t velocity = max_velocity);
+
+        /**
+         * @brief End a note, leaving its voice to ring out
+         *
+         * @returns false if the note already ended or was stolen
+         *
+         * @throws std::range_error if @b velocity is greater than @c 0x7F
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        bool note_off(uint64_t note, uint8_t velocity = 0x40);
+
+        /**
+         * @brief Bend the pitch of a note, @c 0x2000 being no bend
+         *
+         * @returns false if the note already ended or was stolen
+         *
+         * @throws std::range_error if @b value is greater than @c 0x3FFF
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        bool pitch_bend(uint64_t note, uint16_t value);
+
+        /**
+         * @brief Set the pressure of a note, as channel pressure on its voice
+         *
+         * @returns false if the note already ended or was stolen
+         *
+         * @throws std::range_error if @b value is greater than @c 0x7F
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        bool pressure(uint64_t note, uint8_t value);
+
+        /**
+         * @brief Set the timbre of a note, as controller 74 on its voice
+         *
+         * @returns false if the note already ended or was stolen
+         *
+         * @throws std::range_error if @b value is greater than @c 0x7F
+         * @throws Whatever is thrown by Output::send_msg()
+         */
+        bool timbre(uint64_t note, uint8_t value);
+
+        /**
+         * @brief Channel a note plays on
+         *
+         * @throws std::domain_error if the note already ended or was stolen
+         */
+        uint8_t channel(uint64_t note);
+
+        /**
+         * @brief End every sounding note
+         *
+         * @throws Whatever is thrown by Output::send_batch()
+         */
+        void release_all();
+
+        /// @brief Change how voices are stolen from now on
+        void set_policy(StealPolicy policy);
+
+        /// @brief Number of notes sounding
+        size_t sounding_count();
+
+        /// @brief Number of notes ended early to free their voice
+        size_t stolen();
+
+        /// @brief Number of notes not played as no voice could be stolen
+        size_t dropped();
+};
+}
+
+#endif //_BRAGI_MIDI_V1_VOICE_ALLOCATOR_HPP_//
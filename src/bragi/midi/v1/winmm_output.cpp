@@ -0,0 +1,196 @@
+#ifndef _WIN32
+    #error "WinMM backend is only available on Windows!"
+#endif
+
+#include <Windows.h>
+#include <mmeapi.h>
+// #include <mmsystem.h>
+// winmm.lib
+
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+
+#include <bragi/midi/v1/output_backend.hpp>
+
+namespace bragi::midi::v1 {
+static void throw_sys_err(int err_code) {
+    throw std::system_error(std::error_code(err_code, std::system_category()));
+}
+
+/********************************/
+/* WinMM backend                */
+/********************************/
+class WinmmOutput : public OutputBackend {
+    protected:
+        UINT                   device;
+        mutable MIDIOUTCAPS    details = {0};
+        mutable std::once_flag described;         // Capabilities are read on first use, see caps()
+        HMIDIOUT               connection = nullptr;
+        HANDLE                 done       = nullptr; // Signalled by the driver when it is finished with a buffer
+
+        // Not read up front, as the registry answers from its cache and an output would otherwise query the driver
+        // every time it is constructed
+        const MIDIOUTCAPS& caps() const {
+            std::call_once(described, [this]() {
+                int err = ::midiOutGetDevCaps(device, &details, sizeof(details));
+
+                if ( err != MMSYSERR_NOERROR )
+                    throw_sys_err(err);
+            });
+            return details;
+        }
+
+    public:
+        WinmmOutput(UINT dev): device(dev) {
+            if ( dev >= ::midiOutGetNumDevs() )
+                throw std::domain_error("No such output!");
+
+            done = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+            if ( !done )
+                throw_sys_err(static_cast<int>(::GetLastError()));
+        }
+
+        /// @brief Disable copy constructor, the event handle is owned
+        WinmmOutput(const WinmmOutput&) = delete;
+
+        /// @brief Disable copy assignment, the event handle is owned
+        WinmmOutput& operator=(const WinmmOutput&) = delete;
+
+        ~WinmmOutput() {
+            disconnect();
+            ::CloseHandle(done);
+        }
+
+        void disconnect() override {
+            if ( connection ) {
+                ::midiOutClose(connection);
+                connection = nullptr;
+            }
+        }
+
+        void connect() override {
+            if ( connection )
+                throw std::logic_error("Already connected!");
+
+            int err = ::midiOutOpen(&connection, device, reinterpret_cast<DWORD_PTR>(done), 0, CALLBACK_EVENT);
+
+            if ( err != MMSYSERR_NOERROR )
+                throw_sys_err(err);
+        }
+
+        void send_short(uint8_t msg_type, uint8_t b1, uint8_t b2) override {
+            if ( !connection )
+                throw std::logic_error("Not connected!");
+
+            DWORD msg = msg_type | b1 << 8 | b2 << 16;
+            int err = ::midiOutShortMsg(connection, msg);
+            if ( err != MMSYSERR_NOERROR )
+                throw_sys_err(err);
+        }
+
+        void send_long(const uint8_t* data, size_t size) override {
+            if ( !connection )
+                throw std::logic_error("Not connected!");
+
+            MIDIHDR header = {0};
+            header.lpData         = reinterpret_cast<LPSTR>(const_cast<uint8_t*>(data));
+            header.dwBufferLength = static_cast<DWORD>(size);
+
+            int err = ::midiOutPrepareHeader(connection, &header, sizeof(header));
+            if ( err != MMSYSERR_NOERROR )
+                throw_sys_err(err);
+
+            // Left signalled by earlier notifications, such as MOM_OPEN
+            ::ResetEvent(done);
+            err = ::midiOutLongMsg(connection, &header, sizeof(header));
+
+            // The driver owns the buffer until it marks it done, sleeping rather than spinning as this takes 320 us a
+            // byte on a physical port
+            if ( err == MMSYSERR_NOERROR )
+                while ( !(header.dwFlags & MHDR_DONE) )
+                    ::WaitForSingleObject(done, INFINITE);
+
+            ::midiOutUnprepareHeader(connection, &header, sizeof(header));
+
+            if ( err != MMSYSERR_NOERROR )
+                throw_sys_err(err);
+        }
+
+        bool physical_device() const override {
+            return caps().wTechnology == MOD_MIDIPORT;
+        }
+
+        uint16_t manufacturer_id() const override {
+            return caps().wMid;
+        }
+
+        uint16_t product_id() const override {
+            return caps().wPid;
+        }
+
+        std::string product_name() const override {
+            // if ( details.szPname )
+                // return {details.szPname, details.szPname + wcslen(details.szPname)};
+            const MIDIOUTCAPS& found = caps();
+            return {found.szPname, found.szPname + strlen(found.szPname)};
+        }
+};
+
+/********************************/
+/* Implementation               */
+/********************************/
+unsigned int system_output_count() {
+    return ::midiOutGetNumDevs();
+}
+
+std::unique_ptr<OutputBackend> system_output_backend(unsigned int out_no) {
+    return std::unique_ptr<OutputBackend>(new WinmmOutput(out_no));
+}
+}
+
+
+
+
+// struct _OutputImpl {
+//     HMIDIOUT    target = nullptr;
+//     UINT        port;
+//     MIDIOUTCAPS details = {0};
+//     bool        connected = false;
+// };
+
+// static inline _OutputImpl* get_output(void* pimpl) {
+//     if ( pimpl == nullptr )
+//         throw std::runtime_error("Incomplete Output!");
+
+//     _OutputImpl* impl = reinterpret_cast<_OutputImpl*>(pimpl);
+
+//     if ( impl->target == nullptr )
+//         throw std::runtime_error("Malformed Output!");
+
+//     return impl;
+// }
+
+// static void cleanup(void* pimpl) {
+//     if ( !pimpl )
+//         return;
+
+//     try {
+//         _OutputImpl* impl = get_output(pimpl);
+
+//         if ( impl->connected ) {
+//             ::midiOutClose(impl->target);
+//         }
+
+
+//     } catch ( std::runtime_error ) {
+//         return;
+//     }
+// }
+
+// namespace bragi::midi {
+//     Output::~Output() {
+//         cleanup(pimpl);
+//     }
+// }
@@ -0,0 +1,31 @@
+/**
+ * @file check.hpp
+ * @brief Minimal assertions for the tests, which are plain programs failing with a non-zero exit code
+ */
+#ifndef _BRAGI_MIDI_TESTS_CHECK_HPP_
+#define _BRAGI_MIDI_TESTS_CHECK_HPP_
+
+#include <cstdio>
+
+/// @brief Number of failed checks so far, returned by check_result()
+inline int check_failures = 0;
+
+inline bool check(bool passed, const char* condition, const char* file, int line) {
+    if ( !passed ) {
+        std::fprintf(stderr, "FAILED: %s (%s:%d)\n", condition, file, line);
+        check_failures++;
+    }
+    return passed;
+}
+
+/// @brief Exit code of a test, @c 1 if any check failed
+inline int check_result() {
+    if ( check_failures )
+        std::fprintf(stderr, "%d checks failed\n", check_failures);
+    return check_failures ? 1 : 0;
+}
+
+/// @brief Record a failure if @b condition is false, evaluates to @b condition
+#define CHECK(condition) check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+#endif //_BRAGI_MIDI_TESTS_CHECK_HPP_//
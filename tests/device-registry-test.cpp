@@ -0,0 +1,147 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include "check.hpp"
+
+using namespace bragi::midi::v1;
+using namespace std::chrono_literals;
+
+static std::basic_string<uint8_t> bytes(std::initializer_list<uint8_t> values) {
+    return std::basic_string<uint8_t>(values);
+}
+
+// Capabilities come from the provider once, and acquiring again reuses the connection
+static void test_caching_and_pooling() {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(2);
+    DeviceRegistry                           registry(devices, 1h);
+
+    CHECK(registry.count() == 2);
+    std::vector<DeviceInfo> listed = registry.list();
+    CHECK(listed.size() == 2 && listed[1].product_name == "simulated:1" && listed[1].out_no == 1);
+    CHECK(devices->opened(1) == 1);
+
+    try {
+        registry.info(2);
+        CHECK(!"info() of a missing device should throw");
+    } catch ( std::domain_error& ) {}
+
+    std::shared_ptr<Output> first = registry.acquire(1);
+    for ( int i = 0; i < 100; i++ )
+        CHECK(registry.acquire(1) == first);
+    CHECK(devices->opened(1) == 2);
+    CHECK(devices->connections(1) == 1);
+
+    first->send_msg(ShortMessage(0x90, 60, 100));
+    CHECK(devices->sent(1) == bytes({0x90, 60, 100}));
+
+    // Answered from the cache, without opening the device again
+    std::unique_ptr<OutputBackend> separate = registry.open(1);
+    CHECK(separate->product_name() == "simulated:1");
+    CHECK(devices->opened(1) == 3);
+
+    // Held by a user, so not idle
+    CHECK(registry.close_idle() == 0);
+    first.reset();
+    CHECK(registry.close_idle() == 1);
+    CHECK(registry.acquire(1) != nullptr && devices->connections(1) == 2);
+}
+
+// A changed device count reloads the list and empties the pool
+static void test_hot_plug() {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(1);
+    DeviceRegistry                           registry(devices, 0ms);
+
+    std::shared_ptr<Output> before = registry.acquire(0);
+    devices->set_count(2);
+    CHECK(registry.count() == 2);
+
+    std::shared_ptr<Output> after = registry.acquire(0);
+    CHECK(after != before);
+
+    // Outputs handed out earlier keep working
+    before->send_msg(ShortMessage(0x80, 60, 0));
+    CHECK(devices->sent(0) == bytes({0x80, 60, 0}));
+
+    devices->set_count(0);
+    try {
+        registry.acquire(0);
+        CHECK(!"acquire() of a removed device should throw");
+    } catch ( std::domain_error& ) {}
+}
+
+// Connecting a slow device holds up neither other calls nor anyone but those acquiring the same device
+static void test_connect_outside_lock() {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(2, 300ms);
+    DeviceRegistry                           registry(devices, 1h);
+    registry.count();
+
+    std::shared_ptr<Output> first, second;
+    std::thread             connecting([&]() { first = registry.acquire(0); });
+    std::this_thread::sleep_for(50ms);
+    std::thread             waiting([&]() { second = registry.acquire(0); });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CHECK(registry.count() == 2);
+    CHECK(registry.info(1).product_name == "simulated:1");
+    CHECK(std::chrono::steady_clock::now() - start < 100ms);
+
+    connecting.join();
+    waiting.join();
+    CHECK(first && first == second);
+    CHECK(devices->connections(0) == 1);
+}
+
+// A failed connection is not pooled, so the next attempt connects again
+static void test_failed_connect() {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(1, 200ms);
+    DeviceRegistry                           registry(devices, 1h);
+    registry.count();
+
+    // Removed while connecting
+    bool        failed = false;
+    std::thread connecting([&]() {
+        try {
+            registry.acquire(0);
+        } catch ( std::system_error& ) {
+            failed = true;
+        }
+    });
+    std::this_thread::sleep_for(50ms);
+    devices->set_count(0);
+    connecting.join();
+    CHECK(failed);
+
+    devices->set_count(1);
+    std::shared_ptr<Output> output = registry.acquire(0);
+    CHECK(output && devices->connections(0) == 1);
+}
+
+// Output(out_no) goes through the process-wide registry
+static void test_output_constructor() {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(2);
+    DeviceRegistry::instance().set_provider(devices);
+
+    CHECK(Output::output_count() == 2);
+
+    Output output(1);
+    CHECK(output.product_name() == "simulated:1");
+    output.connect();
+    output.send_msg(ShortMessage(0xB0, 7, 100));
+    CHECK(devices->sent(1) == bytes({0xB0, 7, 100}));
+
+    DeviceRegistry::instance().set_provider(nullptr);
+}
+
+int main() {
+    test_caching_and_pooling();
+    test_hot_plug();
+    test_connect_outside_lock();
+    test_failed_connect();
+    test_output_constructor();
+    return check_result();
+}
@@ -0,0 +1,150 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace bragi::midi::v1;
+
+static bool before(const NoteSpan& a, const NoteSpan& b) {
+    if ( a.start != b.start )
+        return a.start < b.start;
+    return a.end != b.end ? a.end < b.end : a.pitch < b.pitch;
+}
+
+static bool same(const NoteSpan& a, const NoteSpan& b) {
+    return a.start == b.start && a.end == b.end && a.pitch == b.pitch;
+}
+
+// Pairing, velocity 0 as NOTE OFF, repeated pitches ending first in first out, and stray NOTE OFF messages
+static void test_builder() {
+    NoteSpanBuilder builder;
+    NoteSpan        span;
+
+    CHECK(!builder.add(0, ShortMessage(0x91, 60, 100), span));
+    CHECK(!builder.add(10, ShortMessage(0x91, 60, 90), span));
+    CHECK(!builder.add(15, ShortMessage(0xB1, 7, 100), span));
+    CHECK(builder.held() == 2);
+
+    CHECK(builder.add(20, ShortMessage(0x91, 60, 0), span));
+    CHECK(span.start == 0 && span.end == 20 && span.velocity == 100 && span.channel == 1 && span.pitch == 60);
+    CHECK(builder.add(30, ShortMessage(0x81, 60, 64), span));
+    CHECK(span.start == 10 && span.end == 30 && span.velocity == 90);
+
+    // Another channel, then nothing left to end
+    CHECK(!builder.add(40, ShortMessage(0x80, 60, 64), span));
+    CHECK(!builder.add(40, ShortMessage(0x81, 60, 64), span));
+    CHECK(builder.unmatched() == 2 && builder.held() == 0);
+
+    std::vector<NoteSpan> spans;
+    builder.add(50, ShortMessage(0x9F, 72, 80), span);
+    builder.finish(70, spans);
+    CHECK(spans.size() == 1 && spans[0].start == 50 && spans[0].end == 70 && spans[0].channel == 15);
+}
+
+// Queries return exactly what checking every span would, while spans keep arriving
+static void test_against_brute_force(unsigned int seed) {
+    std::mt19937          random(seed);
+    NoteSpanIndex         index;
+    std::vector<NoteSpan> all;
+    std::vector<NoteSpan> found;
+    std::vector<NoteSpan> expected;
+
+    // Times on a coarse grid, so many notes share their start or end, as in quantized music
+    auto    time = [&](int64_t range) { return static_cast<int64_t>(random() % range) / 8 * 8; };
+    int64_t at   = 0;
+
+    for ( int round = 0; round < 20; round++ ) {
+        size_t count = 1 + random() % 400;
+        for ( size_t i = 0; i < count; i++ ) {
+            NoteSpan span;
+
+            // Mostly in order of start, as recorded, now and then earlier
+            at += time(16);
+            span.start    = random() % 8 ? at : std::max<int64_t>(0, at - time(4000));
+            span.end      = span.start + (random() % 10 ? time(200) : random() % 2 ? 0 : time(8000));
+            span.pitch    = random() % 128;
+            span.velocity = 1 + random() % 127;
+            span.channel  = random() % 3 ? 2 : 9;
+
+            index.insert(span);
+            all.push_back(span);
+        }
+
+        for ( int query = 0; query < 40; query++ ) {
+            uint8_t channel = random() % 2 ? 2 : 9;
+            int64_t from    = time(at + 100);
+            int64_t to      = from + (random() % 8 ? time(2000) : 0);
+
+            // Exactly at the start or end of a span
+            if ( random() % 4 == 0 ) {
+                const NoteSpan& span = all[random() % all.size()];
+                from = random() % 2 ? span.start : span.end;
+            }
+
+            found.clear();
+            size_t returned = index.query(channel, from, to, found);
+            CHECK(returned == found.size());
+
+            // Notes sounding at @b from come first, then those starting later in order
+            size_t later = 0;
+            while ( later < found.size() && found[later].start < from )
+                later++;
+            for ( size_t i = later; i < found.size(); i++ )
+                CHECK(found[i].start >= from && (i == later || found[i - 1].start <= found[i].start));
+
+            // An empty range holds nothing, not even the notes sounding at its point in time
+            expected.clear();
+            for ( const NoteSpan& span : all )
+                if ( span.channel == channel && from < to && span.start < to && span.end > from )
+                    expected.push_back(span);
+
+            std::sort(found.begin(), found.end(), before);
+            std::sort(expected.begin(), expected.end(), before);
+            CHECK(found.size() == expected.size() && std::equal(found.begin(), found.end(), expected.begin(), same));
+        }
+    }
+
+    CHECK(index.size() == all.size());
+    index.clear();
+    found.clear();
+    CHECK(index.size() == 0 && index.query(2, 0, at, found) == 0);
+}
+
+// Recorded messages become spans once ended, or at finish()
+static void test_recording() {
+    NoteSpanIndex index;
+    index.record(0, ShortMessage(0x90, 60, 100));
+    index.record(100, ShortMessage(0x90, 64, 100));
+    index.record(200, ShortMessage(0x80, 60, 0));
+
+    std::vector<NoteSpan> found;
+    CHECK(index.size() == 1);
+    CHECK(index.query(0, 150, 160, found) == 1 && found[0].pitch == 60);
+
+    index.finish(300);
+    found.clear();
+    CHECK(index.size() == 2);
+    CHECK(index.query(0, 250, 260, found) == 1 && found[0].pitch == 64 && found[0].end == 300);
+
+    // Nothing sounds in an empty range, or before the first note
+    found.clear();
+    CHECK(index.query(0, 150, 150, found) == 0);
+    CHECK(index.query(0, -50, 0, found) == 0);
+
+    try {
+        index.query(16, 0, 100, found);
+        CHECK(!"a channel above 15 should throw");
+    } catch ( std::range_error& ) {}
+}
+
+int main() {
+    test_builder();
+    for ( unsigned int seed = 0; seed < 5; seed++ )
+        test_against_brute_force(seed);
+    test_recording();
+    return check_result();
+}
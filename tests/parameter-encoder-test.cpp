@@ -0,0 +1,162 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+#include "check.hpp"
+
+using namespace bragi::midi::v1;
+
+using Bytes = std::basic_string<uint8_t>;
+
+/**
+ * @brief An encoder sending to a simulated device, handing back what each step sent
+ */
+struct Recorded {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(1);
+    DeviceRegistry                           registry{devices, std::chrono::hours(1)};
+    ParameterEncoder                         encoder{registry.acquire(0)};
+
+    /// @brief Bytes sent since the last call
+    Bytes take() {
+        Bytes sent = devices->sent(0);
+        devices->clear();
+        return sent;
+    }
+};
+
+/// @brief Controller changes on a channel, as pairs of controller and value
+static Bytes cc(uint8_t channel, std::initializer_list<uint8_t> pairs) {
+    Bytes   bytes;
+    uint8_t status = MessageType::controller_change | channel;
+    for ( const uint8_t* pair = pairs.begin(); pair != pairs.end(); pair += 2 )
+        bytes += Bytes({status, pair[0], pair[1]});
+    return bytes;
+}
+
+// Only the half of the selection which changed is sent again, followed by the data entry in full
+static void test_select_halves() {
+    Recorded rec;
+
+    rec.encoder.registered(0x0081, 0x0102);
+    CHECK(rec.take() == cc(0, {101, 0x01, 100, 0x01, 6, 0x02, 38, 0x02}));
+
+    // Same MSB of the parameter number
+    rec.encoder.registered(0x0085, 0x0102);
+    CHECK(rec.take() == cc(0, {100, 0x05, 6, 0x02, 38, 0x02}));
+
+    // Same LSB
+    rec.encoder.registered(0x0105, 0x0102);
+    CHECK(rec.take() == cc(0, {101, 0x02, 6, 0x02, 38, 0x02}));
+
+    // Channels are tracked apart
+    rec.encoder.registered(0x0105, 0x0102, 3);
+    CHECK(rec.take() == cc(3, {101, 0x02, 100, 0x05, 6, 0x02, 38, 0x02}));
+}
+
+// Switching between RPN and NRPN selects the parameter in full, even for the same number
+static void test_registered_switch() {
+    Recorded rec;
+
+    rec.encoder.registered(0x0000, 0x0100);
+    rec.take();
+
+    rec.encoder.non_registered(0x0000, 0x0100);
+    CHECK(rec.take() == cc(0, {99, 0x00, 98, 0x00, 6, 0x02, 38, 0x00}));
+
+    rec.encoder.non_registered(0x0000, 0x0101);
+    CHECK(rec.take() == cc(0, {38, 0x01}));
+
+    rec.encoder.registered(0x0000, 0x0101);
+    CHECK(rec.take() == cc(0, {101, 0x00, 100, 0x00, 6, 0x02, 38, 0x01}));
+}
+
+// A new MSB is always followed by its LSB, a new LSB alone goes out alone, and an unchanged value sends nothing
+static void test_value_halves() {
+    Recorded rec;
+
+    rec.encoder.controller(7, 0x1234);
+    CHECK(rec.take() == cc(0, {7, 0x24, 39, 0x34}));
+
+    rec.encoder.controller(7, 0x1235);
+    CHECK(rec.take() == cc(0, {39, 0x35}));
+
+    // The LSB is the same as before, but follows the new MSB anyway
+    rec.encoder.controller(7, 0x1435);
+    CHECK(rec.take() == cc(0, {7, 0x28, 39, 0x35}));
+
+    rec.encoder.controller(7, 0x1435);
+    CHECK(rec.take().empty());
+
+    rec.encoder.registered(0x0002, 0x0040);
+    rec.take();
+    rec.encoder.registered(0x0002, 0x0040);
+    CHECK(rec.take().empty());
+    rec.encoder.registered(0x0002, 0x00C0);
+    CHECK(rec.take() == cc(0, {6, 0x01, 38, 0x40}));
+
+    // Each step sent 2, 1, 2, 0, 4, 0 and 2 messages, leaving out 0, 1, 0, 2, 0, 4 and 2
+    CHECK(rec.encoder.sent() == 11);
+    CHECK(rec.encoder.saved() == 9);
+}
+
+// Several changes go out together, in order
+static void test_batch() {
+    Recorded rec;
+
+    ParameterChange changes[] = {
+        {ParameterChange::controller, 1, 1, 0x0080},
+        {ParameterChange::registered, 1, 0x0000, 0x0180},
+        {ParameterChange::registered, 1, 0x0000, 0x0181},
+    };
+    rec.encoder.send(changes, 3);
+    CHECK(rec.take() == cc(1, {1, 0x01, 33, 0x00, 101, 0x00, 100, 0x00, 6, 0x03, 38, 0x00, 38, 0x01}));
+
+    // Out of range, so nothing at all is sent
+    ParameterChange bad[] = {
+        {ParameterChange::controller, 1, 1, 0x0000},
+        {ParameterChange::controller, 1, 32, 0x0000},
+    };
+    try {
+        rec.encoder.send(bad, 2);
+        CHECK(!"a controller above 31 should throw");
+    } catch ( std::range_error& ) {}
+    CHECK(rec.take().empty());
+}
+
+// After invalidate() everything is sent in full, deselect() selects the null RPN once
+static void test_invalidate_and_deselect() {
+    Recorded rec;
+
+    rec.encoder.controller(1, 0x0100);
+    rec.encoder.registered(0x0001, 0x2000);
+    rec.take();
+
+    rec.encoder.invalidate();
+    rec.encoder.controller(1, 0x0100);
+    rec.encoder.registered(0x0001, 0x2000);
+    CHECK(rec.take() == cc(0, {1, 0x02, 33, 0x00, 101, 0x00, 100, 0x01, 6, 0x40, 38, 0x00}));
+
+    rec.encoder.deselect();
+    CHECK(rec.take() == cc(0, {101, 0x7F, 100, 0x7F}));
+    rec.encoder.deselect();
+    CHECK(rec.take().empty());
+
+    // The parameter and its value are sent again, as the receiver no longer has them selected
+    rec.encoder.registered(0x0001, 0x2000);
+    CHECK(rec.take() == cc(0, {101, 0x00, 100, 0x01, 6, 0x40, 38, 0x00}));
+
+    // Controllers are not affected by the selection
+    rec.encoder.controller(1, 0x0100);
+    CHECK(rec.take().empty());
+}
+
+int main() {
+    test_select_halves();
+    test_registered_switch();
+    test_value_halves();
+    test_batch();
+    test_invalidate_and_deselect();
+    return check_result();
+}
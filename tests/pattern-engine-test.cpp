@@ -0,0 +1,172 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace bragi::midi::v1;
+using namespace std::chrono_literals;
+
+using Bytes = std::basic_string<uint8_t>;
+
+/**
+ * @brief Notes found in what was sent, up to the first controller change, which only stop() sends
+ */
+struct Notes {
+    std::vector<ShortMessage> played;
+    size_t                    stray   = 0; // NOTE OFF without a sounding note
+    size_t                    hanging = 0; // NOTE ON without a NOTE OFF
+
+    explicit Notes(const Bytes& sent) {
+        std::map<unsigned int, size_t> sounding;
+
+        // The engine only sends 3-byte messages, each with its status
+        for ( size_t i = 0; i + 3 <= sent.size(); i += 3 ) {
+            ShortMessage msg(sent[i], sent[i + 1], sent[i + 2]);
+            if ( (msg.status() & 0xF0) == MessageType::controller_change )
+                break;
+            played.push_back(msg);
+
+            unsigned int key = (msg.status() & 0x0F) << 7 | msg.data1();
+            if ( !off(msg) )
+                sounding[key]++;
+            else if ( sounding[key] == 0 )
+                stray++;
+            else
+                sounding[key]--;
+        }
+
+        for ( const auto& [key, count] : sounding )
+            hanging += count;
+    }
+
+    static bool off(const ShortMessage& msg) {
+        return (msg.status() & 0xF0) == MessageType::note_off || msg.data2() == 0;
+    }
+
+    /// @brief Index of the first NOTE ON, or NOTE OFF, of a pitch, played.size() if there is none
+    size_t find(bool note_off, uint8_t pitch) const {
+        for ( size_t i = 0; i < played.size(); i++ )
+            if ( played[i].data1() == pitch && off(played[i]) == note_off )
+                return i;
+        return played.size();
+    }
+};
+
+// Edits made while a note held across a bar line sounds, each of which used to leave it without a NOTE OFF
+enum class Edit { pitch, mute, shorter, remove, replace };
+
+static void test_edit_held_note(Edit edit) {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(1);
+    DeviceRegistry                           registry(devices, 1h);
+
+    // Bars of 200 ms and steps of 12.5 ms, so the note starts 150 ms into the first bar and ends 50 ms into the next
+    PatternEngine engine(registry.acquire(0), 1200, 4, 4, 0, 1ms);
+    Pattern       pattern;
+    pattern.steps.resize(16);
+    pattern.steps[12] = {60, 100, 8, 1};
+    size_t id = engine.add(pattern);
+
+    PatternEngine::clock::time_point start = PatternEngine::clock::now() + 20ms;
+    engine.start(start);
+    std::this_thread::sleep_until(start + 170ms);
+
+    switch ( edit ) {
+        case Edit::pitch:   engine.set_step(id, 12, {61, 100, 8, 1}); break;
+        case Edit::mute:    engine.set_step(id, 12, {60, 0, 8, 1}); break;
+        case Edit::shorter: engine.set_step(id, 12, {60, 100, 1, 1}); break;
+        case Edit::remove:  engine.remove(id); break;
+        case Edit::replace:
+            pattern.steps[12].pitch = 62;
+            engine.set(id, pattern);
+            break;
+    }
+
+    // Into the third bar, before its note starts
+    std::this_thread::sleep_until(start + 500ms);
+    Notes notes(devices->sent(0));
+    engine.stop();
+
+    CHECK(notes.stray == 0);
+    CHECK(notes.hanging == 0);
+    CHECK(notes.find(false, 60) == 0);
+    CHECK(notes.find(true, 60) < notes.played.size());
+}
+
+// Random edits of every kind, then every pattern is removed, after which every note must have ended
+static void test_random_edits(unsigned int seed) {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(1);
+    DeviceRegistry                           registry(devices, 1h);
+    PatternEngine                            engine(registry.acquire(0), 2400, 2, 3, seed, 300us);
+    std::mt19937                             random(seed);
+
+    auto random_pattern = [&]() {
+        Pattern pattern;
+        pattern.channel        = random() % 2;
+        pattern.steps_per_beat = 1 + random() % 8;
+        pattern.swing          = (random() % 5) / 10.0f;
+        pattern.steps.resize(1 + random() % 9);
+        for ( PatternStep& step : pattern.steps ) {
+            step.pitch       = 60 + random() % 3;
+            step.velocity    = random() % 3 ? 100 : 0;
+            step.gate        = 0.1f + (random() % 60) / 10.0f;
+            step.probability = (random() % 4) / 3.0f;
+        }
+        return pattern;
+    };
+
+    std::vector<size_t> ids;
+    for ( int i = 0; i < 3; i++ )
+        ids.push_back(engine.add(random_pattern()));
+    engine.start();
+
+    for ( int i = 0; i < 150; i++ ) {
+        std::this_thread::sleep_for(std::chrono::microseconds(random() % 4000));
+        unsigned int kind = random() % 10;
+        size_t       id   = ids[random() % ids.size()];
+
+        // Removed or too short patterns throw, which is fine
+        try {
+            if ( kind < 6 ) {
+                engine.set_step(id, random() % 9, random_pattern().steps[0]);
+            } else if ( kind < 8 ) {
+                engine.set(id, random_pattern());
+            } else if ( kind < 9 ) {
+                engine.remove(id);
+                ids.push_back(engine.add(random_pattern()));
+            } else {
+                engine.set_tempo(1200 + random() % 2400);
+            }
+        } catch ( std::domain_error& ) {}
+    }
+
+    for ( size_t id : ids ) {
+        try {
+            engine.remove(id);
+        } catch ( std::domain_error& ) {}
+    }
+
+    // Bars of 50 ms, notes of at most 6.1 beats
+    engine.set_tempo(2400);
+    std::this_thread::sleep_for(600ms);
+    Notes notes(devices->sent(0));
+    engine.stop();
+
+    CHECK(!notes.played.empty());
+    CHECK(notes.stray == 0);
+    CHECK(notes.hanging == 0);
+}
+
+int main() {
+    for ( Edit edit : {Edit::pitch, Edit::mute, Edit::shorter, Edit::remove, Edit::replace} )
+        test_edit_held_note(edit);
+    for ( unsigned int seed = 0; seed < 6; seed++ )
+        test_random_edits(seed);
+    return check_result();
+}
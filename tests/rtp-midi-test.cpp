@@ -0,0 +1,258 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace bragi::midi::v1;
+
+// Two sessions on the loopback interface, talking through a relay which records the clock synchronization and can
+// drop the next RTP packet, to check the handshake, the CK exchange and recovery from a lost NOTE OFF.
+
+/**
+ * @brief A synchronization packet seen by the relay
+ */
+struct Sync {
+    bool     to_invitee;
+    uint8_t  count;
+    uint64_t ts[3];
+};
+
+static uint64_t get64(const uint8_t* bytes) {
+    uint64_t value = 0;
+    for ( size_t i = 0; i < 8; i++ )
+        value = value << 8 | bytes[i];
+    return value;
+}
+
+static int open_udp(uint16_t port) {
+    int sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(port);
+
+    if ( sock < 0 || ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ) {
+        if ( sock >= 0 )
+            ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static sockaddr_in loopback(uint16_t port) {
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(port);
+    return addr;
+}
+
+/**
+ * @brief Forwards between an inviting session and the session it thinks it invites
+ *
+ * The inviting session sends to ports facing it, the relay passes everything on from ports facing the invited
+ * session, and back.
+ */
+class Relay {
+    protected:
+        int                sockets[4] = {-1, -1, -1, -1}; // Control and data facing the inviter, then the invitee
+        sockaddr_in        inviter[2];
+        sockaddr_in        invitee[2];
+        std::atomic<bool>  running{true};
+        std::thread        worker;
+
+        void run() {
+            uint8_t buffer[2048];
+
+            while ( running ) {
+                pollfd polled[4];
+                for ( size_t i = 0; i < 4; i++ )
+                    polled[i] = {sockets[i], POLLIN, 0};
+                if ( ::poll(polled, 4, 20) <= 0 )
+                    continue;
+
+                for ( size_t i = 0; i < 4; i++ ) {
+                    if ( !(polled[i].revents & POLLIN) )
+                        continue;
+
+                    sockaddr_in from;
+                    socklen_t   from_size = sizeof(from);
+                    ssize_t     size      = ::recvfrom(sockets[i], buffer, sizeof(buffer), 0,
+                                                       reinterpret_cast<sockaddr*>(&from), &from_size);
+                    if ( size <= 0 )
+                        continue;
+
+                    bool   to_invitee = i < 2;
+                    size_t port       = i % 2;
+                    if ( to_invitee )
+                        inviter[port] = from;
+
+                    bool sync = size >= 36 && buffer[0] == 0xFF && buffer[1] == 0xFF && buffer[2] == 'C'
+                                && buffer[3] == 'K';
+                    if ( sync ) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        syncs.push_back({to_invitee, buffer[8],
+                                         {get64(buffer + 12), get64(buffer + 20), get64(buffer + 28)}});
+                    }
+
+                    bool rtp = (buffer[0] & 0xC0) == 0x80;
+                    if ( rtp && to_invitee && drop_next.exchange(false) ) {
+                        dropped++;
+                        continue;
+                    }
+
+                    const sockaddr_in& to = to_invitee ? invitee[port] : inviter[port];
+                    ::sendto(sockets[to_invitee ? 2 + port : port], buffer, static_cast<size_t>(size), 0,
+                             reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+                }
+            }
+        }
+
+    public:
+        std::mutex          mutex;
+        std::vector<Sync>   syncs;
+        std::atomic<bool>   drop_next{false};
+        std::atomic<size_t> dropped{0};
+        uint16_t            port = 0;
+
+        explicit Relay(uint16_t invitee_port) {
+            invitee[0] = loopback(invitee_port);
+            invitee[1] = loopback(invitee_port + 1);
+
+            for ( uint16_t base = 30000; base < 60000 && sockets[3] < 0; base += 4 ) {
+                for ( size_t i = 0; i < 4; i++ ) {
+                    if ( sockets[i] >= 0 )
+                        ::close(sockets[i]);
+                    sockets[i] = open_udp(static_cast<uint16_t>(base + i));
+                    if ( sockets[i] < 0 )
+                        break;
+                }
+                port = base;
+            }
+            if ( sockets[3] < 0 )
+                throw std::runtime_error("No free ports for the relay!");
+
+            worker = std::thread(&Relay::run, this);
+        }
+
+        ~Relay() {
+            running = false;
+            worker.join();
+            for ( int sock : sockets )
+                ::close(sock);
+        }
+};
+
+static std::unique_ptr<RtpMidiSession> open_session(const std::string& name, uint16_t first_port) {
+    for ( uint16_t port = first_port; port < first_port + 1000; port += 2 ) {
+        try {
+            return std::unique_ptr<RtpMidiSession>(new RtpMidiSession(name, port));
+        } catch ( std::system_error& ) {
+            // Taken, try the next pair
+        }
+    }
+    throw std::runtime_error("No free ports for a session!");
+}
+
+static bool wait_for(const std::function<bool()>& done) {
+    for ( int i = 0; i < 200; i++ ) {
+        if ( done() )
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+int main() {
+    std::unique_ptr<RtpMidiSession> inviter = open_session("inviter", 21000);
+    std::unique_ptr<RtpMidiSession> invitee = open_session("invitee", 23000);
+    Relay                           relay(invitee->control_port());
+
+    std::mutex                              received_mutex;
+    std::vector<std::basic_string<uint8_t>> received;
+    invitee->set_receiver([&](const Message& msg) {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        received.push_back(msg.serialize());
+    });
+    auto received_count = [&]() {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        return received.size();
+    };
+
+    // IN and OK on both ports
+    inviter->invite("127.0.0.1", relay.port, std::chrono::seconds(5));
+    CHECK(inviter->connected());
+    CHECK(wait_for([&]() { return invitee->connected(); }));
+
+    // CK 0 from the inviter, answered with CK 1, completed with CK 2, each echoing the earlier timestamps
+    CHECK(wait_for([&]() {
+        std::lock_guard<std::mutex> lock(relay.mutex);
+        return relay.syncs.size() >= 3;
+    }));
+    {
+        std::lock_guard<std::mutex> lock(relay.mutex);
+        if ( CHECK(relay.syncs.size() >= 3) ) {
+            const Sync* ck = relay.syncs.data();
+            CHECK(ck[0].to_invitee && ck[0].count == 0);
+            CHECK(!ck[1].to_invitee && ck[1].count == 1 && ck[1].ts[0] == ck[0].ts[0]);
+            CHECK(ck[2].to_invitee && ck[2].count == 2 && ck[2].ts[0] == ck[0].ts[0] && ck[2].ts[1] == ck[1].ts[1]);
+            CHECK(ck[2].ts[2] >= ck[2].ts[0]);
+        }
+    }
+
+    // Two notes arrive as sent
+    inviter->send(note_on(60, 100));
+    inviter->send(note_on(64, 100));
+    inviter->flush();
+    CHECK(wait_for([&]() { return received_count() == 2; }));
+
+    // The NOTE OFF of one is lost. Chapter N of the journal of the next packet ends that note, and only that one,
+    // before the next note starts
+    relay.drop_next = true;
+    inviter->send(note_off(60, 0));
+    inviter->flush();
+    CHECK(wait_for([&]() { return relay.dropped == 1; }));
+
+    inviter->send(note_on(62, 100));
+    inviter->flush();
+    CHECK(wait_for([&]() { return received_count() == 4; }));
+
+    {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        if ( CHECK(received.size() == 4) ) {
+            CHECK(received[0] == note_on(60, 100).serialize());
+            CHECK(received[1] == note_on(64, 100).serialize());
+            CHECK(received[2].size() == 3 && (received[2][0] & 0xF0) == MessageType::note_off && received[2][1] == 60);
+            CHECK(received[3] == note_on(62, 100).serialize());
+        }
+    }
+
+    RtpMidiStats stats = invitee->stats();
+    CHECK(stats.packets_received == 2);
+    CHECK(stats.packets_lost == 1);
+    CHECK(stats.notes_recovered == 1);
+
+    // BY ends the session on both sides
+    inviter->end();
+    CHECK(!inviter->connected());
+    CHECK(wait_for([&]() { return !invitee->connected(); }));
+
+    return check_result();
+}
@@ -0,0 +1,95 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+#include "check.hpp"
+
+using namespace bragi::midi::v1;
+
+// A writer and a reader in separate processes. The reader checks that every message arrives, in order and intact,
+// acknowledging each batch so the writer never laps it.
+
+constexpr size_t message_count = 20000;
+constexpr size_t batch_size    = 64;
+
+// Every 50th message is a system exclusive message spanning several slots, the rest are numbered pitch bends
+static std::basic_string<uint8_t> expected(size_t i) {
+    if ( i % 50 == 49 ) {
+        std::basic_string<uint8_t> bytes = {0xF0, 0x7D};
+        for ( size_t k = 0; k < 100; k++ )
+            bytes.push_back(static_cast<uint8_t>((i + k) & 0x7F));
+        bytes.push_back(0xF7);
+        return bytes;
+    }
+
+    return {static_cast<uint8_t>(0xE0 | i % 16), static_cast<uint8_t>(i & 0x7F), static_cast<uint8_t>(i >> 7 & 0x7F)};
+}
+
+static int read_all(const std::string& name, int ready, int ack) {
+    ShmReader  reader(name);
+    ShmMessage msg;
+    char       token = 0;
+
+    if ( ::write(ready, &token, 1) != 1 )
+        return 1;
+
+    for ( size_t i = 0; i < message_count; i++ ) {
+        if ( !CHECK(reader.read(msg, std::chrono::seconds(5))) )
+            break;
+        if ( !CHECK(msg.bytes == expected(i)) ) {
+            std::fprintf(stderr, "Message %zu is wrong\n", i);
+            break;
+        }
+
+        if ( (i + 1) % batch_size == 0 && ::write(ack, &token, 1) != 1 )
+            return 1;
+    }
+
+    CHECK(reader.overruns() == 0);
+    CHECK(!reader.try_read(msg));
+    return check_result();
+}
+
+int main() {
+    std::string name = "bragi-shm-test-" + std::to_string(::getpid());
+
+    // 256 slots, so a batch fits with room to spare but the ring wraps many times
+    Output output(std::unique_ptr<OutputBackend>(new ShmOutput(name, 256)));
+    output.connect();
+
+    int ready[2], ack[2];
+    if ( ::pipe(ready) != 0 || ::pipe(ack) != 0 )
+        return 1;
+
+    pid_t child = ::fork();
+    if ( child < 0 )
+        return 1;
+    if ( child == 0 )
+        ::_exit(read_all(name, ready[1], ack[1]));
+
+    char token;
+    CHECK(::read(ready[0], &token, 1) == 1);
+
+    for ( size_t i = 0; i < message_count; i++ ) {
+        std::basic_string<uint8_t> bytes = expected(i);
+        if ( bytes.size() == 3 )
+            output.send_msg(ShortMessage(bytes[0], bytes[1], bytes[2]));
+        else
+            output.send_raw(bytes.data(), bytes.size());
+
+        // Stops early if the reader gave up
+        if ( (i + 1) % batch_size == 0 && ::read(ack[0], &token, 1) != 1 )
+            break;
+    }
+
+    int status = 0;
+    CHECK(::waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    output.disconnect();
+    return check_result();
+}
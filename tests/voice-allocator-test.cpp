@@ -0,0 +1,146 @@
+#include <bragi/midi/v1/midi.hh>
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace bragi::midi::v1;
+
+using Bytes = std::basic_string<uint8_t>;
+
+/**
+ * @brief An allocator sending to a simulated device, handing back what each step sent
+ */
+struct Recorded {
+    std::shared_ptr<SimulatedDeviceProvider> devices = std::make_shared<SimulatedDeviceProvider>(1);
+    DeviceRegistry                           registry{devices, std::chrono::hours(1)};
+    VoiceAllocator                           voices;
+
+    Recorded(std::vector<uint8_t> channels, StealPolicy policy = StealPolicy::oldest):
+        voices(registry.acquire(0), std::move(channels), policy) {}
+
+    /// @brief Bytes sent since the last call
+    Bytes take() {
+        Bytes sent = devices->sent(0);
+        devices->clear();
+        return sent;
+    }
+};
+
+static Bytes msg(uint8_t status, uint8_t data1, uint8_t data2) {
+    return Bytes({status, data1, data2});
+}
+
+/**
+ * @brief Start a note while three voices sound notes of velocity 80, 40 and 40
+ *
+ * @returns Channel of the voice stolen, @c 0 if the note was dropped
+ */
+static uint8_t steal(StealPolicy policy) {
+    Recorded rec({1, 2, 3}, policy);
+
+    uint64_t notes[3] = {rec.voices.note_on(60, 80), rec.voices.note_on(62, 40), rec.voices.note_on(64, 40)};
+    for ( size_t i = 0; i < 3; i++ )
+        CHECK(rec.voices.channel(notes[i]) == i + 1);
+    rec.take();
+
+    uint64_t note = rec.voices.note_on(70, 100);
+    Bytes    sent = rec.take();
+
+    if ( note == VoiceAllocator::no_voice ) {
+        CHECK(sent.empty());
+        CHECK(rec.voices.dropped() == 1 && rec.voices.stolen() == 0 && rec.voices.sounding_count() == 3);
+        return 0;
+    }
+
+    uint8_t channel = rec.voices.channel(note);
+    size_t  victim  = channel - 1;
+    uint8_t pitch   = static_cast<uint8_t>(60 + 2 * victim);
+
+    // The stolen note ends before the new one starts on its voice
+    CHECK(sent == msg(MessageType::note_off | channel, pitch, 0x40) + msg(MessageType::note_on | channel, 70, 100));
+    CHECK(rec.voices.stolen() == 1 && rec.voices.sounding_count() == 3);
+
+    // Its id no longer refers to anything, the others still do
+    CHECK(!rec.voices.note_off(notes[victim]));
+    CHECK(!rec.voices.pitch_bend(notes[victim], 0));
+    for ( size_t i = 0; i < 3; i++ )
+        if ( i != victim )
+            CHECK(rec.voices.channel(notes[i]) == i + 1);
+    CHECK(rec.take().empty());
+
+    return channel;
+}
+
+// Which note each policy steals, ties in velocity going to the oldest
+static void test_steal_order() {
+    CHECK(steal(StealPolicy::oldest) == 1);
+    CHECK(steal(StealPolicy::newest) == 3);
+    CHECK(steal(StealPolicy::quietest) == 2);
+    CHECK(steal(StealPolicy::none) == 0);
+}
+
+// Free voices are taken first, then the one released longest ago, neither stealing
+static void test_free_then_released() {
+    Recorded rec({1, 2, 3}, StealPolicy::none);
+
+    uint64_t first = rec.voices.note_on(60);
+    CHECK(rec.voices.note_off(first));
+    CHECK(rec.voices.channel(rec.voices.note_on(62)) == 2);
+    CHECK(rec.voices.channel(rec.voices.note_on(64)) == 3);
+
+    uint64_t third = rec.voices.note_on(66);
+    CHECK(rec.voices.channel(third) == 1);
+    CHECK(rec.voices.note_off(third));
+
+    rec.take();
+    uint64_t again = rec.voices.note_on(68, 90);
+    CHECK(rec.voices.channel(again) == 1);
+    CHECK(rec.take() == msg(MessageType::note_on | 1, 68, 90));
+    CHECK(rec.voices.stolen() == 0 && rec.voices.dropped() == 0);
+}
+
+// Ids of notes which ended are ignored, however often their voice was reused since
+static void test_stale_ids() {
+    Recorded rec({5});
+
+    uint64_t first = rec.voices.note_on(60);
+    CHECK(rec.voices.note_off(first));
+    rec.take();
+
+    CHECK(!rec.voices.note_off(first));
+    CHECK(!rec.voices.pitch_bend(first, 0));
+    CHECK(!rec.voices.pressure(first, 10));
+    CHECK(!rec.voices.timbre(first, 10));
+    try {
+        rec.voices.channel(first);
+        CHECK(!"channel() of an ended note should throw");
+    } catch ( std::domain_error& ) {}
+    CHECK(rec.take().empty());
+
+    // As many notes again as a 16-bit count of them holds
+    uint64_t last = first;
+    for ( size_t i = 0; i < size_t(1) << 16; i++ ) {
+        last = rec.voices.note_on(60 + i % 12);
+        CHECK(last != first);
+    }
+    rec.take();
+
+    CHECK(!rec.voices.note_off(first));
+    CHECK(!rec.voices.pitch_bend(first, 0));
+    CHECK(rec.take().empty());
+
+    CHECK(rec.voices.pitch_bend(last, 0x3000));
+    CHECK(rec.voices.note_off(last));
+    CHECK(rec.take() == msg(MessageType::pitch_bend | 5, 0x00, 0x60) + msg(MessageType::note_off | 5, 63, 0x40));
+}
+
+int main() {
+    test_steal_order();
+    test_free_then_released();
+    test_stale_ids();
+    return check_result();
+}